@@ -0,0 +1,514 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "ImageProcessor.h"
+#include "Parallel.h"
+#include "PixelKernels.h"
+
+// Quality of a filter result against a ground-truth image, following the
+// DIBCO conventions: foreground is dark (text), F-measure and pseudo
+// F-measure are in percent, PSNR in dB, DRD is lower-is-better.
+class BinarizationMetrics
+{
+public:
+    struct BinaryScores
+    {
+        double precision = 0.0;
+        double recall = 0.0;
+        double fMeasure = 0.0;
+        double pseudoFMeasure = 0.0;
+        double psnr = 0.0;
+        double drd = 0.0;
+    };
+
+    struct GrayScores
+    {
+        double psnr = 0.0;
+        double ssim = 0.0;
+    };
+
+    // Everything about the ground truth that does not depend on the scored
+    // image, so batches pay for thinning and block statistics only once.
+    struct GroundTruth
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> foreground;
+        std::vector<uint8_t> skeleton;
+        long long foregroundCount = 0;
+        long long skeletonCount = 0;
+        long long nonUniformBlocks = 0;
+    };
+
+    template <typename T>
+    static GroundTruth PrepareGroundTruth(const ImageProcessor::ImageT<T> &gt)
+    {
+        GroundTruth prepared;
+        prepared.width = gt.width;
+        prepared.height = gt.height;
+        ExtractForeground(gt, prepared.foreground);
+
+        prepared.skeleton = prepared.foreground;
+        Thin(prepared.skeleton, gt.width, gt.height);
+
+        prepared.foregroundCount = CountOnes(prepared.foreground.data(), prepared.foreground.size());
+        prepared.skeletonCount = CountOnes(prepared.skeleton.data(), prepared.skeleton.size());
+        prepared.nonUniformBlocks = CountNonUniformBlocks(prepared.foreground, gt.width, gt.height);
+        return prepared;
+    }
+
+    template <typename T>
+    static BinaryScores ScoreBinary(const ImageProcessor::ImageT<T> &result, const GroundTruth &gt, bool parallel = true)
+    {
+        BinaryScores scores;
+        if (result.width != gt.width || result.height != gt.height || gt.foreground.empty())
+            return scores;
+
+        std::vector<uint8_t> fg;
+        ExtractForeground(result, fg, parallel);
+
+        const int width = gt.width;
+        const int height = gt.height;
+        const int workers = parallel ? Parallel::WorkerCount(height, MIN_ROWS_PER_WORKER) : 1;
+        std::vector<Counts> partial(workers);
+
+        auto body = [&](int y0, int y1, int worker)
+        {
+            Counts &c = partial[worker];
+            size_t begin = (size_t)y0 * width;
+            size_t n = (size_t)(y1 - y0) * width;
+            CountOverlap(fg.data() + begin, gt.foreground.data() + begin, n, c.tp, c.resultOnes);
+            c.skeletonHits += CountAnd(fg.data() + begin, gt.skeleton.data() + begin, n);
+            c.drd += DrdRows(fg, gt.foreground, width, height, y0, y1);
+        };
+        RunRows(height, parallel, body);
+
+        Counts total;
+        for (const Counts &c : partial)
+        {
+            total.tp += c.tp;
+            total.resultOnes += c.resultOnes;
+            total.skeletonHits += c.skeletonHits;
+            total.drd += c.drd;
+        }
+
+        long long fp = total.resultOnes - total.tp;
+        long long fn = gt.foregroundCount - total.tp;
+        double pixels = (double)width * height;
+
+        scores.precision = total.resultOnes > 0 ? (double)total.tp / total.resultOnes : 0.0;
+        scores.recall = gt.foregroundCount > 0 ? (double)total.tp / gt.foregroundCount : 0.0;
+        scores.fMeasure = Harmonic(scores.precision, scores.recall) * 100.0;
+
+        double pseudoRecall = gt.skeletonCount > 0 ? (double)total.skeletonHits / gt.skeletonCount : 0.0;
+        scores.pseudoFMeasure = Harmonic(scores.precision, pseudoRecall) * 100.0;
+
+        double mse = (double)(fp + fn) / pixels;
+        scores.psnr = mse > 0.0 ? 10.0 * std::log10(1.0 / mse) : INFINITY;
+        scores.drd = total.drd / (double)std::max(1LL, gt.nonUniformBlocks);
+        return scores;
+    }
+
+    template <typename T>
+    static GrayScores ScoreGray(const ImageProcessor::ImageT<T> &result, const ImageProcessor::ImageT<T> &reference, bool parallel = true)
+    {
+        GrayScores scores;
+        if (result.width != reference.width || result.height != reference.height || result.data.empty())
+            return scores;
+
+        const int width = result.width;
+        const int height = result.height;
+        const double peak = (double)PixelTraits<T>::Max;
+        const size_t n = (size_t)width * height;
+
+        std::vector<float> x, y;
+        ExtractLuma(result, x, parallel);
+        ExtractLuma(reference, y, parallel);
+
+        std::vector<float> xx(n), yy(n), xy(n);
+        const int workers = parallel ? Parallel::WorkerCount(height, MIN_ROWS_PER_WORKER) : 1;
+        std::vector<double> sqErr(workers, 0.0);
+
+        auto products = [&](int y0, int y1, int worker)
+        {
+            double err = 0.0;
+            for (size_t i = (size_t)y0 * width; i < (size_t)y1 * width; ++i)
+            {
+                float d = x[i] - y[i];
+                err += d * d;
+                xx[i] = x[i] * x[i];
+                yy[i] = y[i] * y[i];
+                xy[i] = x[i] * y[i];
+            }
+            sqErr[worker] += err;
+        };
+        RunRows(height, parallel, products);
+
+        double mse = 0.0;
+        for (double e : sqErr)
+            mse += e;
+        mse /= (double)n;
+        scores.psnr = mse > 0.0 ? 10.0 * std::log10(peak * peak / mse) : INFINITY;
+
+        std::vector<float> kernel = SsimKernel();
+        std::vector<float> muX(n), muY(n), sXX(n), sYY(n), sXY(n);
+        GaussianPlane(x, muX, width, height, kernel, parallel);
+        GaussianPlane(y, muY, width, height, kernel, parallel);
+        GaussianPlane(xx, sXX, width, height, kernel, parallel);
+        GaussianPlane(yy, sYY, width, height, kernel, parallel);
+        GaussianPlane(xy, sXY, width, height, kernel, parallel);
+
+        const float c1 = (float)((0.01 * peak) * (0.01 * peak));
+        const float c2 = (float)((0.03 * peak) * (0.03 * peak));
+        std::vector<double> ssimSum(workers, 0.0);
+
+        auto ssimRows = [&](int y0, int y1, int worker)
+        {
+            double sum = 0.0;
+            for (size_t i = (size_t)y0 * width; i < (size_t)y1 * width; ++i)
+            {
+                float mx = muX[i];
+                float my = muY[i];
+                float vx = sXX[i] - mx * mx;
+                float vy = sYY[i] - my * my;
+                float cov = sXY[i] - mx * my;
+                sum += ((2.0f * mx * my + c1) * (2.0f * cov + c2)) /
+                       ((mx * mx + my * my + c1) * (vx + vy + c2));
+            }
+            ssimSum[worker] += sum;
+        };
+        RunRows(height, parallel, ssimRows);
+
+        double total = 0.0;
+        for (double s : ssimSum)
+            total += s;
+        scores.ssim = total / (double)n;
+        return scores;
+    }
+
+    // Scores many outputs against one ground truth; images are spread across
+    // threads and each is scored single-threaded to avoid nested fan-out.
+    template <typename T>
+    static std::vector<BinaryScores> ScoreBinaryBatch(const std::vector<const ImageProcessor::ImageT<T> *> &results, const GroundTruth &gt)
+    {
+        std::vector<BinaryScores> scores(results.size());
+        Parallel::For(0, (int)results.size(), [&](int i0, int i1, int)
+                      {
+                          for (int i = i0; i < i1; ++i)
+                              scores[i] = ScoreBinary(*results[i], gt, false);
+                      });
+        return scores;
+    }
+
+private:
+    static constexpr int MIN_ROWS_PER_WORKER = 64;
+    static constexpr int DRD_RADIUS = 2;
+    static constexpr int DRD_SIZE = 2 * DRD_RADIUS + 1;
+    static constexpr int DRD_BLOCK = 8;
+
+    struct Counts
+    {
+        long long tp = 0;
+        long long resultOnes = 0;
+        long long skeletonHits = 0;
+        double drd = 0.0;
+    };
+
+    template <typename F>
+    static void RunRows(int height, bool parallel, F &&body)
+    {
+        if (parallel)
+            Parallel::For(0, height, body, MIN_ROWS_PER_WORKER);
+        else
+            body(0, height, 0);
+    }
+
+    static double Harmonic(double a, double b)
+    {
+        return (a + b) > 0.0 ? 2.0 * a * b / (a + b) : 0.0;
+    }
+
+    template <typename T>
+    static void ExtractForeground(const ImageProcessor::ImageT<T> &img, std::vector<uint8_t> &fg, bool parallel = true)
+    {
+        const T half = (T)(PixelTraits<T>::Max / 2 + (std::is_integral<T>::value ? 1 : 0));
+        fg.resize((size_t)img.width * img.height);
+        RunRows(img.height, parallel, [&](int y0, int y1, int)
+                {
+                    for (int y = y0; y < y1; ++y)
+                    {
+                        uint8_t *out = fg.data() + (size_t)y * img.width;
+                        if constexpr (std::is_same<T, unsigned char>::value)
+                        {
+                            PixelKernels::Get().mask.fn(img.data.data() + (size_t)y * img.width * 4, out, img.width, half);
+                        }
+                        else
+                        {
+                            for (int x = 0; x < img.width; ++x)
+                                out[x] = ImageProcessor::GetLum(img, x, y) < half ? 1 : 0;
+                        }
+                    }
+                });
+    }
+
+    template <typename T>
+    static void ExtractLuma(const ImageProcessor::ImageT<T> &img, std::vector<float> &luma, bool parallel)
+    {
+        luma.resize((size_t)img.width * img.height);
+        RunRows(img.height, parallel, [&](int y0, int y1, int)
+                {
+                    for (int y = y0; y < y1; ++y)
+                        for (int x = 0; x < img.width; ++x)
+                            luma[(size_t)y * img.width + x] = (float)ImageProcessor::GetLum(img, x, y);
+                });
+    }
+
+#ifdef LAB2_SSE2
+    static long long SumLanes(__m128i acc)
+    {
+        alignas(16) long long lanes[2];
+        _mm_store_si128((__m128i *)lanes, acc);
+        return lanes[0] + lanes[1];
+    }
+#endif
+
+    static long long CountOnes(const uint8_t *a, size_t n)
+    {
+        long long count = 0;
+        size_t i = 0;
+#ifdef LAB2_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16)
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a + i)), zero));
+        count += SumLanes(acc);
+#endif
+        for (; i < n; ++i)
+            count += a[i];
+        return count;
+    }
+
+    static long long CountAnd(const uint8_t *a, const uint8_t *b, size_t n)
+    {
+        long long count = 0;
+        size_t i = 0;
+#ifdef LAB2_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i both = _mm_and_si128(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i)));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(both, zero));
+        }
+        count += SumLanes(acc);
+#endif
+        for (; i < n; ++i)
+            count += a[i] & b[i];
+        return count;
+    }
+
+    static void CountOverlap(const uint8_t *result, const uint8_t *gt, size_t n, long long &tp, long long &resultOnes)
+    {
+        tp += CountAnd(result, gt, n);
+        resultOnes += CountOnes(result, n);
+    }
+
+    static const float *DrdWeights()
+    {
+        static const std::array<float, DRD_SIZE * DRD_SIZE> weights = []()
+        {
+            std::array<float, DRD_SIZE * DRD_SIZE> w{};
+            float sum = 0.0f;
+            for (int dy = -DRD_RADIUS; dy <= DRD_RADIUS; ++dy)
+            {
+                for (int dx = -DRD_RADIUS; dx <= DRD_RADIUS; ++dx)
+                {
+                    float v = (dx == 0 && dy == 0) ? 0.0f : 1.0f / std::sqrt((float)(dx * dx + dy * dy));
+                    w[(dy + DRD_RADIUS) * DRD_SIZE + dx + DRD_RADIUS] = v;
+                    sum += v;
+                }
+            }
+            for (float &v : w)
+                v /= sum;
+            return w;
+        }();
+        return weights.data();
+    }
+
+    static double DrdRows(const std::vector<uint8_t> &result, const std::vector<uint8_t> &gt, int width, int height, int y0, int y1)
+    {
+        const float *weights = DrdWeights();
+        double drd = 0.0;
+
+        for (int y = y0; y < y1; ++y)
+        {
+            const uint8_t *r = result.data() + (size_t)y * width;
+            const uint8_t *g = gt.data() + (size_t)y * width;
+            for (int x = 0; x < width; ++x)
+            {
+                if (r[x] == g[x])
+                    continue;
+
+                float d = 0.0f;
+                for (int dy = -DRD_RADIUS; dy <= DRD_RADIUS; ++dy)
+                {
+                    int yy = y + dy;
+                    if (yy < 0 || yy >= height)
+                        continue;
+                    const uint8_t *gRow = gt.data() + (size_t)yy * width;
+                    for (int dx = -DRD_RADIUS; dx <= DRD_RADIUS; ++dx)
+                    {
+                        int xx = x + dx;
+                        if (xx < 0 || xx >= width)
+                            continue;
+                        if (gRow[xx] != r[x])
+                            d += weights[(dy + DRD_RADIUS) * DRD_SIZE + dx + DRD_RADIUS];
+                    }
+                }
+                drd += d;
+            }
+        }
+        return drd;
+    }
+
+    static long long CountNonUniformBlocks(const std::vector<uint8_t> &fg, int width, int height)
+    {
+        long long blocks = 0;
+        for (int by = 0; by + DRD_BLOCK <= height; by += DRD_BLOCK)
+        {
+            for (int bx = 0; bx + DRD_BLOCK <= width; bx += DRD_BLOCK)
+            {
+                int ones = 0;
+                for (int y = by; y < by + DRD_BLOCK; ++y)
+                    for (int x = bx; x < bx + DRD_BLOCK; ++x)
+                        ones += fg[(size_t)y * width + x];
+                if (ones != 0 && ones != DRD_BLOCK * DRD_BLOCK)
+                    blocks++;
+            }
+        }
+        return blocks;
+    }
+
+    // Zhang-Suen thinning of the ground-truth foreground, used for the
+    // pseudo-recall term of the pseudo F-measure.
+    static void Thin(std::vector<uint8_t> &img, int width, int height)
+    {
+        auto at = [&](int x, int y) -> int
+        {
+            if (x < 0 || y < 0 || x >= width || y >= height)
+                return 0;
+            return img[(size_t)y * width + x];
+        };
+
+        std::vector<size_t> toClear;
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                toClear.clear();
+                for (int y = 0; y < height; ++y)
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        if (!img[(size_t)y * width + x])
+                            continue;
+
+                        int p[8] = {at(x, y - 1), at(x + 1, y - 1), at(x + 1, y), at(x + 1, y + 1),
+                                    at(x, y + 1), at(x - 1, y + 1), at(x - 1, y), at(x - 1, y - 1)};
+                        int neighbours = 0;
+                        int transitions = 0;
+                        for (int i = 0; i < 8; ++i)
+                        {
+                            neighbours += p[i];
+                            if (!p[i] && p[(i + 1) % 8])
+                                transitions++;
+                        }
+                        if (neighbours < 2 || neighbours > 6 || transitions != 1)
+                            continue;
+
+                        bool keep = (pass == 0) ? (p[0] * p[2] * p[4] != 0 || p[2] * p[4] * p[6] != 0)
+                                                : (p[0] * p[2] * p[6] != 0 || p[0] * p[4] * p[6] != 0);
+                        if (!keep)
+                            toClear.push_back((size_t)y * width + x);
+                    }
+                }
+                for (size_t idx : toClear)
+                    img[idx] = 0;
+                changed = changed || !toClear.empty();
+            }
+        }
+    }
+
+    static std::vector<float> SsimKernel()
+    {
+        const float sigma = 1.5f;
+        const int radius = 5;
+        std::vector<float> kernel(radius + 1);
+        float sum = 0.0f;
+        for (int i = 0; i <= radius; ++i)
+        {
+            kernel[i] = std::exp(-(float)(i * i) / (2.0f * sigma * sigma));
+            sum += (i == 0) ? kernel[i] : 2.0f * kernel[i];
+        }
+        for (float &w : kernel)
+            w /= sum;
+        return kernel;
+    }
+
+    // Separable blur of a float plane. The vertical pass walks whole rows, so
+    // both passes are contiguous loops the compiler vectorizes.
+    static void GaussianPlane(const std::vector<float> &in, std::vector<float> &out, int width, int height,
+                              const std::vector<float> &kernel, bool parallel)
+    {
+        const int radius = (int)kernel.size() - 1;
+        std::vector<float> tmp(in.size());
+
+        RunRows(height, parallel, [&](int y0, int y1, int)
+                {
+                    std::vector<float> padded(width + 2 * radius);
+                    for (int y = y0; y < y1; ++y)
+                    {
+                        const float *row = in.data() + (size_t)y * width;
+                        for (int i = 0; i < width + 2 * radius; ++i)
+                            padded[i] = row[std::max(0, std::min(i - radius, width - 1))];
+
+                        float *dst = tmp.data() + (size_t)y * width;
+                        const float *p = padded.data() + radius;
+                        for (int x = 0; x < width; ++x)
+                            dst[x] = p[x] * kernel[0];
+                        for (int k = 1; k <= radius; ++k)
+                        {
+                            float w = kernel[k];
+                            for (int x = 0; x < width; ++x)
+                                dst[x] += (p[x - k] + p[x + k]) * w;
+                        }
+                    }
+                });
+
+        RunRows(height, parallel, [&](int y0, int y1, int)
+                {
+                    for (int y = y0; y < y1; ++y)
+                    {
+                        float *dst = out.data() + (size_t)y * width;
+                        const float *center = tmp.data() + (size_t)y * width;
+                        for (int x = 0; x < width; ++x)
+                            dst[x] = center[x] * kernel[0];
+                        for (int k = 1; k <= radius; ++k)
+                        {
+                            const float *up = tmp.data() + (size_t)std::max(0, y - k) * width;
+                            const float *down = tmp.data() + (size_t)std::min(height - 1, y + k) * width;
+                            float w = kernel[k];
+                            for (int x = 0; x < width; ++x)
+                                dst[x] += (up[x] + down[x]) * w;
+                        }
+                    }
+                });
+    }
+};
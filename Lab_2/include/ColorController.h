@@ -2,275 +2,409 @@
 
 #include "imgui.h"
 #include <GL/gl.h>
+#include <array>
 #include <vector>
 #include <string>
 #include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <functional>
+#include <cstdio>
+#include <type_traits>
 
-#include "stb_image.h"
+#include "ImageProcessor.h"
+#include "ImageCache.h"
+#include "TiledImageView.h"
+#include "BinarizationMetrics.h"
+#include "SkewCorrection.h"
 
-class ImageProcessor
+class ColorController
 {
-public:
-    struct Image
+private:
+    template <typename T>
+    using Filter = std::function<void(const ImageProcessor::ImageT<T> &, ImageProcessor::ImageT<T> &)>;
+
+    struct FilterJob
     {
-        std::vector<unsigned char> data;
-        int width = 0;
-        int height = 0;
-        int channels = 0;
+        Filter<unsigned char> filter8;
+        Filter<unsigned short> filter16;
+        int halo;
     };
 
-    static bool LoadImageFromFile(const char *filename, Image &outImg)
+    struct RegionPatch
     {
-        unsigned char *imgData = stbi_load(filename, &outImg.width, &outImg.height, &outImg.channels, 4);
-        if (!imgData)
-            return false;
+        int x = 0;
+        int y = 0;
+        ImageProcessor::Image image;
+    };
 
-        outImg.data.assign(imgData, imgData + (outImg.width * outImg.height * 4));
-        outImg.channels = 4;
-        stbi_image_free(imgData);
-        return true;
-    }
+    struct ResultPane
+    {
+        ResultPane(TileCache &cache, const char *paneTitle, bool isBinary, const char *outputFile)
+            : view(cache), title(paneTitle), binary(isBinary), saveName(outputFile) {}
+
+        TiledImageView view;
+        const char *title;
+        bool binary;
+        const char *saveName;
+        std::string saveStatus;
+        FilterJob job;
+        bool scored = false;
+        BinarizationMetrics::BinaryScores binaryScores;
+        BinarizationMetrics::GrayScores grayScores;
+    };
 
-    static unsigned char GetLum(const Image &img, int x, int y)
+    TileCache tileCache;
+    TiledImageView originalView{tileCache};
+    ResultPane medianPane{tileCache, "Медианный фильтр", false, "median.pgm"};
+    ResultPane bernsenPane{tileCache, "Бернсен", true, "bernsen.pbm"};
+    ResultPane niblackPane{tileCache, "Ниблак", true, "niblack.pbm"};
+    ResultPane otsuPane{tileCache, "Отсу", true, "otsu.pbm"};
+
+    ImageProcessor::ImageView srcImg;
+    ImageProcessor::ImageView16 srcImg16;
+    bool highBitDepth = false;
+    bool sourceMapped = false;
+    std::string skewStatus;
+    std::vector<RegionPatch> patches;
+
+    ImageProcessor::Image gtImg;
+    BinarizationMetrics::GroundTruth groundTruth;
+    std::string metricsStatus;
+
+    float smoothSigma = 0.0f;
+    // Bernsen decides flat windows by the global Otsu level instead of mid-grey.
+    bool bernsenOtsu = false;
+
+    std::array<ResultPane *, 4> Panes()
     {
-        x = std::max(0, std::min(x, img.width - 1));
-        y = std::max(0, std::min(y, img.height - 1));
+        return {&medianPane, &bernsenPane, &niblackPane, &otsuPane};
+    }
+    std::string kernelReport = PixelKernels::Get().Report();
 
-        int idx = (y * img.width + x) * 4;
-        unsigned char r = img.data[idx];
-        unsigned char g = img.data[idx + 1];
-        unsigned char b = img.data[idx + 2];
+    bool HasImage() const
+    {
+        return highBitDepth ? !srcImg16.Empty() : !srcImg.Empty();
+    }
 
-        return static_cast<unsigned char>(0.299f * r + 0.587f * g + 0.114f * b);
+    int ImageWidth() const
+    {
+        return highBitDepth ? srcImg16.width : srcImg.width;
     }
 
-    static void ApplyMedian(const Image &src, Image &dst, int kernelSize = 3)
+    int ImageHeight() const
     {
-        dst = src;
-        int radius = kernelSize / 2;
-        std::vector<unsigned char> window;
-        window.reserve(kernelSize * kernelSize);
+        return highBitDepth ? srcImg16.height : srcImg.height;
+    }
 
-        for (int y = 0; y < src.height; ++y)
+    template <typename F>
+    FilterJob MakeJob(F filter, int halo, bool smooth) const
+    {
+        float sigma = smooth ? smoothSigma : 0.0f;
+        auto run = [filter, sigma](const auto &src, auto &dst)
         {
-            for (int x = 0; x < src.width; ++x)
+            if (sigma <= 0.0f)
             {
-                window.clear();
-                for (int ky = -radius; ky <= radius; ++ky)
-                {
-                    for (int kx = -radius; kx <= radius; ++kx)
-                    {
-                        window.push_back(GetLum(src, x + kx, y + ky));
-                    }
-                }
-                std::sort(window.begin(), window.end());
-                unsigned char med = window[window.size() / 2];
-
-                int idx = (y * src.width + x) * 4;
-                dst.data[idx] = med;
-                dst.data[idx + 1] = med;
-                dst.data[idx + 2] = med;
-                dst.data[idx + 3] = 255;
+                filter(src, dst);
+                return;
             }
-        }
+            typename std::decay<decltype(src)>::type smoothed;
+            ImageProcessor::ApplyGaussianBlur(src, smoothed, sigma);
+            filter(smoothed, dst);
+        };
+        return {run, run, halo + ImageProcessor::GaussianRadius(sigma)};
     }
 
-    static void ApplyBernsen(const Image &src, Image &dst, int kernelSize = 15, int contrastLimit = 15)
+    template <typename T>
+    static void FilterRegion(const ImageProcessor::ImageViewT<T> &src, const Filter<T> &filter, int halo,
+                             int x, int y, int w, int h, ImageProcessor::Image &out)
     {
-        dst = src;
-        int radius = kernelSize / 2;
+        int x0 = std::max(0, x - halo);
+        int y0 = std::max(0, y - halo);
+        int x1 = std::min(src.width, x + w + halo);
+        int y1 = std::min(src.height, y + h + halo);
+
+        ImageProcessor::ImageT<T> region;
+        ImageProcessor::ImageT<T> filtered;
+        ImageProcessor::CropImage(src, x0, y0, x1 - x0, y1 - y0, region);
+        filter(region, filtered);
 
-        for (int y = 0; y < src.height; ++y)
+        if constexpr (std::is_same<T, unsigned char>::value)
         {
-            for (int x = 0; x < src.width; ++x)
-            {
-                unsigned char minVal = 255;
-                unsigned char maxVal = 0;
-
-                for (int ky = -radius; ky <= radius; ++ky)
-                {
-                    for (int kx = -radius; kx <= radius; ++kx)
-                    {
-                        unsigned char val = GetLum(src, x + kx, y + ky);
-                        if (val < minVal)
-                            minVal = val;
-                        if (val > maxVal)
-                            maxVal = val;
-                    }
-                }
-
-                int mid = (minVal + maxVal) / 2;
-                int contrast = maxVal - minVal;
-                unsigned char pixel = GetLum(src, x, y);
-                unsigned char res = 0;
-
-                if (contrast < contrastLimit)
-                {
-                    res = (mid >= 128) ? 255 : 0;
-                }
-                else
-                {
-                    res = (pixel >= mid) ? 255 : 0;
-                }
-
-                int idx = (y * src.width + x) * 4;
-                dst.data[idx] = res;
-                dst.data[idx + 1] = res;
-                dst.data[idx + 2] = res;
-                dst.data[idx + 3] = 255;
-            }
+            ImageProcessor::CropImage(filtered, x - x0, y - y0, w, h, out);
+        }
+        else
+        {
+            ImageProcessor::ImageT<T> inner;
+            ImageProcessor::CropImage(filtered, x - x0, y - y0, w, h, inner);
+            ImageProcessor::ConvertImage(inner, out);
         }
     }
 
-    static void ApplyNiblack(const Image &src, Image &dst, int kernelSize = 15, float k = -0.2f)
+    void RunJob(const FilterJob &job, int x, int y, int w, int h, ImageProcessor::Image &out) const
     {
-        dst = src;
-        int radius = kernelSize / 2;
-        int N = kernelSize * kernelSize;
+        if (highBitDepth)
+            FilterRegion(srcImg16, job.filter16, job.halo, x, y, w, h, out);
+        else
+            FilterRegion(srcImg, job.filter8, job.halo, x, y, w, h, out);
+    }
 
-        for (int y = 0; y < src.height; ++y)
+    TiledImageView::TileFiller MakeFilterFiller(const FilterJob &job)
+    {
+        return [this, job](int x, int y, int w, int h, ImageProcessor::Image &tile)
         {
-            for (int x = 0; x < src.width; ++x)
-            {
-                float sum = 0.0f;
-                float sumSq = 0.0f;
-
-                for (int ky = -radius; ky <= radius; ++ky)
-                {
-                    for (int kx = -radius; kx <= radius; ++kx)
-                    {
-                        unsigned char val = GetLum(src, x + kx, y + ky);
-                        sum += val;
-                        sumSq += (val * val);
-                    }
-                }
-
-                float mean = sum / N;
-                float variance = (sumSq / N) - (mean * mean);
-                float sigma = std::sqrt(std::max(0.0f, variance));
-
-                float threshold = mean + k * sigma;
-
-                unsigned char pixel = GetLum(src, x, y);
-                unsigned char res = (pixel > threshold) ? 255 : 0;
-
-                int idx = (y * src.width + x) * 4;
-                dst.data[idx] = res;
-                dst.data[idx + 1] = res;
-                dst.data[idx + 2] = res;
-                dst.data[idx + 3] = 255;
-            }
-        }
+            RunJob(job, x, y, w, h, tile);
+        };
     }
-};
-
-class ColorController
-{
-private:
-    GLuint originalTex = 0;
-    GLuint medianTex = 0;
-    GLuint bernsenTex = 0;
-    GLuint niblackTex = 0;
-
-    ImageProcessor::Image srcImg;
 
-    GLuint CreateGLTexture(const ImageProcessor::Image &img)
+    void FillSourceTile(int x, int y, int w, int h, ImageProcessor::Image &tile) const
     {
-        if (img.data.empty())
-            return 0;
-        GLuint texID;
-        glGenTextures(1, &texID);
-        glBindTexture(GL_TEXTURE_2D, texID);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (highBitDepth)
+        {
+            ImageProcessor::Image16 region;
+            ImageProcessor::CropImage(srcImg16, x, y, w, h, region);
+            ImageProcessor::ConvertImage(region, tile);
+        }
+        else
+        {
+            ImageProcessor::CropImage(srcImg, x, y, w, h, tile);
+        }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.width, img.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.data.data());
-        return texID;
+        for (const RegionPatch &patch : patches)
+            ImageProcessor::PasteImage(patch.image, tile, patch.x - x, patch.y - y);
     }
 
 public:
-    ColorController() {}
+    ColorController()
+    {
+        originalView.EnableSelection(true);
+    }
+
+    void LoadImage(const char *filepath)
+    {
+        ImageCache::Entry entry;
+        if (ImageCache::Load(filepath, entry))
+            SetImage(entry);
+        else
+            std::cerr << "Error loading image: " << filepath << std::endl;
+    }
 
-    ~ColorController()
+    void SetImage(const ImageCache::Entry &entry)
     {
+        if (entry.Empty())
+            return;
+
+        highBitDepth = entry.highBitDepth;
+        sourceMapped = entry.mapped;
+        skewStatus.clear();
+        srcImg = entry.image8;
+        srcImg16 = entry.image16;
+
+        originalView.SetSource(ImageWidth(), ImageHeight(),
+                               [this](int x, int y, int w, int h, ImageProcessor::Image &tile)
+                               {
+                                   FillSourceTile(x, y, w, h, tile);
+                               });
+
+        patches.clear();
         ClearResults();
-        if (originalTex)
-            glDeleteTextures(1, &originalTex);
     }
 
-    void LoadImage(const char *filepath)
+    void ClearResults()
     {
-        if (ImageProcessor::LoadImageFromFile(filepath, srcImg))
+        for (ResultPane *pane : Panes())
         {
-            if (originalTex)
-                glDeleteTextures(1, &originalTex);
-            originalTex = CreateGLTexture(srcImg);
+            pane->view.Reset();
+            pane->scored = false;
+        }
+    }
 
-            ClearResults();
+    void LoadGroundTruth(const char *filepath)
+    {
+        ImageProcessor::Image img;
+        if (!ImageProcessor::LoadImageFromFile(filepath, img))
+        {
+            metricsStatus = "Не удалось загрузить эталон";
+            return;
         }
-        else
+        if (img.width != ImageWidth() || img.height != ImageHeight())
         {
-            std::cerr << "Error loading image: " << filepath << std::endl;
+            metricsStatus = "Размер эталона не совпадает с изображением";
+            return;
         }
+
+        gtImg = std::move(img);
+        groundTruth = BinarizationMetrics::PrepareGroundTruth(gtImg);
+        metricsStatus.clear();
+        for (ResultPane *pane : Panes())
+            pane->scored = false;
     }
 
-    void ClearResults()
+    void EvaluateResults()
     {
-        if (medianTex)
+        if (gtImg.data.empty() || gtImg.width != ImageWidth() || gtImg.height != ImageHeight())
+            return;
+
+        for (ResultPane *pane : Panes())
         {
-            glDeleteTextures(1, &medianTex);
-            medianTex = 0;
+            if (!pane->view.HasSource())
+                continue;
+
+            ImageProcessor::Image result;
+            RunJob(pane->job, 0, 0, ImageWidth(), ImageHeight(), result);
+            if (pane->binary)
+                pane->binaryScores = BinarizationMetrics::ScoreBinary(result, groundTruth);
+            else
+                pane->grayScores = BinarizationMetrics::ScoreGray(result, gtImg);
+            pane->scored = true;
         }
-        if (bernsenTex)
+    }
+
+    // Binary results go to 1-bit P4, the median to 8-bit P5.
+    void SaveResult(ResultPane &pane)
+    {
+        ImageProcessor::Image result;
+        RunJob(pane.job, 0, 0, ImageWidth(), ImageHeight(), result);
+        auto format = pane.binary ? ImageProcessor::NetpbmFormat::Bitmap : ImageProcessor::NetpbmFormat::Graymap;
+        pane.saveStatus = ImageProcessor::SaveNetpbm(pane.saveName, result, format) ? std::string("Сохранено: ") + pane.saveName
+                                                                                    : std::string("Не удалось сохранить ") + pane.saveName;
+    }
+
+    FilterJob MedianJob() const
+    {
+        auto filter = [](const auto &src, auto &dst)
         {
-            glDeleteTextures(1, &bernsenTex);
-            bernsenTex = 0;
-        }
-        if (niblackTex)
+            ImageProcessor::ApplyMedian(src, dst, 3);
+        };
+        return MakeJob(filter, 3 / 2, false);
+    }
+
+    // The level is taken from the whole source once, so every tile is
+    // thresholded the same way.
+    int SourceOtsuLevel() const
+    {
+        return ImageProcessor::OtsuLevel(highBitDepth ? ImageProcessor::LumHistogram(srcImg16)
+                                                      : ImageProcessor::LumHistogram(srcImg));
+    }
+
+    FilterJob BernsenJob() const
+    {
+        const int level = bernsenOtsu ? SourceOtsuLevel() : -1;
+        auto filter = [level](const auto &src, auto &dst)
+        {
+            ImageProcessor::ApplyBernsen(src, dst, 15, 15, level);
+        };
+        return MakeJob(filter, 15 / 2, true);
+    }
+
+    FilterJob OtsuJob() const
+    {
+        const int level = SourceOtsuLevel();
+        auto filter = [level](const auto &src, auto &dst)
+        {
+            ImageProcessor::ApplyThreshold(src, dst, level);
+        };
+        return MakeJob(filter, 0, true);
+    }
+
+    FilterJob NiblackJob() const
+    {
+        auto filter = [](const auto &src, auto &dst)
+        {
+            ImageProcessor::ApplyNiblack(src, dst, 15, -0.2f);
+        };
+        return MakeJob(filter, 15 / 2, true);
+    }
+
+    void ShowJob(ResultPane &pane, const FilterJob &job)
+    {
+        if (!HasImage())
+            return;
+        pane.job = job;
+        pane.scored = false;
+        pane.saveStatus.clear();
+        pane.view.SetSource(ImageWidth(), ImageHeight(), MakeFilterFiller(job));
+    }
+
+    void ApplyToSelection(const FilterJob &job)
+    {
+        int x, y, w, h;
+        if (!HasImage() || !originalView.GetSelection(x, y, w, h))
+            return;
+
+        RegionPatch patch;
+        patch.x = x;
+        patch.y = y;
+        RunJob(job, x, y, w, h, patch.image);
+        patches.push_back(std::move(patch));
+        originalView.InvalidateRect(x, y, w, h);
+    }
+
+    void ClearPatches()
+    {
+        for (const RegionPatch &patch : patches)
+            originalView.InvalidateRect(patch.x, patch.y, patch.image.width, patch.image.height);
+        patches.clear();
+    }
+
+    // The whole page is measured and rotated back; the result replaces the
+    // source, so the filters and the ground truth see the corrected page.
+    template <typename T>
+    static double DeskewView(const ImageProcessor::ImageViewT<T> &view, ImageProcessor::ImageViewT<T> &out)
+    {
+        ImageProcessor::ImageT<T> page;
+        ImageProcessor::CropImage(view, 0, 0, view.width, view.height, page);
+        ImageProcessor::ImageT<T> rotated;
+        double angle = SkewCorrection::Deskew(page, rotated);
+        if (angle != 0.0)
+            out = ImageProcessor::MakeView(std::move(rotated));
+        return angle;
+    }
+
+    void OnBtnDeskew()
+    {
+        if (!HasImage())
+            return;
+
+        ImageCache::Entry entry;
+        entry.highBitDepth = highBitDepth;
+        double angle = highBitDepth ? DeskewView(srcImg16, entry.image16) : DeskewView(srcImg, entry.image8);
+        if (entry.Empty())
         {
-            glDeleteTextures(1, &niblackTex);
-            niblackTex = 0;
+            skewStatus = "Наклон не найден";
+            return;
         }
+
+        SetImage(entry);
+        char text[64];
+        std::snprintf(text, sizeof(text), "Наклон: %.2f°", angle);
+        skewStatus = text;
     }
 
     void OnBtnMedian()
     {
-        if (srcImg.data.empty())
-            return;
-        ImageProcessor::Image res;
-        ImageProcessor::ApplyMedian(srcImg, res, 3);
-        if (medianTex)
-            glDeleteTextures(1, &medianTex);
-        medianTex = CreateGLTexture(res);
+        ShowJob(medianPane, MedianJob());
     }
 
     void OnBtnBernsen()
     {
-        if (srcImg.data.empty())
-            return;
-        ImageProcessor::Image res;
-        ImageProcessor::ApplyBernsen(srcImg, res, 15, 15);
-        if (bernsenTex)
-            glDeleteTextures(1, &bernsenTex);
-        bernsenTex = CreateGLTexture(res);
+        ShowJob(bernsenPane, BernsenJob());
     }
 
     void OnBtnNiblack()
     {
-        if (srcImg.data.empty())
-            return;
-        ImageProcessor::Image res;
-        ImageProcessor::ApplyNiblack(srcImg, res, 15, -0.2f);
-        if (niblackTex)
-            glDeleteTextures(1, &niblackTex);
-        niblackTex = CreateGLTexture(res);
+        ShowJob(niblackPane, NiblackJob());
+    }
+
+    void OnBtnOtsu()
+    {
+        ShowJob(otsuPane, OtsuJob());
     }
 
     void Render()
     {
+        tileCache.BeginFrame();
+
         ImGui::Begin("Управление");
 
         ImGui::Text("V_15");
@@ -283,6 +417,24 @@ public:
         {
             LoadImage(fileNameBuf);
         }
+        if (HasImage())
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled("%d x %d, %s%s", ImageWidth(), ImageHeight(), highBitDepth ? "16 бит" : "8 бит",
+                                sourceMapped ? ", из кэша" : "");
+        }
+
+        ImGui::BeginDisabled(!HasImage());
+        if (ImGui::Button("Выровнять наклон"))
+        {
+            OnBtnDeskew();
+        }
+        ImGui::EndDisabled();
+        if (!skewStatus.empty())
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s", skewStatus.c_str());
+        }
 
         ImGui::Spacing();
         ImGui::Separator();
@@ -293,64 +445,141 @@ public:
             OnBtnMedian();
         }
 
+        ImGui::SliderFloat("Сглаживание (σ)", &smoothSigma, 0.0f, 10.0f, "%.1f");
+
         if (ImGui::Button("Бернсен"))
         {
             OnBtnBernsen();
         }
+        ImGui::SameLine();
+        ImGui::Checkbox("Отсу в однородных окнах", &bernsenOtsu);
 
         if (ImGui::Button("Ниблак"))
         {
             OnBtnNiblack();
         }
 
+        if (ImGui::Button("Отсу (глобальный порог)"))
+        {
+            OnBtnOtsu();
+        }
+
         ImGui::Spacing();
         ImGui::Separator();
+        ImGui::Text("В выделенной области:");
+        ImGui::TextDisabled("(правая кнопка мыши на \"Исходное\")");
 
-        ImGui::PushStyleColor(ImGuiCol_Button, (ImVec4)ImColor::HSV(0.0f, 0.6f, 0.6f));
-        if (ImGui::Button("Очистка"))
+        int selX, selY, selW, selH;
+        bool hasSelection = originalView.GetSelection(selX, selY, selW, selH);
+        ImGui::BeginDisabled(!hasSelection);
+        if (ImGui::Button("Медиана##roi"))
         {
-            ClearResults();
+            ApplyToSelection(MedianJob());
         }
-        ImGui::PopStyleColor();
+        ImGui::SameLine();
+        if (ImGui::Button("Бернсен##roi"))
+        {
+            ApplyToSelection(BernsenJob());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Ниблак##roi"))
+        {
+            ApplyToSelection(NiblackJob());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Отсу##roi"))
+        {
+            ApplyToSelection(OtsuJob());
+        }
+        ImGui::EndDisabled();
+        if (hasSelection)
+            ImGui::Text("Область: %d x %d", selW, selH);
 
-        ImGui::End();
+        ImGui::BeginDisabled(patches.empty());
+        if (ImGui::Button("Вернуть исходное"))
+        {
+            ClearPatches();
+        }
+        ImGui::EndDisabled();
 
-        ImGui::Begin("Исходное");
-        if (originalTex)
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Text("Оценка по эталону:");
+
+        static char gtFileNameBuf[128] = "";
+        ImGui::InputText("Эталон", gtFileNameBuf, 128);
+        if (ImGui::Button("Загрузить эталон"))
         {
-            float w = ImGui::GetWindowWidth();
-            float h = w * ((float)srcImg.height / (float)srcImg.width);
-            ImGui::Image((void *)(intptr_t)originalTex, ImVec2(w - 20, h));
+            LoadGroundTruth(gtFileNameBuf);
         }
-        else
+        ImGui::SameLine();
+        ImGui::BeginDisabled(gtImg.data.empty());
+        if (ImGui::Button("Оценить"))
         {
+            EvaluateResults();
         }
-        ImGui::End();
+        ImGui::EndDisabled();
+        if (!metricsStatus.empty())
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", metricsStatus.c_str());
+
+        ImGui::Spacing();
+        ImGui::Separator();
 
-        if (medianTex)
+        ImGui::PushStyleColor(ImGuiCol_Button, (ImVec4)ImColor::HSV(0.0f, 0.6f, 0.6f));
+        if (ImGui::Button("Очистка"))
         {
-            ImGui::Begin("Медианный фильтр");
-            float w = ImGui::GetWindowWidth();
-            float h = w * ((float)srcImg.height / (float)srcImg.width);
-            ImGui::Image((void *)(intptr_t)medianTex, ImVec2(w - 20, h));
-            ImGui::End();
+            ClearResults();
         }
+        ImGui::PopStyleColor();
 
-        if (bernsenTex)
+        ImGui::Spacing();
+        ImGui::Text("Тайлы в видеопамяти: %.1f / %.0f МБ",
+                    tileCache.ResidentBytes() / (1024.0f * 1024.0f),
+                    tileCache.Budget() / (1024.0f * 1024.0f));
+        ImGui::TextDisabled("SIMD: %s%s", CpuDispatch::Name(CpuDispatch::Active()),
+                            CpuDispatch::IsOverridden() ? " (LAB2_ISA)" : "");
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("%s", kernelReport.c_str());
+
+        if (FilterCalibration::Enabled())
         {
-            ImGui::Begin("Бернсен");
-            float w = ImGui::GetWindowWidth();
-            float h = w * ((float)srcImg.height / (float)srcImg.width);
-            ImGui::Image((void *)(intptr_t)bernsenTex, ImVec2(w - 20, h));
-            ImGui::End();
+            ImGui::TextDisabled("Калибровка: %d записей", (int)FilterCalibration::EntryCount());
+            if (ImGui::IsItemHovered() && FilterCalibration::EntryCount() > 0)
+                ImGui::SetTooltip("%s", FilterCalibration::Report().c_str());
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Сбросить"))
+                FilterCalibration::Reset();
         }
 
-        if (niblackTex)
+        ImGui::End();
+
+        ImGui::Begin("Исходное");
+        originalView.Render();
+        ImGui::End();
+
+        for (ResultPane *pane : Panes())
         {
-            ImGui::Begin("Ниблак");
-            float w = ImGui::GetWindowWidth();
-            float h = w * ((float)srcImg.height / (float)srcImg.width);
-            ImGui::Image((void *)(intptr_t)niblackTex, ImVec2(w - 20, h));
+            if (!pane->view.HasSource())
+                continue;
+
+            ImGui::Begin(pane->title);
+            if (pane->scored && pane->binary)
+            {
+                const BinarizationMetrics::BinaryScores &sc = pane->binaryScores;
+                ImGui::Text("F: %.2f  pF: %.2f  PSNR: %.2f  DRD: %.2f", sc.fMeasure, sc.pseudoFMeasure, sc.psnr, sc.drd);
+            }
+            else if (pane->scored)
+            {
+                ImGui::Text("PSNR: %.2f дБ  SSIM: %.4f", pane->grayScores.psnr, pane->grayScores.ssim);
+            }
+            if (ImGui::SmallButton(pane->binary ? "Сохранить PBM" : "Сохранить PGM"))
+                SaveResult(*pane);
+            if (!pane->saveStatus.empty())
+            {
+                ImGui::SameLine();
+                ImGui::TextDisabled("%s", pane->saveStatus.c_str());
+            }
+            pane->view.Render();
             ImGui::End();
         }
     }
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LAB2_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LAB2_TARGET(isa) __attribute__((target(isa)))
+#define LAB2_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define LAB2_TARGET(isa)
+#define LAB2_NOINLINE __declspec(noinline)
+#else
+#define LAB2_TARGET(isa)
+#define LAB2_NOINLINE
+#endif
+
+enum class Isa
+{
+    Scalar,
+    Sse2,
+    Sse41,
+    Avx2,
+    Avx512
+};
+
+// CPU features are probed once; LAB2_ISA=scalar|sse2|sse4.1|avx2|avx512 caps
+// the level that kernels may bind to, so variants can be compared on one machine.
+class CpuDispatch
+{
+public:
+    static Isa Detected()
+    {
+        static const Isa isa = Detect();
+        return isa;
+    }
+
+    static Isa Active()
+    {
+        static const Isa isa = ResolveActive();
+        return isa;
+    }
+
+    // True only when LAB2_ISA lowered the level; an unknown or higher value
+    // is ignored by Active() and does not count.
+    static bool IsOverridden()
+    {
+        return Active() != Detected();
+    }
+
+    static const char *Name(Isa isa)
+    {
+        switch (isa)
+        {
+        case Isa::Sse2:
+            return "sse2";
+        case Isa::Sse41:
+            return "sse4.1";
+        case Isa::Avx2:
+            return "avx2";
+        case Isa::Avx512:
+            return "avx512";
+        default:
+            return "scalar";
+        }
+    }
+
+    static bool Parse(const char *text, Isa &isa)
+    {
+        const Isa all[] = {Isa::Scalar, Isa::Sse2, Isa::Sse41, Isa::Avx2, Isa::Avx512};
+        for (Isa candidate : all)
+        {
+            if (std::strcmp(text, Name(candidate)) == 0)
+            {
+                isa = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static constexpr const char *ENV_NAME = "LAB2_ISA";
+
+private:
+    static Isa ResolveActive()
+    {
+        Isa isa = Detected();
+        const char *forced = std::getenv(ENV_NAME);
+        Isa requested;
+        if (forced && Parse(forced, requested) && requested < isa)
+            isa = requested;
+        return isa;
+    }
+
+    static Isa Detect()
+    {
+#if defined(LAB2_X86) && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+            return Isa::Avx512;
+        if (__builtin_cpu_supports("avx2"))
+            return Isa::Avx2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return Isa::Sse41;
+        if (__builtin_cpu_supports("sse2"))
+            return Isa::Sse2;
+        return Isa::Scalar;
+#elif defined(LAB2_X86) && defined(_MSC_VER)
+        int regs[4];
+        __cpuid(regs, 0);
+        const int maxLeaf = regs[0];
+
+        __cpuid(regs, 1);
+        const bool sse2 = (regs[3] & (1 << 26)) != 0;
+        const bool sse41 = (regs[2] & (1 << 19)) != 0;
+        const bool osxsave = (regs[2] & (1 << 27)) != 0;
+        const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+
+        bool avx2 = false;
+        bool avx512 = false;
+        if (maxLeaf >= 7 && (xcr0 & 0x6) == 0x6)
+        {
+            __cpuidex(regs, 7, 0);
+            avx2 = (regs[1] & (1 << 5)) != 0;
+            avx512 = (regs[1] & (1 << 16)) != 0 && (regs[1] & (1 << 30)) != 0 && (xcr0 & 0xE6) == 0xE6;
+        }
+
+        if (avx512)
+            return Isa::Avx512;
+        if (avx2)
+            return Isa::Avx2;
+        if (sse41)
+            return Isa::Sse41;
+        return sse2 ? Isa::Sse2 : Isa::Scalar;
+#else
+        return Isa::Scalar;
+#endif
+    }
+};
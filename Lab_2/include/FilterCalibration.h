@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "CpuDispatch.h"
+
+// Remembers which implementation of a filter ran fastest on this machine for a
+// given (filter, pixel type, kernel size, image size bucket). A missing entry is
+// measured on first use on synthetic data and stored in a small text file,
+// LAB2_CALIBRATION (default "lab2_calibration.txt"); LAB2_CALIBRATION=off
+// disables measuring and every filter uses its built-in default.
+class FilterCalibration
+{
+public:
+    static int SizeBucket(size_t pixels)
+    {
+        if (pixels < SMALL_PIXELS)
+            return 0;
+        if (pixels < LARGE_PIXELS)
+            return 1;
+        return 2;
+    }
+
+    // `timer(index, width, height)` times candidate `index` on a synthetic
+    // width x height image, in ms. A stored choice is found without touching
+    // the heap, so steady-state filtering stays allocation-free.
+    template <typename Timer>
+    static int Choose(const char *filter, const char *type, int kernelSize, size_t pixels,
+                      const char *const *names, int count, int fallback, const Timer &timer)
+    {
+        if (count <= 1)
+            return 0;
+
+        State &state = GetState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.Load();
+
+        const Key key{filter, type, kernelSize, SizeBucket(pixels)};
+        auto it = state.choices.find(key);
+        if (it != state.choices.end())
+        {
+            for (int i = 0; i < count; ++i)
+                if (it->second == names[i])
+                    return i;
+        }
+
+        if (!state.enabled)
+            return fallback;
+
+        int best = Measure(std::get<3>(key), count, timer);
+        state.choices[key] = names[best];
+        state.Save();
+        return best;
+    }
+
+    static bool Enabled()
+    {
+        State &state = GetState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.Load();
+        return state.enabled;
+    }
+
+    static size_t EntryCount()
+    {
+        State &state = GetState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.Load();
+        return state.choices.size();
+    }
+
+    static std::string Path()
+    {
+        return GetState().path;
+    }
+
+    // Forgets every stored choice and deletes the file, so the next call of
+    // each filter measures again.
+    static void Reset()
+    {
+        State &state = GetState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.choices.clear();
+        state.loaded = true;
+        if (state.enabled)
+            std::remove(state.path.c_str());
+    }
+
+    static std::string Report()
+    {
+        State &state = GetState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.Load();
+
+        std::string text;
+        for (const auto &entry : state.choices)
+        {
+            char line[160];
+            std::snprintf(line, sizeof(line), "%s %s k=%d size=%d: %s\n", std::get<0>(entry.first).c_str(),
+                          std::get<1>(entry.first).c_str(), std::get<2>(entry.first), std::get<3>(entry.first),
+                          entry.second.c_str());
+            text += line;
+        }
+        return text;
+    }
+
+private:
+    static constexpr size_t SMALL_PIXELS = 512 * 512;
+    static constexpr size_t LARGE_PIXELS = 2048 * 2048;
+    static constexpr int PROBE_SIZE = 64;
+    static constexpr double PROBE_KEEP_RATIO = 2.0;
+    static constexpr double MIN_SAMPLE_MS = 20.0;
+    static constexpr double MEASURE_BUDGET_MS = 50.0;
+    static constexpr int MAX_SAMPLES = 5;
+    static constexpr int FILE_VERSION = 1;
+
+    using Key = std::tuple<std::string, std::string, int, int>;
+
+    struct State
+    {
+        std::mutex mutex;
+        std::map<Key, std::string> choices;
+        std::string path;
+        bool enabled = true;
+        bool loaded = false;
+
+        State()
+        {
+            const char *env = std::getenv("LAB2_CALIBRATION");
+            path = env ? env : "lab2_calibration.txt";
+            enabled = !(env && std::strcmp(env, "off") == 0);
+        }
+
+        void Load()
+        {
+            if (loaded)
+                return;
+            loaded = true;
+            if (!enabled)
+                return;
+
+            FILE *file = std::fopen(path.c_str(), "r");
+            if (!file)
+                return;
+
+            char isa[32] = {};
+            int version = 0;
+            if (std::fscanf(file, "lab2-calibration %d %31s", &version, isa) == 2 && version == FILE_VERSION &&
+                std::strcmp(isa, CpuDispatch::Name(CpuDispatch::Active())) == 0)
+            {
+                char filter[32];
+                char type[16];
+                char name[32];
+                int kernel;
+                int bucket;
+                while (std::fscanf(file, "%31s %15s %d %d %31s", filter, type, &kernel, &bucket, name) == 5)
+                    choices[Key{filter, type, kernel, bucket}] = name;
+            }
+            std::fclose(file);
+        }
+
+        void Save() const
+        {
+            FILE *file = std::fopen(path.c_str(), "w");
+            if (!file)
+                return;
+
+            std::fprintf(file, "lab2-calibration %d %s\n", FILE_VERSION, CpuDispatch::Name(CpuDispatch::Active()));
+            for (const auto &entry : choices)
+                std::fprintf(file, "%s %s %d %d %s\n", std::get<0>(entry.first).c_str(), std::get<1>(entry.first).c_str(),
+                             std::get<2>(entry.first), std::get<3>(entry.first), entry.second.c_str());
+            std::fclose(file);
+        }
+    };
+
+    static State &GetState()
+    {
+        static State state;
+        return state;
+    }
+
+    // Every candidate runs on a small probe first; only those within
+    // PROBE_KEEP_RATIO of the fastest are timed again at a larger size, so a
+    // brute-force loop is never run on a large image. That size is the
+    // bucket's, shrunk until the probe cost of the slowest kept candidate,
+    // scaled by area, predicts at most MEASURE_BUDGET_MS per run: measuring
+    // runs on the calling (UI) thread and must not stall it.
+    template <typename Timer>
+    static int Measure(int bucket, int count, const Timer &timer)
+    {
+        static const int sides[] = {192, 768, 1536};
+
+        std::vector<double> probe(count);
+        double probeBest = 1e30;
+        for (int i = 0; i < count; ++i)
+        {
+            probe[i] = Sample(i, PROBE_SIZE, PROBE_SIZE, timer);
+            probeBest = std::min(probeBest, probe[i]);
+        }
+
+        double probeWorst = 0.0;
+        for (int i = 0; i < count; ++i)
+            if (probe[i] <= probeBest * PROBE_KEEP_RATIO)
+                probeWorst = std::max(probeWorst, probe[i]);
+
+        double scale = std::sqrt(MEASURE_BUDGET_MS / std::max(probeWorst, 1e-6));
+        const int side = std::min(sides[bucket], (int)(PROBE_SIZE * scale));
+
+        int best = 0;
+        double bestMs = 1e30;
+        for (int i = 0; i < count; ++i)
+        {
+            if (probe[i] > probeBest * PROBE_KEEP_RATIO)
+                continue;
+            double ms = side > PROBE_SIZE ? Sample(i, side, side, timer) : probe[i];
+            if (ms < bestMs)
+            {
+                bestMs = ms;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    template <typename Timer>
+    static double Sample(int index, int width, int height, const Timer &timer)
+    {
+        double best = 1e30;
+        double total = 0.0;
+        for (int run = 0; run < MAX_SAMPLES && total < MIN_SAMPLE_MS; ++run)
+        {
+            double ms = timer(index, width, height);
+            best = std::min(best, ms);
+            total += ms;
+        }
+        return best;
+    }
+};
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "ImageProcessor.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+// Decoded pixels of every opened JPEG/PNG are kept on disk in LAB2_IMAGE_CACHE
+// (default "lab2_cache"; LAB2_IMAGE_CACHE=off disables the cache). A cache file
+// is a fixed header followed by the raw RGBA rows from a page boundary on, so
+// reopening an image maps the file and neither decodes nor copies it. The
+// source file's size and modification time are kept in the header, and a
+// changed source is decoded again. Binary Netpbm files bypass the cache and
+// are mapped directly.
+class ImageCache
+{
+public:
+    struct Entry
+    {
+        ImageProcessor::ImageView image8;
+        ImageProcessor::ImageView16 image16;
+        bool highBitDepth = false;
+        // Pixels come straight from a mapped file (cache entry or Netpbm).
+        bool mapped = false;
+
+        bool Empty() const { return highBitDepth ? image16.Empty() : image8.Empty(); }
+    };
+
+    static bool Load(const char *path, Entry &entry)
+    {
+        entry = Entry();
+
+        // Netpbm rows are read from the file itself and need no cache.
+        ImageProcessor::NetpbmHeader netpbm;
+        if (ImageProcessor::ReadNetpbmHeader(path, netpbm))
+        {
+            entry.highBitDepth = netpbm.HighBitDepth();
+            entry.mapped = netpbm.ZeroCopy();
+            return entry.highBitDepth ? ImageProcessor::LoadNetpbm(path, entry.image16)
+                                      : ImageProcessor::LoadNetpbm(path, entry.image8);
+        }
+
+        Stamp stamp;
+        if (!GetStamp(path, stamp))
+            return false;
+
+        const bool enabled = Enabled();
+        std::string cachePath;
+        if (enabled)
+        {
+            cachePath = CachePath(path);
+            if (OpenCached(cachePath.c_str(), stamp, entry))
+                return true;
+        }
+
+        if (!Decode(path, entry))
+            return false;
+
+        if (enabled)
+            Store(cachePath, stamp, entry);
+        return true;
+    }
+
+    // Decodes a batch of files on all cores. Decoding time varies a lot
+    // between files, so each worker takes the next file from a shared counter
+    // instead of a fixed share of the list.
+    static std::vector<Entry> LoadBatch(const std::vector<std::string> &paths)
+    {
+        std::vector<Entry> entries(paths.size());
+        std::atomic<size_t> next{0};
+
+        Parallel::For(0, Parallel::WorkerCount((int)paths.size()), [&](int, int, int)
+                      {
+                          for (size_t i = next++; i < paths.size(); i = next++)
+                              Load(paths[i].c_str(), entries[i]);
+                      });
+        return entries;
+    }
+
+    static bool Enabled()
+    {
+        const char *env = std::getenv(ENV_NAME);
+        return !(env && std::strcmp(env, "off") == 0);
+    }
+
+    static std::string Directory()
+    {
+        const char *env = std::getenv(ENV_NAME);
+        return env ? env : "lab2_cache";
+    }
+
+    static std::string CachePath(const char *path)
+    {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(path, error);
+        std::string key = error ? std::string(path) : absolute.string();
+
+        // FNV-1a of the absolute path.
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.l2img", (unsigned long long)hash);
+        return (std::filesystem::path(Directory()) / name).string();
+    }
+
+    static constexpr const char *ENV_NAME = "LAB2_IMAGE_CACHE";
+
+private:
+    static constexpr uint32_t FILE_VERSION = 1;
+    static constexpr uint32_t DATA_OFFSET = 4096;
+
+    struct Stamp
+    {
+        uint64_t size = 0;
+        int64_t time = 0;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t bytesPerChannel;
+        uint32_t dataOffset;
+        uint64_t stride;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+    };
+
+    static_assert(sizeof(Header) == 56, "cache header layout");
+
+    static constexpr char MAGIC[8] = {'L', 'A', 'B', '2', 'I', 'M', 'G', '\0'};
+
+    static bool GetStamp(const char *path, Stamp &stamp)
+    {
+        std::error_code error;
+        stamp.size = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error)
+            return false;
+        stamp.time = (int64_t)time.time_since_epoch().count();
+        return true;
+    }
+
+    static bool Decode(const char *path, Entry &entry)
+    {
+        entry.highBitDepth = ImageProcessor::IsHighBitDepth(path);
+        if (entry.highBitDepth)
+        {
+            ImageProcessor::Image16 img;
+            if (!ImageProcessor::LoadImageFromFile(path, img))
+                return false;
+            entry.image16 = ImageProcessor::MakeView(std::move(img));
+        }
+        else
+        {
+            ImageProcessor::Image img;
+            if (!ImageProcessor::LoadImageFromFile(path, img))
+                return false;
+            entry.image8 = ImageProcessor::MakeView(std::move(img));
+        }
+        return true;
+    }
+
+    template <typename T>
+    static void MapView(const std::shared_ptr<const MappedFile> &file, const Header &header,
+                        ImageProcessor::ImageViewT<T> &view)
+    {
+        view.pixels = reinterpret_cast<const T *>(file->Data() + header.dataOffset);
+        view.width = (int)header.width;
+        view.height = (int)header.height;
+        view.channels = (int)header.channels;
+        view.stride = (size_t)(header.stride / sizeof(T));
+        view.owner = file;
+    }
+
+    static bool OpenCached(const char *cachePath, const Stamp &stamp, Entry &entry)
+    {
+        std::shared_ptr<const MappedFile> file = MappedFile::Open(cachePath);
+        if (!file || file->Size() < sizeof(Header))
+            return false;
+
+        Header header;
+        std::memcpy(&header, file->Data(), sizeof(Header));
+
+        const uint64_t bpc = header.bytesPerChannel;
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FILE_VERSION ||
+            header.sourceSize != stamp.size || header.sourceTime != stamp.time ||
+            (bpc != 1 && bpc != 2) || header.channels != 4 || header.width == 0 || header.height == 0 ||
+            header.dataOffset % 64 != 0 || header.stride % bpc != 0 ||
+            header.stride < (uint64_t)header.width * header.channels * bpc ||
+            header.dataOffset < sizeof(Header) || header.dataOffset > file->Size() ||
+            header.stride > (file->Size() - header.dataOffset) / header.height)
+            return false;
+
+        entry.highBitDepth = bpc == 2;
+        if (entry.highBitDepth)
+            MapView(file, header, entry.image16);
+        else
+            MapView(file, header, entry.image8);
+        entry.mapped = true;
+        return true;
+    }
+
+    template <typename T>
+    static bool WriteRows(FILE *file, const ImageProcessor::ImageViewT<T> &view, Header &header)
+    {
+        header.width = (uint32_t)view.width;
+        header.height = (uint32_t)view.height;
+        header.channels = (uint32_t)view.channels;
+        header.bytesPerChannel = sizeof(T);
+        header.stride = (uint64_t)view.width * view.channels * sizeof(T);
+
+        static const char padding[DATA_OFFSET] = {};
+        if (std::fwrite(&header, sizeof(Header), 1, file) != 1 ||
+            std::fwrite(padding, DATA_OFFSET - sizeof(Header), 1, file) != 1)
+            return false;
+
+        for (int y = 0; y < view.height; ++y)
+            if (std::fwrite(view.Row(y), header.stride, 1, file) != 1)
+                return false;
+        return true;
+    }
+
+    // Written under a temporary name and renamed, so a reader never maps a
+    // half-written file.
+    static void Store(const std::string &cachePath, const Stamp &stamp, const Entry &entry)
+    {
+        static std::atomic<unsigned> counter{0};
+
+        std::error_code error;
+        std::filesystem::create_directories(Directory(), error);
+
+        std::string tmpPath = cachePath + "." + std::to_string(counter++) + ".tmp";
+        FILE *file = std::fopen(tmpPath.c_str(), "wb");
+        if (!file)
+            return;
+
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = FILE_VERSION;
+        header.dataOffset = DATA_OFFSET;
+        header.sourceSize = stamp.size;
+        header.sourceTime = stamp.time;
+
+        bool written = entry.highBitDepth ? WriteRows(file, entry.image16, header)
+                                          : WriteRows(file, entry.image8, header);
+        written = std::fclose(file) == 0 && written;
+
+        if (written)
+            std::filesystem::rename(tmpPath, cachePath, error);
+        if (!written || error)
+            std::filesystem::remove(tmpPath, error);
+    }
+};
@@ -0,0 +1,2115 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <limits>
+#include <memory>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LAB2_SSE2 1
+#endif
+
+#include "stb_image.h"
+#include "PixelKernels.h"
+#include "FilterCalibration.h"
+#include "ScratchArena.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+template <typename T>
+struct PixelTraits;
+
+template <>
+struct PixelTraits<unsigned char>
+{
+    using Sum = int;
+    using Real = float;
+    static constexpr unsigned char Max = 255;
+    static constexpr const char *Name = "u8";
+    static Sum FromU8(int v) { return v; }
+    static unsigned char Round(double v) { return (unsigned char)std::min(255.0, v + 0.5); }
+};
+
+template <>
+struct PixelTraits<unsigned short>
+{
+    using Sum = long long;
+    using Real = double;
+    static constexpr unsigned short Max = 65535;
+    static constexpr const char *Name = "u16";
+    static Sum FromU8(int v) { return (Sum)v * 257; }
+    static unsigned short Round(double v) { return (unsigned short)std::min(65535.0, v + 0.5); }
+};
+
+template <>
+struct PixelTraits<float>
+{
+    using Sum = double;
+    using Real = float;
+    static constexpr float Max = 1.0f;
+    static constexpr const char *Name = "f32";
+    static Sum FromU8(int v) { return v / 255.0; }
+    static float Round(double v) { return (float)v; }
+};
+
+class ImageProcessor
+{
+public:
+    template <typename T>
+    struct ImageT
+    {
+        std::vector<T> data;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+    };
+
+    using Image = ImageT<unsigned char>;
+    using Image16 = ImageT<unsigned short>;
+    using ImageF = ImageT<float>;
+
+    // Read-only pixels stored elsewhere (a decoded image or a memory-mapped
+    // file); `owner` keeps that storage alive and `stride` is the distance
+    // between rows in elements.
+    template <typename T>
+    struct ImageViewT
+    {
+        const T *pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        size_t stride = 0;
+        std::shared_ptr<const void> owner;
+
+        bool Empty() const { return pixels == nullptr; }
+        const T *Row(int y) const { return pixels + (size_t)y * stride; }
+    };
+
+    using ImageView = ImageViewT<unsigned char>;
+    using ImageView16 = ImageViewT<unsigned short>;
+
+    template <typename T>
+    static ImageViewT<T> MakeView(ImageT<T> img)
+    {
+        auto owned = std::make_shared<ImageT<T>>(std::move(img));
+        ImageViewT<T> view;
+        view.pixels = owned->data.empty() ? nullptr : owned->data.data();
+        view.width = owned->width;
+        view.height = owned->height;
+        view.channels = owned->channels;
+        view.stride = (size_t)owned->width * owned->channels;
+        view.owner = std::move(owned);
+        return view;
+    }
+
+    // Borrows the pixels of img without owning them; valid while img lives
+    // and keeps its size.
+    template <typename T>
+    static ImageViewT<T> ViewOf(const ImageT<T> &img)
+    {
+        ImageViewT<T> view;
+        view.pixels = img.data.empty() ? nullptr : img.data.data();
+        view.width = img.width;
+        view.height = img.height;
+        view.channels = img.channels;
+        view.stride = (size_t)img.width * img.channels;
+        return view;
+    }
+
+    static bool LoadImageFromFile(const char *filename, Image &outImg)
+    {
+        unsigned char *imgData = stbi_load(filename, &outImg.width, &outImg.height, &outImg.channels, 4);
+        if (!imgData)
+            return false;
+
+        outImg.data.assign(imgData, imgData + (outImg.width * outImg.height * 4));
+        outImg.channels = 4;
+        stbi_image_free(imgData);
+        return true;
+    }
+
+    static bool LoadImageFromFile(const char *filename, Image16 &outImg)
+    {
+        unsigned short *imgData = stbi_load_16(filename, &outImg.width, &outImg.height, &outImg.channels, 4);
+        if (!imgData)
+            return false;
+
+        outImg.data.assign(imgData, imgData + (outImg.width * outImg.height * 4));
+        outImg.channels = 4;
+        stbi_image_free(imgData);
+        return true;
+    }
+
+    static bool LoadImageFromFile(const char *filename, ImageF &outImg)
+    {
+        Image16 img16;
+        if (!LoadImageFromFile(filename, img16))
+            return false;
+        ConvertImage(img16, outImg);
+        return true;
+    }
+
+    static bool IsHighBitDepth(const char *filename)
+    {
+        return stbi_is_16_bit(filename) != 0;
+    }
+
+    // Binary Netpbm: P4 (1 bit per pixel), P5 (gray) and P6 (RGB).
+    enum class NetpbmFormat
+    {
+        Bitmap = 4,
+        Graymap = 5,
+        Pixmap = 6
+    };
+
+    struct NetpbmHeader
+    {
+        NetpbmFormat format = NetpbmFormat::Graymap;
+        int width = 0;
+        int height = 0;
+        int maxValue = 1;
+        size_t dataOffset = 0;
+
+        int Channels() const { return format == NetpbmFormat::Pixmap ? 3 : 1; }
+        bool HighBitDepth() const { return maxValue > 255; }
+        // 8-bit P5/P6 rows are used in place; other files are converted.
+        bool ZeroCopy() const { return format != NetpbmFormat::Bitmap && maxValue == 255; }
+    };
+
+    static bool ReadNetpbmHeader(const char *filename, NetpbmHeader &header)
+    {
+        std::shared_ptr<const MappedFile> file = MappedFile::Open(filename);
+        return file && ParseNetpbmHeader(file->Data(), file->Size(), header);
+    }
+
+    // Maps the file; 8-bit P5/P6 are exposed as a view of the mapping without
+    // copying. P4 is expanded to 0 / Max gray, other ranges are rescaled.
+    template <typename T>
+    static bool LoadNetpbm(const char *filename, ImageViewT<T> &view)
+    {
+        static_assert(std::is_integral<T>::value, "Netpbm samples are integers");
+
+        std::shared_ptr<const MappedFile> file = MappedFile::Open(filename);
+        NetpbmHeader header;
+        if (!file || !ParseNetpbmHeader(file->Data(), file->Size(), header))
+            return false;
+
+        const int channels = header.Channels();
+        const unsigned char *data = file->Data() + header.dataOffset;
+
+        if constexpr (std::is_same<T, unsigned char>::value)
+        {
+            if (header.ZeroCopy())
+            {
+                view.pixels = data;
+                view.width = header.width;
+                view.height = header.height;
+                view.channels = channels;
+                view.stride = (size_t)header.width * channels;
+                view.owner = file;
+                return true;
+            }
+        }
+
+        ImageT<T> img;
+        img.width = header.width;
+        img.height = header.height;
+        img.channels = channels;
+        img.data.resize((size_t)header.width * header.height * channels);
+
+        if (header.format == NetpbmFormat::Bitmap)
+        {
+            const size_t rowBytes = ((size_t)header.width + 7) / 8;
+            for (int y = 0; y < header.height; ++y)
+            {
+                const unsigned char *row = data + (size_t)y * rowBytes;
+                T *out = img.data.data() + (size_t)y * header.width;
+                for (int x = 0; x < header.width; ++x)
+                    out[x] = ((row[x >> 3] >> (7 - (x & 7))) & 1) ? 0 : PixelTraits<T>::Max;
+            }
+        }
+        else
+        {
+            const bool wide = header.HighBitDepth();
+            const double scale = (double)PixelTraits<T>::Max / header.maxValue;
+            for (size_t i = 0; i < img.data.size(); ++i)
+            {
+                unsigned v = wide ? ((unsigned)data[2 * i] << 8) | data[2 * i + 1] : data[i];
+                img.data[i] = PixelTraits<T>::Round(v * scale);
+            }
+        }
+
+        view = MakeView(std::move(img));
+        return true;
+    }
+
+    // Rows are converted into one scratch row and written as they are ready.
+    // P5 stores luminance; P4 stores pixels darker than half the range as
+    // black, one bit each, which fits the 0 / Max output of Bernsen and
+    // Niblack. 8-bit images are written with maxval 255, others with 65535.
+    template <typename T>
+    static bool SaveNetpbm(const char *filename, const ImageT<T> &img, NetpbmFormat format)
+    {
+        if (img.data.empty() || img.channels != 4)
+            return false;
+
+        FILE *file = std::fopen(filename, "wb");
+        if (!file)
+            return false;
+
+        const int maxValue = std::is_same<T, unsigned char>::value ? 255 : 65535;
+        if (format == NetpbmFormat::Bitmap)
+            std::fprintf(file, "P4\n%d %d\n", img.width, img.height);
+        else
+            std::fprintf(file, "P%d\n%d %d\n%d\n", (int)format, img.width, img.height, maxValue);
+
+        const int channels = format == NetpbmFormat::Pixmap ? 3 : 1;
+        const size_t sampleBytes = maxValue > 255 ? 2 : 1;
+        const size_t rowBytes = format == NetpbmFormat::Bitmap ? ((size_t)img.width + 7) / 8
+                                                               : (size_t)img.width * channels * sampleBytes;
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<unsigned char> row = arena.Allocate<unsigned char>(rowBytes);
+        ScratchBuffer<T> lum = arena.Allocate<T>(img.width);
+
+        bool written = true;
+        for (int y = 0; y < img.height && written; ++y)
+        {
+            if (format == NetpbmFormat::Pixmap)
+            {
+                const T *in = img.data.data() + (size_t)y * img.width * 4;
+                for (int x = 0; x < img.width; ++x)
+                    for (int c = 0; c < 3; ++c)
+                        PutNetpbmSample(row.data(), (size_t)x * 3 + c, NetpbmSample(in[x * 4 + c]), sampleBytes);
+            }
+            else
+            {
+                LumaRow(img, y, lum.data());
+                if (format == NetpbmFormat::Bitmap)
+                {
+                    std::fill(row.begin(), row.end(), (unsigned char)0);
+                    for (int x = 0; x < img.width; ++x)
+                        if ((double)lum[x] * 2.0 < (double)PixelTraits<T>::Max)
+                            row[x >> 3] |= (unsigned char)(0x80 >> (x & 7));
+                }
+                else
+                {
+                    for (int x = 0; x < img.width; ++x)
+                        PutNetpbmSample(row.data(), x, NetpbmSample(lum[x]), sampleBytes);
+                }
+            }
+            written = std::fwrite(row.data(), rowBytes, 1, file) == 1;
+        }
+
+        return std::fclose(file) == 0 && written;
+    }
+
+    template <typename TDst, typename TSrc>
+    static void ConvertImage(const ImageT<TSrc> &src, ImageT<TDst> &dst)
+    {
+        dst.width = src.width;
+        dst.height = src.height;
+        dst.channels = src.channels;
+        dst.data.resize(src.data.size());
+
+        if constexpr (std::is_same<TDst, unsigned char>::value && std::is_same<TSrc, unsigned short>::value)
+        {
+            PixelKernels::Get().narrow.fn(src.data.data(), dst.data.data(), src.data.size());
+            return;
+        }
+
+        const double scale = (double)PixelTraits<TDst>::Max / (double)PixelTraits<TSrc>::Max;
+        for (size_t i = 0; i < src.data.size(); ++i)
+        {
+            double v = std::max(0.0, (double)src.data[i] * scale);
+            dst.data[i] = PixelTraits<TDst>::Round(v);
+        }
+    }
+
+    template <typename T>
+    static void ConvertImage(const ImageT<T> &src, ImageT<T> &dst)
+    {
+        dst = src;
+    }
+
+    template <typename T>
+    static T GetLum(const ImageT<T> &img, int x, int y)
+    {
+        x = std::max(0, std::min(x, img.width - 1));
+        y = std::max(0, std::min(y, img.height - 1));
+
+        int idx = (y * img.width + x) * 4;
+        T r = img.data[idx];
+        T g = img.data[idx + 1];
+        T b = img.data[idx + 2];
+
+        return static_cast<T>(0.299f * r + 0.587f * g + 0.114f * b);
+    }
+
+    template <typename T>
+    struct FilterVariant
+    {
+        const char *name;
+        bool (*supports)(int kernelSize);
+        // `level` is the Otsu level for Bernsen and unused elsewhere.
+        void (*run)(const ImageT<T> &src, ImageT<T> &dst, int kernelSize, double param, int level);
+    };
+
+    template <typename T>
+    struct FilterFamily
+    {
+        const char *name;
+        std::vector<FilterVariant<T>> variants;
+        // Used when calibration is switched off.
+        const char *(*preferred)(int kernelSize);
+    };
+
+    // Every registered implementation of median, Bernsen and Niblack, for
+    // tools that check them against each other.
+    template <typename T>
+    static std::array<const FilterFamily<T> *, 3> Families()
+    {
+        return {&MedianFamily<T>(), &BernsenFamily<T>(), &NiblackFamily<T>()};
+    }
+
+    // Each filter has several implementations; FilterCalibration picks the one
+    // that measured fastest on this machine for the kernel and image size.
+    template <typename T>
+    static void ApplyMedian(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 3)
+    {
+        RunBest(MedianFamily<T>(), src, dst, kernelSize, 0.0);
+    }
+
+    template <typename T>
+    static void ApplyMedianGeneric(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 3)
+    {
+        ResizeLike(src, dst);
+        int radius = kernelSize / 2;
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> window = arena.Allocate<T>((size_t)kernelSize * kernelSize);
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            for (int x = 0; x < src.width; ++x)
+            {
+                size_t count = 0;
+                for (int ky = -radius; ky <= radius; ++ky)
+                {
+                    for (int kx = -radius; kx <= radius; ++kx)
+                    {
+                        window[count++] = GetLum(src, x + kx, y + ky);
+                    }
+                }
+                std::sort(window.begin(), window.end());
+                T med = window[window.size() / 2];
+
+                WritePixel(dst, x, y, med);
+            }
+        }
+    }
+
+    // Median over a K x K window read from a border-padded luminance plane.
+    // Small windows run a pruned Batcher network over a strip of pixels, so
+    // every compare-exchange is a branch-free min/max over a contiguous array.
+    template <int K, typename T>
+    static void ApplyMedianFixed(const ImageT<T> &src, ImageT<T> &dst)
+    {
+        constexpr int R = K / 2;
+        constexpr int N = K * K;
+
+        ResizeLike(src, dst);
+        if (src.data.empty())
+            return;
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> plane = BuildLumPlane(arena, src, R);
+        const int stride = src.width + 2 * R;
+
+        if constexpr (N <= MEDIAN_NETWORK_MAX)
+        {
+            ScratchBuffer<T> lanes = arena.Allocate<T>((size_t)N * MEDIAN_STRIP);
+            for (int y = 0; y < src.height; ++y)
+            {
+                for (int x0 = 0; x0 < src.width; x0 += MEDIAN_STRIP)
+                {
+                    const int count = std::min(MEDIAN_STRIP, src.width - x0);
+                    for (int ky = 0; ky < K; ++ky)
+                    {
+                        const T *row = plane.data() + (size_t)(y + ky) * stride + x0;
+                        for (int kx = 0; kx < K; ++kx)
+                            std::memcpy(&lanes[(size_t)(ky * K + kx) * MEDIAN_STRIP], row + kx, count * sizeof(T));
+                    }
+
+                    RunMedianNetwork<N>(lanes.data(), std::make_index_sequence<MedianNetwork<N>::Get().count>());
+
+                    WriteSpan(dst, x0, y, &lanes[(size_t)(N / 2) * MEDIAN_STRIP], count);
+                }
+            }
+        }
+        else
+        {
+            std::array<T, N> window;
+            ScratchBuffer<T> out = arena.Allocate<T>(src.width);
+            for (int y = 0; y < src.height; ++y)
+            {
+                for (int x = 0; x < src.width; ++x)
+                {
+                    for (int ky = 0; ky < K; ++ky)
+                    {
+                        const T *row = plane.data() + (size_t)(y + ky) * stride + x;
+                        for (int kx = 0; kx < K; ++kx)
+                            window[ky * K + kx] = row[kx];
+                    }
+                    std::nth_element(window.begin(), window.begin() + N / 2, window.end());
+                    out[x] = window[N / 2];
+                }
+                WriteSpan(dst, 0, y, out.data(), src.width);
+            }
+        }
+    }
+
+    // Sliding-window (Huang) median over a two-level histogram: the coarse
+    // level indexes the high half of the value bits, so finding the median
+    // scans at most 2 * 2^(bits/2) bins instead of 2^bits.
+    template <typename T>
+    static void ApplyMedianHistogram(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 3)
+    {
+        static_assert(std::is_integral<T>::value, "histogram median needs integer pixels");
+        constexpr int BITS = sizeof(T) * 8;
+        constexpr int FINE_BITS = BITS / 2;
+        constexpr int COARSE_BINS = 1 << (BITS - FINE_BITS);
+        constexpr int FINE_BINS = 1 << BITS;
+
+        ResizeLike(src, dst);
+        if (src.data.empty())
+            return;
+
+        int radius = kernelSize / 2;
+        int rank = (kernelSize * kernelSize) / 2;
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> lum = arena.Allocate<T>((size_t)src.width * src.height);
+        for (int y = 0; y < src.height; ++y)
+            LumaRow(src, y, lum.data() + (size_t)y * src.width);
+
+        ScratchBuffer<uint32_t> coarse = arena.Allocate<uint32_t>(COARSE_BINS, 0);
+        ScratchBuffer<uint32_t> fine = arena.Allocate<uint32_t>(FINE_BINS, 0);
+
+        auto at = [&](int x, int y) -> T
+        {
+            x = std::max(0, std::min(x, src.width - 1));
+            y = std::max(0, std::min(y, src.height - 1));
+            return lum[(size_t)y * src.width + x];
+        };
+        auto add = [&](T v, int delta)
+        {
+            coarse[v >> FINE_BITS] += delta;
+            fine[v] += delta;
+        };
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            for (int ky = -radius; ky <= radius; ++ky)
+                for (int kx = -radius; kx <= radius; ++kx)
+                    add(at(kx, y + ky), 1);
+
+            for (int x = 0; x < src.width; ++x)
+            {
+                uint32_t acc = 0;
+                int c = 0;
+                while (acc + coarse[c] <= (uint32_t)rank)
+                    acc += coarse[c++];
+                int f = c << FINE_BITS;
+                while (acc + fine[f] <= (uint32_t)rank)
+                    acc += fine[f++];
+
+                WritePixel(dst, x, y, (T)f);
+
+                if (x + 1 < src.width)
+                {
+                    for (int ky = -radius; ky <= radius; ++ky)
+                    {
+                        add(at(x - radius, y + ky), -1);
+                        add(at(x + radius + 1, y + ky), 1);
+                    }
+                }
+            }
+
+            for (int ky = -radius; ky <= radius; ++ky)
+                for (int kx = -radius; kx <= radius; ++kx)
+                    add(at(src.width - 1 + kx, y + ky), -1);
+        }
+    }
+
+    static constexpr int HISTOGRAM_BINS = 256;
+    using Histogram = std::array<uint64_t, HISTOGRAM_BINS>;
+
+    // 8-bit luminance bin of a level of any pixel type.
+    template <typename T>
+    static int HistogramBin(T v)
+    {
+        if constexpr (std::is_same<T, unsigned char>::value)
+            return v;
+        else if constexpr (std::is_same<T, unsigned short>::value)
+            return v >> 8;
+        else
+            return std::max(0, std::min(HISTOGRAM_BINS - 1, (int)(v * (HISTOGRAM_BINS - 1) + 0.5f)));
+    }
+
+    // Luminance histogram in 256 bins (16-bit and float levels are scaled to
+    // 8 bits). Each worker counts its rows into its own sub-histograms, which
+    // are summed at the end, so the pass is bound by memory bandwidth rather
+    // than by contention on the counters.
+    template <typename T>
+    static Histogram LumHistogram(const ImageViewT<T> &src)
+    {
+        Histogram total = {};
+        if (src.Empty() || src.channels != 4)
+            return total;
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        const int workers = Parallel::WorkerCount(src.height, HISTOGRAM_MIN_ROWS);
+        ScratchBuffer<uint32_t> partial = arena.Allocate<uint32_t>((size_t)workers * HISTOGRAM_LANES * HISTOGRAM_BINS, 0);
+
+        Parallel::For(0, src.height, [&](int y0, int y1, int worker)
+                      {
+                          ScratchArena &local = ScratchArena::ForThread();
+                          ScratchArena::Scope localScope(local);
+                          ScratchBuffer<T> lum = local.Allocate<T>(src.width);
+                          uint32_t *h = partial.data() + (size_t)worker * HISTOGRAM_LANES * HISTOGRAM_BINS;
+                          for (int y = y0; y < y1; ++y)
+                          {
+                              LumaRow(src, y, lum.data());
+                              CountBins(lum.data(), src.width, h);
+                          }
+                      },
+                      HISTOGRAM_MIN_ROWS);
+
+        for (size_t lane = 0; lane < (size_t)workers * HISTOGRAM_LANES; ++lane)
+            for (int i = 0; i < HISTOGRAM_BINS; ++i)
+                total[i] += partial[lane * HISTOGRAM_BINS + i];
+        return total;
+    }
+
+    template <typename T>
+    static Histogram LumHistogram(const ImageT<T> &src)
+    {
+        return LumHistogram(ViewOf(src));
+    }
+
+    // Otsu's method: the split of the histogram with the largest
+    // between-class variance. Bins up to the returned level are dark.
+    static int OtsuLevel(const Histogram &hist)
+    {
+        uint64_t count = 0;
+        double sum = 0.0;
+        for (int i = 0; i < HISTOGRAM_BINS; ++i)
+        {
+            count += hist[i];
+            sum += (double)i * hist[i];
+        }
+
+        int level = HISTOGRAM_BINS / 2 - 1;
+        double best = -1.0;
+        uint64_t darkCount = 0;
+        double darkSum = 0.0;
+        for (int t = 0; t < HISTOGRAM_BINS - 1; ++t)
+        {
+            darkCount += hist[t];
+            darkSum += (double)t * hist[t];
+            if (darkCount == 0)
+                continue;
+            const uint64_t lightCount = count - darkCount;
+            if (lightCount == 0)
+                break;
+
+            const double diff = darkSum / darkCount - (sum - darkSum) / lightCount;
+            const double between = (double)darkCount * (double)lightCount * diff * diff;
+            if (between > best)
+            {
+                best = between;
+                level = t;
+            }
+        }
+        return level;
+    }
+
+    // Global binarization: white where the luminance bin is above `level`.
+    template <typename T>
+    static void ApplyThreshold(const ImageT<T> &src, ImageT<T> &dst, int level)
+    {
+        ResizeLike(src, dst);
+        if (src.data.empty())
+            return;
+
+        Parallel::For(0, src.height, [&](int y0, int y1, int)
+                      {
+                          ScratchArena &arena = ScratchArena::ForThread();
+                          ScratchArena::Scope scope(arena);
+                          ScratchBuffer<T> row = arena.Allocate<T>(src.width);
+                          for (int y = y0; y < y1; ++y)
+                          {
+                              ThresholdRow(src, y, level, row.data());
+                              WriteSpan(dst, 0, y, row.data(), src.width);
+                          }
+                      },
+                      HISTOGRAM_MIN_ROWS);
+    }
+
+    template <typename T>
+    static void ApplyOtsu(const ImageT<T> &src, ImageT<T> &dst)
+    {
+        ApplyThreshold(src, dst, OtsuLevel(LumHistogram(src)));
+    }
+
+    // Windows with less contrast than contrastLimit are decided as a whole:
+    // white when their mid-range is at least mid-grey, or, with an Otsu level
+    // given (see ApplyBernsenOtsu), when it lies above that level.
+    template <typename T>
+    static void ApplyBernsen(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 15, int contrastLimit = 15,
+                             int otsuLevel = -1)
+    {
+        RunBest(BernsenFamily<T>(), src, dst, kernelSize, (double)contrastLimit, otsuLevel);
+    }
+
+    // Hybrid: Otsu's global level in flat regions, Bernsen's local mid-range
+    // everywhere else.
+    template <typename T>
+    static void ApplyBernsenOtsu(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 15, int contrastLimit = 15)
+    {
+        ApplyBernsen(src, dst, kernelSize, contrastLimit, OtsuLevel(LumHistogram(src)));
+    }
+
+    template <typename T>
+    static void ApplyBernsenGeneric(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 15, int contrastLimit = 15,
+                                    int otsuLevel = -1)
+    {
+        using Sum = typename PixelTraits<T>::Sum;
+        const Sum contrastLimitT = PixelTraits<T>::FromU8(contrastLimit);
+        const Sum midLevel = FlatLevel<T>(otsuLevel);
+
+        ResizeLike(src, dst);
+        int radius = kernelSize / 2;
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            for (int x = 0; x < src.width; ++x)
+            {
+                T minVal = PixelTraits<T>::Max;
+                T maxVal = 0;
+
+                for (int ky = -radius; ky <= radius; ++ky)
+                {
+                    for (int kx = -radius; kx <= radius; ++kx)
+                    {
+                        T val = GetLum(src, x + kx, y + ky);
+                        if (val < minVal)
+                            minVal = val;
+                        if (val > maxVal)
+                            maxVal = val;
+                    }
+                }
+
+                T pixel = GetLum(src, x, y);
+                WritePixel(dst, x, y, BernsenDecision(pixel, minVal, maxVal, contrastLimitT, midLevel));
+            }
+        }
+    }
+
+    // Min and max are separable, so the K x K window is reduced as K rows
+    // into a column strip and then K columns of that strip.
+    template <int K, typename T>
+    static void ApplyBernsenFixed(const ImageT<T> &src, ImageT<T> &dst, int contrastLimit = 15, int otsuLevel = -1)
+    {
+        using Sum = typename PixelTraits<T>::Sum;
+        constexpr int R = K / 2;
+        const Sum contrastLimitT = PixelTraits<T>::FromU8(contrastLimit);
+        const Sum midLevel = FlatLevel<T>(otsuLevel);
+
+        ResizeLike(src, dst);
+        if (src.data.empty())
+            return;
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> plane = BuildLumPlane(arena, src, R);
+        const int stride = src.width + 2 * R;
+
+        ScratchBuffer<T> colMin = arena.Allocate<T>(stride);
+        ScratchBuffer<T> colMax = arena.Allocate<T>(stride);
+        ScratchBuffer<T> rowMin = arena.Allocate<T>(src.width);
+        ScratchBuffer<T> rowMax = arena.Allocate<T>(src.width);
+        ScratchBuffer<T> out = arena.Allocate<T>(src.width);
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            const T *top = plane.data() + (size_t)y * stride;
+            std::copy(top, top + stride, colMin.begin());
+            std::copy(top, top + stride, colMax.begin());
+            for (int ky = 1; ky < K; ++ky)
+            {
+                const T *row = top + (size_t)ky * stride;
+                for (int x = 0; x < stride; ++x)
+                {
+                    T v = row[x];
+                    colMin[x] = v < colMin[x] ? v : colMin[x];
+                    colMax[x] = v > colMax[x] ? v : colMax[x];
+                }
+            }
+
+            std::copy(colMin.begin(), colMin.begin() + src.width, rowMin.begin());
+            std::copy(colMax.begin(), colMax.begin() + src.width, rowMax.begin());
+            for (int kx = 1; kx < K; ++kx)
+            {
+                for (int x = 0; x < src.width; ++x)
+                {
+                    T lo = colMin[x + kx];
+                    T hi = colMax[x + kx];
+                    rowMin[x] = lo < rowMin[x] ? lo : rowMin[x];
+                    rowMax[x] = hi > rowMax[x] ? hi : rowMax[x];
+                }
+            }
+
+            const T *center = top + (size_t)R * stride + R;
+            for (int x = 0; x < src.width; ++x)
+                out[x] = BernsenDecision(center[x], rowMin[x], rowMax[x], contrastLimitT, midLevel);
+            WriteSpan(dst, 0, y, out.data(), src.width);
+        }
+    }
+
+    // van Herk / Gil-Werman min and max: prefix and suffix extrema over blocks
+    // of K rows (then K columns) give any window in three comparisons, so the
+    // cost per pixel does not depend on the kernel size.
+    template <typename T>
+    static void ApplyBernsenVanHerk(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 15, int contrastLimit = 15,
+                                    int otsuLevel = -1)
+    {
+        using Sum = typename PixelTraits<T>::Sum;
+        const Sum contrastLimitT = PixelTraits<T>::FromU8(contrastLimit);
+        const Sum midLevel = FlatLevel<T>(otsuLevel);
+        const int K = kernelSize;
+        const int R = K / 2;
+
+        ResizeLike(src, dst);
+        if (src.data.empty())
+            return;
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> plane = BuildLumPlane(arena, src, R);
+        const int stride = src.width + 2 * R;
+        const int rows = src.height + 2 * R;
+
+        ScratchBuffer<T> prefixMin = arena.Allocate<T>((size_t)rows * stride);
+        ScratchBuffer<T> prefixMax = arena.Allocate<T>((size_t)rows * stride);
+        ScratchBuffer<T> suffixMin = arena.Allocate<T>((size_t)rows * stride);
+        ScratchBuffer<T> suffixMax = arena.Allocate<T>((size_t)rows * stride);
+
+        for (int b = 0; b < rows; b += K)
+        {
+            const int e = std::min(b + K, rows);
+            std::copy(plane.begin() + (size_t)b * stride, plane.begin() + (size_t)(b + 1) * stride, prefixMin.begin() + (size_t)b * stride);
+            std::copy(plane.begin() + (size_t)b * stride, plane.begin() + (size_t)(b + 1) * stride, prefixMax.begin() + (size_t)b * stride);
+            for (int y = b + 1; y < e; ++y)
+            {
+                const T *in = plane.data() + (size_t)y * stride;
+                const T *pMin = prefixMin.data() + (size_t)(y - 1) * stride;
+                const T *pMax = prefixMax.data() + (size_t)(y - 1) * stride;
+                T *oMin = prefixMin.data() + (size_t)y * stride;
+                T *oMax = prefixMax.data() + (size_t)y * stride;
+                for (int x = 0; x < stride; ++x)
+                {
+                    T v = in[x];
+                    oMin[x] = v < pMin[x] ? v : pMin[x];
+                    oMax[x] = v > pMax[x] ? v : pMax[x];
+                }
+            }
+
+            std::copy(plane.begin() + (size_t)(e - 1) * stride, plane.begin() + (size_t)e * stride, suffixMin.begin() + (size_t)(e - 1) * stride);
+            std::copy(plane.begin() + (size_t)(e - 1) * stride, plane.begin() + (size_t)e * stride, suffixMax.begin() + (size_t)(e - 1) * stride);
+            for (int y = e - 2; y >= b; --y)
+            {
+                const T *in = plane.data() + (size_t)y * stride;
+                const T *sMin = suffixMin.data() + (size_t)(y + 1) * stride;
+                const T *sMax = suffixMax.data() + (size_t)(y + 1) * stride;
+                T *oMin = suffixMin.data() + (size_t)y * stride;
+                T *oMax = suffixMax.data() + (size_t)y * stride;
+                for (int x = 0; x < stride; ++x)
+                {
+                    T v = in[x];
+                    oMin[x] = v < sMin[x] ? v : sMin[x];
+                    oMax[x] = v > sMax[x] ? v : sMax[x];
+                }
+            }
+        }
+
+        ScratchBuffer<T> colMin = arena.Allocate<T>(stride);
+        ScratchBuffer<T> colMax = arena.Allocate<T>(stride);
+        ScratchBuffer<T> rowPrefixMin = arena.Allocate<T>(stride);
+        ScratchBuffer<T> rowPrefixMax = arena.Allocate<T>(stride);
+        ScratchBuffer<T> rowSuffixMin = arena.Allocate<T>(stride);
+        ScratchBuffer<T> rowSuffixMax = arena.Allocate<T>(stride);
+        ScratchBuffer<T> out = arena.Allocate<T>(src.width);
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            const T *sMin = suffixMin.data() + (size_t)y * stride;
+            const T *sMax = suffixMax.data() + (size_t)y * stride;
+            const T *pMin = prefixMin.data() + (size_t)(y + K - 1) * stride;
+            const T *pMax = prefixMax.data() + (size_t)(y + K - 1) * stride;
+            for (int x = 0; x < stride; ++x)
+            {
+                colMin[x] = sMin[x] < pMin[x] ? sMin[x] : pMin[x];
+                colMax[x] = sMax[x] > pMax[x] ? sMax[x] : pMax[x];
+            }
+
+            for (int b = 0; b < stride; b += K)
+            {
+                const int e = std::min(b + K, stride);
+                rowPrefixMin[b] = colMin[b];
+                rowPrefixMax[b] = colMax[b];
+                for (int x = b + 1; x < e; ++x)
+                {
+                    rowPrefixMin[x] = std::min(rowPrefixMin[x - 1], colMin[x]);
+                    rowPrefixMax[x] = std::max(rowPrefixMax[x - 1], colMax[x]);
+                }
+                rowSuffixMin[e - 1] = colMin[e - 1];
+                rowSuffixMax[e - 1] = colMax[e - 1];
+                for (int x = e - 2; x >= b; --x)
+                {
+                    rowSuffixMin[x] = std::min(rowSuffixMin[x + 1], colMin[x]);
+                    rowSuffixMax[x] = std::max(rowSuffixMax[x + 1], colMax[x]);
+                }
+            }
+
+            const T *center = plane.data() + (size_t)(y + R) * stride + R;
+            for (int x = 0; x < src.width; ++x)
+            {
+                T minVal = std::min(rowSuffixMin[x], rowPrefixMin[x + K - 1]);
+                T maxVal = std::max(rowSuffixMax[x], rowPrefixMax[x + K - 1]);
+                out[x] = BernsenDecision(center[x], minVal, maxVal, contrastLimitT, midLevel);
+            }
+            WriteSpan(dst, 0, y, out.data(), src.width);
+        }
+    }
+
+    template <typename T>
+    static void ApplyNiblack(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 15, float k = -0.2f)
+    {
+        RunBest(NiblackFamily<T>(), src, dst, kernelSize, (double)k);
+    }
+
+    template <typename T>
+    static void ApplyNiblackGeneric(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 15, float k = -0.2f)
+    {
+        using Real = typename PixelTraits<T>::Real;
+
+        ResizeLike(src, dst);
+        int radius = kernelSize / 2;
+        int N = kernelSize * kernelSize;
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            for (int x = 0; x < src.width; ++x)
+            {
+                Real sum = 0;
+                Real sumSq = 0;
+
+                for (int ky = -radius; ky <= radius; ++ky)
+                {
+                    for (int kx = -radius; kx <= radius; ++kx)
+                    {
+                        Real val = GetLum(src, x + kx, y + ky);
+                        sum += val;
+                        sumSq += (val * val);
+                    }
+                }
+
+                Real mean = sum / N;
+                Real variance = (sumSq / N) - (mean * mean);
+                Real sigma = std::sqrt(std::max((Real)0, variance));
+
+                Real threshold = mean + k * sigma;
+
+                T pixel = GetLum(src, x, y);
+                T res = (pixel > threshold) ? PixelTraits<T>::Max : 0;
+
+                WritePixel(dst, x, y, res);
+            }
+        }
+    }
+
+    // Accumulates every window offset over a whole row at a time. Each pixel
+    // still sums its window in the same ky/kx order as the generic loop, so
+    // the rounding of the float sums and the thresholds are unchanged.
+    template <int K, typename T>
+    static void ApplyNiblackFixed(const ImageT<T> &src, ImageT<T> &dst, float k = -0.2f)
+    {
+        using Real = typename PixelTraits<T>::Real;
+        constexpr int R = K / 2;
+        constexpr int N = K * K;
+
+        ResizeLike(src, dst);
+        if (src.data.empty())
+            return;
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> plane = BuildLumPlane(arena, src, R);
+        const int stride = src.width + 2 * R;
+
+        ScratchBuffer<Real> sum = arena.Allocate<Real>(src.width);
+        ScratchBuffer<Real> sumSq = arena.Allocate<Real>(src.width);
+        ScratchBuffer<T> out = arena.Allocate<T>(src.width);
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            std::fill(sum.begin(), sum.end(), (Real)0);
+            std::fill(sumSq.begin(), sumSq.end(), (Real)0);
+
+            const T *top = plane.data() + (size_t)y * stride;
+            for (int ky = 0; ky < K; ++ky)
+            {
+                const T *row = top + (size_t)ky * stride;
+                for (int kx = 0; kx < K; ++kx)
+                {
+                    const T *in = row + kx;
+                    for (int x = 0; x < src.width; ++x)
+                    {
+                        Real val = in[x];
+                        sum[x] += val;
+                        sumSq[x] += (val * val);
+                    }
+                }
+            }
+
+            const T *center = top + (size_t)R * stride + R;
+            for (int x = 0; x < src.width; ++x)
+            {
+                Real mean = sum[x] / N;
+                Real variance = (sumSq[x] / N) - (mean * mean);
+                Real sigma = std::sqrt(std::max((Real)0, variance));
+
+                Real threshold = mean + k * sigma;
+
+                out[x] = (center[x] > threshold) ? PixelTraits<T>::Max : 0;
+            }
+            WriteSpan(dst, 0, y, out.data(), src.width);
+        }
+    }
+
+    // Sliding window sums kept as exact integers: column sums move down one row
+    // at a time and the row sum moves right one pixel at a time. The generic
+    // loop adds the same integers in float, so both agree whenever no partial
+    // sum exceeds the float mantissa; NiblackRunningSumExact checks that.
+    template <typename T>
+    static void ApplyNiblackRunningSum(const ImageT<T> &src, ImageT<T> &dst, int kernelSize = 15, float k = -0.2f)
+    {
+        static_assert(std::is_integral<T>::value, "running sums need integer pixels");
+        using Real = typename PixelTraits<T>::Real;
+        using Sum = typename PixelTraits<T>::Sum;
+        const int K = kernelSize;
+        const int R = K / 2;
+        const int N = K * K;
+
+        ResizeLike(src, dst);
+        if (src.data.empty())
+            return;
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> plane = BuildLumPlane(arena, src, R);
+        const int stride = src.width + 2 * R;
+
+        ScratchBuffer<Sum> colSum = arena.Allocate<Sum>(stride, 0);
+        ScratchBuffer<Sum> colSq = arena.Allocate<Sum>(stride, 0);
+        ScratchBuffer<T> out = arena.Allocate<T>(src.width);
+
+        for (int ky = 0; ky < K - 1; ++ky)
+        {
+            const T *row = plane.data() + (size_t)ky * stride;
+            for (int x = 0; x < stride; ++x)
+            {
+                colSum[x] += row[x];
+                colSq[x] += (Sum)row[x] * row[x];
+            }
+        }
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            const T *enter = plane.data() + (size_t)(y + K - 1) * stride;
+            for (int x = 0; x < stride; ++x)
+            {
+                colSum[x] += enter[x];
+                colSq[x] += (Sum)enter[x] * enter[x];
+            }
+
+            Sum s = 0;
+            Sum q = 0;
+            for (int kx = 0; kx < K; ++kx)
+            {
+                s += colSum[kx];
+                q += colSq[kx];
+            }
+
+            const T *center = plane.data() + (size_t)(y + R) * stride + R;
+            for (int x = 0; x < src.width; ++x)
+            {
+                Real sum = (Real)s;
+                Real sumSq = (Real)q;
+                Real mean = sum / N;
+                Real variance = (sumSq / N) - (mean * mean);
+                Real sigma = std::sqrt(std::max((Real)0, variance));
+
+                Real threshold = mean + k * sigma;
+
+                out[x] = (center[x] > threshold) ? PixelTraits<T>::Max : 0;
+
+                if (x + 1 < src.width)
+                {
+                    s += colSum[x + K] - colSum[x];
+                    q += colSq[x + K] - colSq[x];
+                }
+            }
+            WriteSpan(dst, 0, y, out.data(), src.width);
+
+            const T *leave = plane.data() + (size_t)y * stride;
+            for (int x = 0; x < stride; ++x)
+            {
+                colSum[x] -= leave[x];
+                colSq[x] -= (Sum)leave[x] * leave[x];
+            }
+        }
+    }
+
+    template <typename T>
+    static bool NiblackRunningSumExact(int kernelSize)
+    {
+        if constexpr (!std::is_integral<T>::value)
+        {
+            return false;
+        }
+        else
+        {
+            const double maxSum = (double)kernelSize * kernelSize * PixelTraits<T>::Max * PixelTraits<T>::Max;
+            return maxSum <= std::ldexp(1.0, std::numeric_limits<typename PixelTraits<T>::Real>::digits);
+        }
+    }
+
+    // Running-sum box blur: O(1) per pixel regardless of radius. The vertical
+    // pass is done as a horizontal pass over the transposed image.
+    template <typename T>
+    static void ApplyBoxBlur(const ImageT<T> &src, ImageT<T> &dst, int radius)
+    {
+        if (src.data.empty() || radius <= 0 || src.channels != 4)
+        {
+            dst = src;
+            return;
+        }
+        ResizeLike(src, dst);
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> tmp = arena.Allocate<T>(src.data.size());
+        BoxBlurRows(src.data.data(), tmp.data(), src.width, src.height, radius);
+        Transpose(tmp.data(), dst.data.data(), src.width, src.height);
+        BoxBlurRows(dst.data.data(), tmp.data(), src.height, src.width, radius);
+        Transpose(tmp.data(), dst.data.data(), src.height, src.width);
+    }
+
+    // Exact separable kernel for small sigma; for large sigma three box passes
+    // approximate the Gaussian at a cost that no longer depends on sigma.
+    template <typename T>
+    static void ApplyGaussianBlur(const ImageT<T> &src, ImageT<T> &dst, float sigma)
+    {
+        if (src.data.empty() || sigma <= 0.0f || src.channels != 4)
+        {
+            dst = src;
+            return;
+        }
+        ResizeLike(src, dst);
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<T> tmp = arena.Allocate<T>(src.data.size());
+
+        if (sigma > GAUSS_EXACT_MAX_SIGMA)
+        {
+            int radii[3];
+            BoxRadiiForGauss(sigma, radii);
+
+            const T *in = src.data.data();
+            for (int pass = 0; pass < 3; ++pass)
+            {
+                T *out = (pass % 2 == 0) ? tmp.data() : dst.data.data();
+                BoxBlurRows(in, out, src.width, src.height, radii[pass]);
+                in = out;
+            }
+            Transpose(tmp.data(), dst.data.data(), src.width, src.height);
+            in = dst.data.data();
+            for (int pass = 0; pass < 3; ++pass)
+            {
+                T *out = (pass % 2 == 0) ? tmp.data() : dst.data.data();
+                BoxBlurRows(in, out, src.height, src.width, radii[pass]);
+                in = out;
+            }
+            Transpose(tmp.data(), dst.data.data(), src.height, src.width);
+            return;
+        }
+
+        ScratchBuffer<float> kernel = BuildGaussKernel(arena, sigma);
+
+        ConvolveRows(src.data.data(), tmp.data(), src.width, src.height, kernel);
+        Transpose(tmp.data(), dst.data.data(), src.width, src.height);
+        ConvolveRows(dst.data.data(), tmp.data(), src.height, src.width, kernel);
+        Transpose(tmp.data(), dst.data.data(), src.height, src.width);
+    }
+
+    static int GaussianRadius(float sigma)
+    {
+        if (sigma <= 0.0f)
+            return 0;
+        if (sigma > GAUSS_EXACT_MAX_SIGMA)
+        {
+            int radii[3];
+            BoxRadiiForGauss(sigma, radii);
+            return radii[0] + radii[1] + radii[2];
+        }
+        return std::max(1, (int)std::ceil(3.0f * sigma));
+    }
+
+    template <typename T>
+    static void CropImage(const ImageT<T> &src, int x, int y, int w, int h, ImageT<T> &dst)
+    {
+        dst.width = w;
+        dst.height = h;
+        dst.channels = src.channels;
+        dst.data.resize((size_t)w * h * src.channels);
+
+        size_t rowBytes = (size_t)w * src.channels * sizeof(T);
+        for (int row = 0; row < h; ++row)
+        {
+            const T *from = src.data.data() + ((size_t)(y + row) * src.width + x) * src.channels;
+            std::memcpy(dst.data.data() + (size_t)row * w * src.channels, from, rowBytes);
+        }
+    }
+
+    // Views may hold gray or RGB rows (Netpbm files); the crop is always RGBA.
+    template <typename T>
+    static void CropImage(const ImageViewT<T> &src, int x, int y, int w, int h, ImageT<T> &dst)
+    {
+        dst.width = w;
+        dst.height = h;
+        dst.channels = 4;
+        dst.data.resize((size_t)w * h * 4);
+
+        for (int row = 0; row < h; ++row)
+        {
+            const T *from = src.Row(y + row) + (size_t)x * src.channels;
+            T *to = dst.data.data() + (size_t)row * w * 4;
+            if (src.channels == 4)
+            {
+                std::memcpy(to, from, (size_t)w * 4 * sizeof(T));
+                continue;
+            }
+            for (int i = 0; i < w; ++i)
+            {
+                const T *p = from + (size_t)i * src.channels;
+                to[i * 4 + 0] = p[0];
+                to[i * 4 + 1] = src.channels >= 3 ? p[1] : p[0];
+                to[i * 4 + 2] = src.channels >= 3 ? p[2] : p[0];
+                to[i * 4 + 3] = PixelTraits<T>::Max;
+            }
+        }
+    }
+
+    template <typename T>
+    static void PasteImage(const ImageT<T> &src, ImageT<T> &dst, int x, int y)
+    {
+        int x0 = std::max(0, x);
+        int y0 = std::max(0, y);
+        int x1 = std::min(dst.width, x + src.width);
+        int y1 = std::min(dst.height, y + src.height);
+        if (x0 >= x1 || y0 >= y1 || src.channels != dst.channels)
+            return;
+
+        size_t rowBytes = (size_t)(x1 - x0) * dst.channels * sizeof(T);
+        for (int row = y0; row < y1; ++row)
+        {
+            const T *from = src.data.data() + ((size_t)(row - y) * src.width + (x0 - x)) * src.channels;
+            std::memcpy(dst.data.data() + ((size_t)row * dst.width + x0) * dst.channels, from, rowBytes);
+        }
+    }
+
+    template <typename T>
+    static void Downsample(const ImageT<T> &src, int factor, ImageT<T> &dst)
+    {
+        using Sum = typename PixelTraits<T>::Sum;
+
+        if (factor <= 1)
+        {
+            dst = src;
+            return;
+        }
+
+        dst.width = (src.width + factor - 1) / factor;
+        dst.height = (src.height + factor - 1) / factor;
+        dst.channels = src.channels;
+        dst.data.assign((size_t)dst.width * dst.height * dst.channels, 0);
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<Sum> acc = arena.Allocate<Sum>((size_t)dst.width * dst.channels);
+        for (int dy = 0; dy < dst.height; ++dy)
+        {
+            std::fill(acc.begin(), acc.end(), (Sum)0);
+            int yEnd = std::min(src.height, (dy + 1) * factor);
+            for (int y = dy * factor; y < yEnd; ++y)
+            {
+                const T *row = src.data.data() + (size_t)y * src.width * src.channels;
+                for (int x = 0; x < src.width; ++x)
+                    for (int c = 0; c < src.channels; ++c)
+                        acc[(x / factor) * src.channels + c] += row[x * src.channels + c];
+            }
+
+            int rows = yEnd - dy * factor;
+            T *out = dst.data.data() + (size_t)dy * dst.width * dst.channels;
+            for (int dx = 0; dx < dst.width; ++dx)
+            {
+                int cols = std::min(src.width, (dx + 1) * factor) - dx * factor;
+                int count = rows * cols;
+                for (int c = 0; c < dst.channels; ++c)
+                    out[dx * dst.channels + c] = DivideRounded(acc[dx * dst.channels + c], count);
+            }
+        }
+    }
+
+private:
+    static constexpr float GAUSS_EXACT_MAX_SIGMA = 4.0f;
+    static constexpr int TRANSPOSE_BLOCK = 32;
+    static constexpr int MEDIAN_HISTOGRAM_MIN_KERNEL = 7;
+    static constexpr int MEDIAN_NETWORK_MAX = 49;
+    static constexpr int MEDIAN_STRIP = 64;
+    static constexpr int MAX_VARIANTS = 4;
+    static constexpr int HISTOGRAM_MIN_ROWS = 64;
+    // Sub-histograms per worker; neighbouring pixels count into different
+    // ones, so runs of one level do not serialize on a single counter.
+    static constexpr int HISTOGRAM_LANES = 4;
+
+    struct CompareExchange
+    {
+        int lo;
+        int hi;
+    };
+
+    // Batcher's merge-exchange sort (Knuth 5.2.2M) for N inputs, keeping only
+    // the comparators that can still affect the middle output.
+    template <int N>
+    struct MedianNetwork
+    {
+        static constexpr int CAPACITY = N * N;
+
+        CompareExchange pairs[CAPACITY] = {};
+        int count = 0;
+
+        static constexpr MedianNetwork Get()
+        {
+            CompareExchange full[CAPACITY] = {};
+            int fullCount = 0;
+
+            int t = 0;
+            while ((1 << t) < N)
+                ++t;
+            for (int p = 1 << (t - 1); p > 0; p >>= 1)
+            {
+                int q = 1 << (t - 1);
+                int r = 0;
+                int d = p;
+                while (true)
+                {
+                    for (int i = 0; i < N - d; ++i)
+                        if ((i & p) == r)
+                            full[fullCount++] = {i, i + d};
+                    if (q == p)
+                        break;
+                    d = q - p;
+                    q >>= 1;
+                    r = p;
+                }
+            }
+
+            bool needed[N] = {};
+            bool keep[CAPACITY] = {};
+            needed[N / 2] = true;
+            for (int i = fullCount - 1; i >= 0; --i)
+            {
+                if (needed[full[i].lo] || needed[full[i].hi])
+                {
+                    keep[i] = true;
+                    needed[full[i].lo] = true;
+                    needed[full[i].hi] = true;
+                }
+            }
+
+            MedianNetwork net;
+            for (int i = 0; i < fullCount; ++i)
+                if (keep[i])
+                    net.pairs[net.count++] = full[i];
+            return net;
+        }
+    };
+
+    template <int N, typename T, size_t... I>
+    static void RunMedianNetwork(T *lanes, std::index_sequence<I...>)
+    {
+        static constexpr MedianNetwork<N> net = MedianNetwork<N>::Get();
+        (CompareExchangeLanes(lanes + (size_t)net.pairs[I].lo * MEDIAN_STRIP,
+                              lanes + (size_t)net.pairs[I].hi * MEDIAN_STRIP),
+         ...);
+    }
+
+#ifdef LAB2_SSE2
+    static void CompareExchangeLanes(unsigned char *lo, unsigned char *hi)
+    {
+        for (int i = 0; i < MEDIAN_STRIP; i += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(lo + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(hi + i));
+            _mm_storeu_si128((__m128i *)(lo + i), _mm_min_epu8(a, b));
+            _mm_storeu_si128((__m128i *)(hi + i), _mm_max_epu8(a, b));
+        }
+    }
+
+    // SSE2 only has signed 16-bit min/max; flipping the sign bit maps the
+    // unsigned order onto the signed one.
+    static void CompareExchangeLanes(unsigned short *lo, unsigned short *hi)
+    {
+        const __m128i bias = _mm_set1_epi16((short)0x8000);
+        for (int i = 0; i < MEDIAN_STRIP; i += 8)
+        {
+            __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(lo + i)), bias);
+            __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(hi + i)), bias);
+            _mm_storeu_si128((__m128i *)(lo + i), _mm_xor_si128(_mm_min_epi16(a, b), bias));
+            _mm_storeu_si128((__m128i *)(hi + i), _mm_xor_si128(_mm_max_epi16(a, b), bias));
+        }
+    }
+
+    static void CompareExchangeLanes(float *lo, float *hi)
+    {
+        for (int i = 0; i < MEDIAN_STRIP; i += 4)
+        {
+            __m128 a = _mm_loadu_ps(lo + i);
+            __m128 b = _mm_loadu_ps(hi + i);
+            _mm_storeu_ps(lo + i, _mm_min_ps(a, b));
+            _mm_storeu_ps(hi + i, _mm_max_ps(a, b));
+        }
+    }
+#endif
+
+    template <typename T>
+    static void CompareExchangeLanes(T *lo, T *hi)
+    {
+        for (int i = 0; i < MEDIAN_STRIP; ++i)
+        {
+            T a = lo[i];
+            T b = hi[i];
+            lo[i] = b < a ? b : a;
+            hi[i] = b < a ? a : b;
+        }
+    }
+
+    static bool IsFixedKernel(int kernelSize)
+    {
+        return kernelSize == 3 || kernelSize == 5 || kernelSize == 7 || kernelSize == 15 || kernelSize == 31;
+    }
+
+    static bool AnyKernel(int)
+    {
+        return true;
+    }
+
+    template <int... Sizes, typename F>
+    static void WithFixedKernel(int kernelSize, F &&body)
+    {
+        ((kernelSize == Sizes ? (body(std::integral_constant<int, Sizes>()), true) : false) || ...);
+    }
+
+    template <typename T>
+    static const FilterFamily<T> &MedianFamily()
+    {
+        static const FilterFamily<T> family = []()
+        {
+            FilterFamily<T> f;
+            f.name = "median";
+            f.variants.push_back({"generic", AnyKernel, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double, int)
+                                  { ApplyMedianGeneric(s, d, kernel); }});
+            f.variants.push_back({"fixed", IsFixedKernel, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double, int)
+                                  { WithFixedKernel<3, 5, 7, 15, 31>(kernel, [&](auto K)
+                                                                     { ApplyMedianFixed<decltype(K)::value>(s, d); }); }});
+            if constexpr (std::is_integral<T>::value)
+            {
+                f.variants.push_back({"histogram", AnyKernel, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double, int)
+                                      { ApplyMedianHistogram(s, d, kernel); }});
+                f.preferred = [](int kernel) -> const char *
+                {
+                    if (kernel >= MEDIAN_HISTOGRAM_MIN_KERNEL)
+                        return "histogram";
+                    return IsFixedKernel(kernel) ? "fixed" : "generic";
+                };
+            }
+            else
+            {
+                f.preferred = [](int kernel) -> const char *
+                { return IsFixedKernel(kernel) ? "fixed" : "generic"; };
+            }
+            return f;
+        }();
+        return family;
+    }
+
+    template <typename T>
+    static const FilterFamily<T> &BernsenFamily()
+    {
+        static const FilterFamily<T> family = []()
+        {
+            FilterFamily<T> f;
+            f.name = "bernsen";
+            f.variants.push_back({"generic", AnyKernel, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double limit, int level)
+                                  { ApplyBernsenGeneric(s, d, kernel, (int)limit, level); }});
+            f.variants.push_back({"fixed", IsFixedKernel, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double limit, int level)
+                                  { WithFixedKernel<3, 5, 7, 15, 31>(kernel, [&](auto K)
+                                                                     { ApplyBernsenFixed<decltype(K)::value>(s, d, (int)limit, level); }); }});
+            f.variants.push_back({"vanherk", AnyKernel, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double limit, int level)
+                                  { ApplyBernsenVanHerk(s, d, kernel, (int)limit, level); }});
+            f.preferred = [](int kernel) -> const char *
+            { return IsFixedKernel(kernel) ? "fixed" : "vanherk"; };
+            return f;
+        }();
+        return family;
+    }
+
+    template <typename T>
+    static const FilterFamily<T> &NiblackFamily()
+    {
+        static const FilterFamily<T> family = []()
+        {
+            FilterFamily<T> f;
+            f.name = "niblack";
+            f.variants.push_back({"generic", AnyKernel, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double k, int)
+                                  { ApplyNiblackGeneric(s, d, kernel, (float)k); }});
+            f.variants.push_back({"fixed", IsFixedKernel, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double k, int)
+                                  { WithFixedKernel<3, 5, 7, 15, 31>(kernel, [&](auto K)
+                                                                     { ApplyNiblackFixed<decltype(K)::value>(s, d, (float)k); }); }});
+            if constexpr (std::is_integral<T>::value)
+            {
+                f.variants.push_back({"running", NiblackRunningSumExact<T>, [](const ImageT<T> &s, ImageT<T> &d, int kernel, double k, int)
+                                      { ApplyNiblackRunningSum(s, d, kernel, (float)k); }});
+            }
+            f.preferred = [](int kernel) -> const char *
+            { return IsFixedKernel(kernel) ? "fixed" : "generic"; };
+            return f;
+        }();
+        return family;
+    }
+
+    template <typename T>
+    static void RunBest(const FilterFamily<T> &family, const ImageT<T> &src, ImageT<T> &dst, int kernelSize, double param,
+                        int level = -1)
+    {
+        std::array<const FilterVariant<T> *, MAX_VARIANTS> eligible;
+        std::array<const char *, MAX_VARIANTS> names;
+        int count = 0;
+        int fallback = 0;
+        const char *preferred = family.preferred(kernelSize);
+        for (const FilterVariant<T> &v : family.variants)
+        {
+            if (!v.supports(kernelSize) || count == MAX_VARIANTS)
+                continue;
+            if (std::strcmp(v.name, preferred) == 0)
+                fallback = count;
+            eligible[count] = &v;
+            names[count] = v.name;
+            ++count;
+        }
+
+        int pick = FilterCalibration::Choose(family.name, PixelTraits<T>::Name, kernelSize, (size_t)src.width * src.height,
+                                             names.data(), count, fallback, [&](int index, int width, int height)
+                                             {
+                                                 ImageT<T> sample;
+                                                 ImageT<T> result;
+                                                 MakeCalibrationImage(width, height, sample);
+                                                 auto start = std::chrono::steady_clock::now();
+                                                 eligible[index]->run(sample, result, kernelSize, param, level);
+                                                 auto end = std::chrono::steady_clock::now();
+                                                 return std::chrono::duration<double, std::milli>(end - start).count();
+                                             });
+        eligible[pick]->run(src, dst, kernelSize, param, level);
+    }
+
+    // Text-like blocks over a gradient with sparse impulse noise, so
+    // data-dependent variants (the histogram median) see realistic input.
+    template <typename T>
+    static void MakeCalibrationImage(int width, int height, ImageT<T> &img)
+    {
+        Image img8;
+        img8.width = width;
+        img8.height = height;
+        img8.channels = 4;
+        img8.data.resize((size_t)width * height * 4);
+
+        uint32_t state = 0x9E3779B9u;
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                int v = 96 + (x + y) * 96 / (width + height);
+                if (((x / 6) + (y / 11)) % 3 == 0)
+                    v -= 70;
+                v += (int)(state & 31) - 16;
+                if ((state >> 8) % 32 == 0)
+                    v = (state >> 16) & 1 ? 255 : 0;
+
+                unsigned char *p = &img8.data[((size_t)y * width + x) * 4];
+                p[0] = p[1] = p[2] = (unsigned char)std::max(0, std::min(255, v));
+                p[3] = 255;
+            }
+        }
+        ConvertImage(img8, img);
+    }
+
+    template <typename T>
+    static void ResizeLike(const ImageT<T> &src, ImageT<T> &dst)
+    {
+        dst.width = src.width;
+        dst.height = src.height;
+        dst.channels = src.channels;
+        dst.data.resize(src.data.size());
+    }
+
+    // Luminance with a border of `radius` clamped pixels on every side, so
+    // window loops can read it without bounds checks.
+    template <typename T>
+    static ScratchBuffer<T> BuildLumPlane(ScratchArena &arena, const ImageT<T> &src, int radius)
+    {
+        const int stride = src.width + 2 * radius;
+        const int rows = src.height + 2 * radius;
+        ScratchBuffer<T> plane = arena.Allocate<T>((size_t)stride * rows);
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            T *row = plane.data() + (size_t)(y + radius) * stride;
+            LumaRow(src, y, row + radius);
+            std::fill(row, row + radius, row[radius]);
+            std::fill(row + radius + src.width, row + stride, row[radius + src.width - 1]);
+        }
+
+        const T *first = plane.data() + (size_t)radius * stride;
+        const T *last = plane.data() + (size_t)(radius + src.height - 1) * stride;
+        for (int y = 0; y < radius; ++y)
+        {
+            std::copy(first, first + stride, plane.data() + (size_t)y * stride);
+            std::copy(last, last + stride, plane.data() + (size_t)(radius + src.height + y) * stride);
+        }
+        return plane;
+    }
+
+    static bool ParseNetpbmHeader(const unsigned char *data, size_t size, NetpbmHeader &header)
+    {
+        if (size < 3 || data[0] != 'P' || data[1] < '4' || data[1] > '6')
+            return false;
+        header.format = (NetpbmFormat)(data[1] - '0');
+
+        size_t pos = 2;
+        auto readNumber = [&](int &value) -> bool
+        {
+            while (pos < size && (std::isspace(data[pos]) || data[pos] == '#'))
+            {
+                if (data[pos] == '#')
+                    while (pos < size && data[pos] != '\n')
+                        ++pos;
+                else
+                    ++pos;
+            }
+            if (pos >= size || !std::isdigit(data[pos]))
+                return false;
+            long long v = 0;
+            while (pos < size && std::isdigit(data[pos]) && v <= std::numeric_limits<int>::max())
+                v = v * 10 + (data[pos++] - '0');
+            value = (int)v;
+            return v <= std::numeric_limits<int>::max();
+        };
+
+        header.maxValue = 1;
+        if (!readNumber(header.width) || !readNumber(header.height))
+            return false;
+        if (header.format != NetpbmFormat::Bitmap && !readNumber(header.maxValue))
+            return false;
+        // Exactly one whitespace byte separates the header from the samples.
+        if (pos >= size || !std::isspace(data[pos]))
+            return false;
+        header.dataOffset = pos + 1;
+
+        if (header.width <= 0 || header.height <= 0 || header.maxValue <= 0 || header.maxValue > 65535)
+            return false;
+
+        size_t rowBytes = header.format == NetpbmFormat::Bitmap
+                              ? ((size_t)header.width + 7) / 8
+                              : (size_t)header.width * header.Channels() * (header.HighBitDepth() ? 2 : 1);
+        return (size_t)header.height <= (size - header.dataOffset) / rowBytes;
+    }
+
+    template <typename T>
+    static unsigned NetpbmSample(T v)
+    {
+        if constexpr (std::is_same<T, float>::value)
+            return PixelTraits<unsigned short>::Round(std::max(0.0, (double)v * 65535.0));
+        else
+            return v;
+    }
+
+    // Netpbm stores 16-bit samples big-endian.
+    static void PutNetpbmSample(unsigned char *row, size_t index, unsigned v, size_t sampleBytes)
+    {
+        if (sampleBytes == 2)
+        {
+            row[2 * index] = (unsigned char)(v >> 8);
+            row[2 * index + 1] = (unsigned char)v;
+        }
+        else
+        {
+            row[index] = (unsigned char)v;
+        }
+    }
+
+    template <typename T>
+    static void CountBins(const T *lum, int count, uint32_t *h)
+    {
+        int x = 0;
+        for (; x + HISTOGRAM_LANES <= count; x += HISTOGRAM_LANES)
+            for (int lane = 0; lane < HISTOGRAM_LANES; ++lane)
+                ++h[lane * HISTOGRAM_BINS + HistogramBin(lum[x + lane])];
+        for (; x < count; ++x)
+            ++h[HistogramBin(lum[x])];
+    }
+
+    // 8-bit rows use the mask kernel, which marks luminance below level + 1,
+    // and turn its 1 / 0 into 0 / 255 by subtracting one.
+    template <typename T>
+    static void ThresholdRow(const ImageT<T> &src, int y, int level, T *out)
+    {
+        if constexpr (std::is_same<T, unsigned char>::value)
+        {
+            if (level >= 0 && level < HISTOGRAM_BINS - 1)
+            {
+                PixelKernels::Get().mask.fn(src.data.data() + (size_t)y * src.width * 4, out, src.width,
+                                            (uint8_t)(level + 1));
+                for (int x = 0; x < src.width; ++x)
+                    out[x] = (unsigned char)(out[x] - 1);
+                return;
+            }
+        }
+        LumaRow(src, y, out);
+        for (int x = 0; x < src.width; ++x)
+            out[x] = HistogramBin(out[x]) > level ? PixelTraits<T>::Max : 0;
+    }
+
+    // The lowest level that falls into a bin above `otsuLevel`; without a
+    // level, mid-grey.
+    template <typename T>
+    static typename PixelTraits<T>::Sum FlatLevel(int otsuLevel)
+    {
+        using Sum = typename PixelTraits<T>::Sum;
+        if (otsuLevel < 0)
+            return PixelTraits<T>::FromU8(128);
+        const int bin = otsuLevel + 1;
+        if constexpr (std::is_same<T, unsigned char>::value)
+            return (Sum)bin;
+        else if constexpr (std::is_same<T, unsigned short>::value)
+            return (Sum)bin << 8;
+        else
+            return (bin - 0.5) / (HISTOGRAM_BINS - 1);
+    }
+
+    template <typename T, typename Sum>
+    static T BernsenDecision(T pixel, T minVal, T maxVal, Sum contrastLimit, Sum midLevel)
+    {
+        Sum mid = ((Sum)minVal + (Sum)maxVal) / 2;
+        Sum contrast = (Sum)maxVal - (Sum)minVal;
+
+        if (contrast < contrastLimit)
+            return (mid >= midLevel) ? PixelTraits<T>::Max : 0;
+        return (pixel >= mid) ? PixelTraits<T>::Max : 0;
+    }
+
+    template <typename T>
+    static void WritePixel(ImageT<T> &dst, int x, int y, T value)
+    {
+        int idx = (y * dst.width + x) * 4;
+        dst.data[idx] = value;
+        dst.data[idx + 1] = value;
+        dst.data[idx + 2] = value;
+        dst.data[idx + 3] = PixelTraits<T>::Max;
+    }
+
+    // Row-at-a-time forms of GetLum and WritePixel; 8-bit rows go through the
+    // dispatched SIMD kernels.
+    template <typename T>
+    static void LumaRow(const ImageT<T> &src, int y, T *out)
+    {
+        if constexpr (std::is_same<T, unsigned char>::value)
+        {
+            PixelKernels::Get().luma.fn(src.data.data() + (size_t)y * src.width * 4, out, src.width);
+        }
+        else
+        {
+            for (int x = 0; x < src.width; ++x)
+                out[x] = GetLum(src, x, y);
+        }
+    }
+
+    template <typename T>
+    static void LumaRow(const ImageViewT<T> &src, int y, T *out)
+    {
+        const T *row = src.Row(y);
+        if constexpr (std::is_same<T, unsigned char>::value)
+        {
+            PixelKernels::Get().luma.fn(row, out, src.width);
+        }
+        else
+        {
+            for (int x = 0; x < src.width; ++x)
+            {
+                const T *p = row + (size_t)x * 4;
+                out[x] = static_cast<T>(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]);
+            }
+        }
+    }
+
+    template <typename T>
+    static void WriteSpan(ImageT<T> &dst, int x, int y, const T *values, int count)
+    {
+        if constexpr (std::is_same<T, unsigned char>::value)
+        {
+            PixelKernels::Get().expand.fn(values, dst.data.data() + ((size_t)y * dst.width + x) * 4, count);
+        }
+        else
+        {
+            for (int i = 0; i < count; ++i)
+                WritePixel(dst, x + i, y, values[i]);
+        }
+    }
+
+    template <typename Sum>
+    static auto DivideRounded(Sum acc, int count) -> typename std::enable_if<std::is_integral<Sum>::value, Sum>::type
+    {
+        return (acc + count / 2) / count;
+    }
+
+    template <typename Sum>
+    static auto DivideRounded(Sum acc, int count) -> typename std::enable_if<!std::is_integral<Sum>::value, Sum>::type
+    {
+        return acc / count;
+    }
+
+    static ScratchBuffer<float> BuildGaussKernel(ScratchArena &arena, float sigma)
+    {
+        int radius = std::max(1, (int)std::ceil(3.0f * sigma));
+        ScratchBuffer<float> kernel = arena.Allocate<float>(radius + 1);
+
+        float sum = 0.0f;
+        for (int i = 0; i <= radius; ++i)
+        {
+            kernel[i] = std::exp(-(float)(i * i) / (2.0f * sigma * sigma));
+            sum += (i == 0) ? kernel[i] : 2.0f * kernel[i];
+        }
+        for (float &w : kernel)
+            w /= sum;
+        return kernel;
+    }
+
+    static void BoxRadiiForGauss(float sigma, int radii[3])
+    {
+        const int n = 3;
+        float wIdeal = std::sqrt(12.0f * sigma * sigma / n + 1.0f);
+        int wl = (int)std::floor(wIdeal);
+        if (wl % 2 == 0)
+            wl--;
+        int wu = wl + 2;
+
+        float mIdeal = (12.0f * sigma * sigma - n * wl * wl - 4.0f * n * wl - 3.0f * n) / (-4.0f * wl - 4.0f);
+        int m = (int)std::round(mIdeal);
+
+        for (int i = 0; i < n; ++i)
+            radii[i] = ((i < m ? wl : wu) - 1) / 2;
+    }
+
+    static void BoxBlurRows(const unsigned char *in, unsigned char *out, int width, int height, int radius)
+    {
+        const float inv = 1.0f / (float)(2 * radius + 1);
+
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char *row = in + (size_t)y * width * 4;
+            unsigned char *dstRow = out + (size_t)y * width * 4;
+
+#ifdef LAB2_SSE2
+            const __m128 vInv = _mm_set1_ps(inv);
+            const __m128 vHalf = _mm_set1_ps(0.5f);
+
+            __m128i sum = _mm_setzero_si128();
+            for (int i = -radius; i <= radius; ++i)
+                sum = _mm_add_epi32(sum, LoadPixel32(row + std::max(0, std::min(i, width - 1)) * 4));
+
+            for (int x = 0; x < width; ++x)
+            {
+                __m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), vInv), vHalf));
+                v = _mm_packs_epi32(v, v);
+                v = _mm_packus_epi16(v, v);
+                int packed = _mm_cvtsi128_si32(v);
+                std::memcpy(dstRow + x * 4, &packed, 4);
+
+                int addIdx = std::min(x + radius + 1, width - 1);
+                int subIdx = std::max(x - radius, 0);
+                sum = _mm_add_epi32(sum, LoadPixel32(row + addIdx * 4));
+                sum = _mm_sub_epi32(sum, LoadPixel32(row + subIdx * 4));
+            }
+#else
+            int sum[4];
+            for (int c = 0; c < 4; ++c)
+            {
+                sum[c] = 0;
+                for (int i = -radius; i <= radius; ++i)
+                    sum[c] += row[std::max(0, std::min(i, width - 1)) * 4 + c];
+            }
+
+            for (int x = 0; x < width; ++x)
+            {
+                int addIdx = std::min(x + radius + 1, width - 1) * 4;
+                int subIdx = std::max(x - radius, 0) * 4;
+                for (int c = 0; c < 4; ++c)
+                {
+                    dstRow[x * 4 + c] = (unsigned char)(int)((float)sum[c] * inv + 0.5f);
+                    sum[c] += row[addIdx + c] - row[subIdx + c];
+                }
+            }
+#endif
+        }
+    }
+
+    static void ConvolveRows(const unsigned char *in, unsigned char *out, int width, int height, ScratchBuffer<float> kernel)
+    {
+        const int radius = (int)kernel.size() - 1;
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<float> padded = arena.Allocate<float>((size_t)(width + 2 * radius) * 4);
+
+#ifdef LAB2_SSE2
+        ScratchBuffer<float> weights = arena.Allocate<float>(kernel.size() * 4);
+        for (size_t k = 0; k < weights.size(); ++k)
+            weights[k] = kernel[k / 4];
+#endif
+
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char *row = in + (size_t)y * width * 4;
+            unsigned char *dstRow = out + (size_t)y * width * 4;
+
+            for (int i = 0; i < width + 2 * radius; ++i)
+            {
+                int sx = std::max(0, std::min(i - radius, width - 1)) * 4;
+#ifdef LAB2_SSE2
+                _mm_storeu_ps(&padded[i * 4], _mm_cvtepi32_ps(LoadPixel32(row + sx)));
+#else
+                for (int c = 0; c < 4; ++c)
+                    padded[i * 4 + c] = row[sx + c];
+#endif
+            }
+
+            const float *p = padded.data() + radius * 4;
+            for (int x = 0; x < width; ++x)
+            {
+                const float *center = p + x * 4;
+#ifdef LAB2_SSE2
+                __m128 acc = _mm_mul_ps(_mm_loadu_ps(center), _mm_loadu_ps(&weights[0]));
+                for (int k = 1; k <= radius; ++k)
+                {
+                    __m128 pair = _mm_add_ps(_mm_loadu_ps(center - k * 4), _mm_loadu_ps(center + k * 4));
+                    acc = _mm_add_ps(acc, _mm_mul_ps(pair, _mm_loadu_ps(&weights[k * 4])));
+                }
+                __m128i v = _mm_cvttps_epi32(_mm_add_ps(acc, _mm_set1_ps(0.5f)));
+                v = _mm_packs_epi32(v, v);
+                v = _mm_packus_epi16(v, v);
+                int packed = _mm_cvtsi128_si32(v);
+                std::memcpy(dstRow + x * 4, &packed, 4);
+#else
+                for (int c = 0; c < 4; ++c)
+                {
+                    float acc = center[c] * kernel[0];
+                    for (int k = 1; k <= radius; ++k)
+                        acc += (center[c - k * 4] + center[c + k * 4]) * kernel[k];
+                    dstRow[x * 4 + c] = (unsigned char)std::min(255, (int)(acc + 0.5f));
+                }
+#endif
+            }
+        }
+    }
+
+    // Transposes a width x height matrix of RGBA pixels in cache-sized blocks.
+    // Pixels are moved with memcpy and unaligned loads, so the buffers need no
+    // particular alignment and are never accessed through another type.
+    static void Transpose(const unsigned char *in, unsigned char *out, int width, int height)
+    {
+        auto src = [&](int x, int y) { return in + ((size_t)y * width + x) * 4; };
+        auto dst = [&](int x, int y) { return out + ((size_t)x * height + y) * 4; };
+
+        for (int by = 0; by < height; by += TRANSPOSE_BLOCK)
+        {
+            int yEnd = std::min(by + TRANSPOSE_BLOCK, height);
+            for (int bx = 0; bx < width; bx += TRANSPOSE_BLOCK)
+            {
+                int xEnd = std::min(bx + TRANSPOSE_BLOCK, width);
+                int y = by;
+#ifdef LAB2_SSE2
+                for (; y + 4 <= yEnd; y += 4)
+                {
+                    int x = bx;
+                    for (; x + 4 <= xEnd; x += 4)
+                    {
+                        __m128i r0 = _mm_loadu_si128((const __m128i *)src(x, y + 0));
+                        __m128i r1 = _mm_loadu_si128((const __m128i *)src(x, y + 1));
+                        __m128i r2 = _mm_loadu_si128((const __m128i *)src(x, y + 2));
+                        __m128i r3 = _mm_loadu_si128((const __m128i *)src(x, y + 3));
+
+                        __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+                        __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+                        __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+                        __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+                        _mm_storeu_si128((__m128i *)dst(x + 0, y), _mm_unpacklo_epi64(t0, t1));
+                        _mm_storeu_si128((__m128i *)dst(x + 1, y), _mm_unpackhi_epi64(t0, t1));
+                        _mm_storeu_si128((__m128i *)dst(x + 2, y), _mm_unpacklo_epi64(t2, t3));
+                        _mm_storeu_si128((__m128i *)dst(x + 3, y), _mm_unpackhi_epi64(t2, t3));
+                    }
+                    for (; x < xEnd; ++x)
+                        for (int yy = y; yy < y + 4; ++yy)
+                            std::memcpy(dst(x, yy), src(x, yy), 4);
+                }
+#endif
+                for (; y < yEnd; ++y)
+                    for (int x = bx; x < xEnd; ++x)
+                        std::memcpy(dst(x, y), src(x, y), 4);
+            }
+        }
+    }
+
+    template <typename T>
+    static void BoxBlurRows(const T *in, T *out, int width, int height, int radius)
+    {
+        using Sum = typename PixelTraits<T>::Sum;
+        const double inv = 1.0 / (double)(2 * radius + 1);
+
+        for (int y = 0; y < height; ++y)
+        {
+            const T *row = in + (size_t)y * width * 4;
+            T *dstRow = out + (size_t)y * width * 4;
+
+            Sum sum[4];
+            for (int c = 0; c < 4; ++c)
+            {
+                sum[c] = 0;
+                for (int i = -radius; i <= radius; ++i)
+                    sum[c] += row[std::max(0, std::min(i, width - 1)) * 4 + c];
+            }
+
+            for (int x = 0; x < width; ++x)
+            {
+                int addIdx = std::min(x + radius + 1, width - 1) * 4;
+                int subIdx = std::max(x - radius, 0) * 4;
+                for (int c = 0; c < 4; ++c)
+                {
+                    dstRow[x * 4 + c] = PixelTraits<T>::Round((double)sum[c] * inv);
+                    sum[c] += (Sum)row[addIdx + c] - (Sum)row[subIdx + c];
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    static void ConvolveRows(const T *in, T *out, int width, int height, ScratchBuffer<float> kernel)
+    {
+        const int radius = (int)kernel.size() - 1;
+
+        for (int y = 0; y < height; ++y)
+        {
+            const T *row = in + (size_t)y * width * 4;
+            T *dstRow = out + (size_t)y * width * 4;
+
+            for (int x = 0; x < width; ++x)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    float acc = row[x * 4 + c] * kernel[0];
+                    for (int k = 1; k <= radius; ++k)
+                    {
+                        int left = std::max(0, x - k) * 4 + c;
+                        int right = std::min(width - 1, x + k) * 4 + c;
+                        acc += ((float)row[left] + (float)row[right]) * kernel[k];
+                    }
+                    dstRow[x * 4 + c] = PixelTraits<T>::Round(acc);
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    static void Transpose(const T *in, T *out, int width, int height)
+    {
+        struct Pixel
+        {
+            T c[4];
+        };
+        const Pixel *src = reinterpret_cast<const Pixel *>(in);
+        Pixel *dst = reinterpret_cast<Pixel *>(out);
+
+        for (int by = 0; by < height; by += TRANSPOSE_BLOCK)
+        {
+            int yEnd = std::min(by + TRANSPOSE_BLOCK, height);
+            for (int bx = 0; bx < width; bx += TRANSPOSE_BLOCK)
+            {
+                int xEnd = std::min(bx + TRANSPOSE_BLOCK, width);
+                for (int y = by; y < yEnd; ++y)
+                    for (int x = bx; x < xEnd; ++x)
+                        dst[(size_t)x * height + y] = src[(size_t)y * width + x];
+            }
+        }
+    }
+
+#ifdef LAB2_SSE2
+    static __m128i LoadPixel32(const unsigned char *p)
+    {
+        int packed;
+        std::memcpy(&packed, p, 4);
+        __m128i v = _mm_cvtsi32_si128(packed);
+        v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+        return _mm_unpacklo_epi16(v, _mm_setzero_si128());
+    }
+#endif
+};
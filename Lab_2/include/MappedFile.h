@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. Pages are loaded by the OS on
+// first access, so opening a large file costs nothing until it is read.
+class MappedFile
+{
+public:
+    static std::shared_ptr<const MappedFile> Open(const char *path)
+    {
+        std::shared_ptr<MappedFile> file(new MappedFile());
+        if (!file->Map(path))
+            return nullptr;
+        return file;
+    }
+
+    ~MappedFile()
+    {
+#if defined(_WIN32)
+        if (data)
+            UnmapViewOfFile(data);
+#else
+        if (data)
+            munmap(data, size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const unsigned char *Data() const { return static_cast<const unsigned char *>(data); }
+    size_t Size() const { return size; }
+
+private:
+    void *data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+
+    bool Map(const char *path)
+    {
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping)
+            return false;
+
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        size = (size_t)fileSize.QuadPart;
+        return data != nullptr;
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        void *mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        data = mapped;
+        size = (size_t)info.st_size;
+        return true;
+#endif
+    }
+};
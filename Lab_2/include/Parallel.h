@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Parallel
+{
+public:
+    static int ThreadCount()
+    {
+        unsigned int n = std::thread::hardware_concurrency();
+        return n > 0 ? (int)n : 1;
+    }
+
+    static int WorkerCount(int count, int minChunk = 1)
+    {
+        return std::max(1, std::min(ThreadCount(), count / std::max(1, minChunk)));
+    }
+
+    // Splits [begin, end) into one contiguous chunk per worker and calls
+    // body(chunkBegin, chunkEnd, workerIndex). The calling thread runs chunk 0,
+    // the others run on the persistent pool, so their thread_local scratch
+    // arenas outlive the call. A call made while the pool is busy (from inside
+    // a body, or from a second thread) starts its own threads instead.
+    template <typename F>
+    static void For(int begin, int end, F &&body, int minChunk = 1)
+    {
+        int count = end - begin;
+        if (count <= 0)
+            return;
+
+        int workers = WorkerCount(count, minChunk);
+        if (workers == 1)
+        {
+            body(begin, end, 0);
+            return;
+        }
+
+        auto chunk = [&](int w)
+        {
+            int chunkBegin = begin + (int)((long long)count * w / workers);
+            int chunkEnd = begin + (int)((long long)count * (w + 1) / workers);
+            body(chunkBegin, chunkEnd, w);
+        };
+        if (Pool::Get().Run(workers, &Invoke<decltype(chunk)>, &chunk))
+            return;
+
+        std::vector<std::thread> threads;
+        threads.reserve(workers - 1);
+        for (int w = 1; w < workers; ++w)
+            threads.emplace_back([&chunk, w]()
+                                 { chunk(w); });
+
+        chunk(0);
+
+        for (std::thread &t : threads)
+            t.join();
+    }
+
+private:
+    using Task = void (*)(void *context, int worker);
+
+    template <typename C>
+    static void Invoke(void *context, int worker)
+    {
+        (*static_cast<C *>(context))(worker);
+    }
+
+    // Workers 1..n-1 of a For call. The threads are started the first time a
+    // call needs them and wait for the next call between jobs.
+    class Pool
+    {
+    public:
+        static Pool &Get()
+        {
+            static Pool pool;
+            return pool;
+        }
+
+        ~Pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread &t : threads)
+                t.join();
+        }
+
+        // Runs task(context, w) for w in [0, workers), w = 0 on the caller.
+        // Returns false without running anything when the pool is in use.
+        bool Run(int workers, Task task, void *context)
+        {
+            if (busy.exchange(true, std::memory_order_acquire))
+                return false;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while ((int)threads.size() < workers - 1)
+                    threads.emplace_back(&Pool::Loop, this, (int)threads.size() + 1, generation);
+                job = task;
+                jobContext = context;
+                jobWorkers = workers;
+                pending = workers - 1;
+                generation++;
+            }
+            wake.notify_all();
+
+            task(context, 0);
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [&]
+                          { return pending == 0; });
+            }
+            busy.store(false, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        std::atomic<bool> busy{false};
+        bool stopping = false;
+        unsigned generation = 0;
+        Task job = nullptr;
+        void *jobContext = nullptr;
+        int jobWorkers = 0;
+        int pending = 0;
+
+        void Loop(int index, unsigned seen)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                wake.wait(lock, [&]
+                          { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                if (index >= jobWorkers)
+                    continue;
+
+                Task task = job;
+                void *context = jobContext;
+                lock.unlock();
+                task(context, index);
+                lock.lock();
+                if (--pending == 0)
+                    done.notify_one();
+            }
+        }
+    };
+};
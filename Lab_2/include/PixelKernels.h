@@ -0,0 +1,565 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+
+#include "CpuDispatch.h"
+
+// Row kernels shared by the filters, each compiled for several instruction
+// sets. Get() binds every kernel once to the best variant the CPU (and the
+// LAB2_ISA override) allows. All variants produce identical output.
+class PixelKernels
+{
+public:
+    // RGBA8 -> 8-bit luminance, the same float formula as ImageProcessor::GetLum.
+    using LumaFn = void (*)(const uint8_t *rgba, uint8_t *luma, size_t count);
+    // RGBA8 -> 1 where luminance < threshold, 0 elsewhere.
+    using MaskFn = void (*)(const uint8_t *rgba, uint8_t *mask, size_t count, uint8_t threshold);
+    // 8-bit gray -> RGBA8 (gray, gray, gray, 255).
+    using ExpandFn = void (*)(const uint8_t *luma, uint8_t *rgba, size_t count);
+    // 16-bit -> 8-bit with rounding, v * 255 / 65535.
+    using NarrowFn = void (*)(const uint16_t *in, uint8_t *out, size_t count);
+    // Bilinear RGBA8 samples along a line: pixel i is read at (x + i * stepX,
+    // y + i * stepY) in 16.16 fixed point, with `stride` bytes per source row.
+    // Every sample and its right and lower neighbours must lie in the image.
+    using BilinearFn = void (*)(const uint8_t *rgba, size_t stride, uint8_t *out, size_t count,
+                                int64_t x, int64_t y, int64_t stepX, int64_t stepY);
+
+    template <typename Fn>
+    struct Binding
+    {
+        Fn fn = nullptr;
+        Isa isa = Isa::Scalar;
+    };
+
+    Binding<LumaFn> luma;
+    Binding<MaskFn> mask;
+    Binding<ExpandFn> expand;
+    Binding<NarrowFn> narrow;
+    Binding<BilinearFn> bilinear;
+
+    static const PixelKernels &Get()
+    {
+        static const PixelKernels kernels = Bind(CpuDispatch::Active());
+        return kernels;
+    }
+
+    static PixelKernels Bind(Isa limit)
+    {
+        PixelKernels k;
+        k.luma = Pick<LumaFn>(limit, {{Isa::Scalar, LumaScalar}
+#ifdef LAB2_X86
+                                      , {Isa::Sse2, LumaSse2}, {Isa::Sse41, LumaSse41}, {Isa::Avx2, LumaAvx2}, {Isa::Avx512, LumaAvx512}
+#endif
+                                     });
+        k.mask = Pick<MaskFn>(limit, {{Isa::Scalar, MaskScalar}
+#ifdef LAB2_X86
+                                      , {Isa::Sse2, MaskSse2}, {Isa::Sse41, MaskSse41}, {Isa::Avx2, MaskAvx2}, {Isa::Avx512, MaskAvx512}
+#endif
+                                     });
+        k.expand = Pick<ExpandFn>(limit, {{Isa::Scalar, ExpandScalar}
+#ifdef LAB2_X86
+                                          , {Isa::Sse2, ExpandSse2}, {Isa::Sse41, ExpandSse41}, {Isa::Avx2, ExpandAvx2}, {Isa::Avx512, ExpandAvx512}
+#endif
+                                         });
+        k.narrow = Pick<NarrowFn>(limit, {{Isa::Scalar, NarrowScalar}
+#ifdef LAB2_X86
+                                          , {Isa::Sse2, NarrowSse2}, {Isa::Sse41, NarrowSse41}, {Isa::Avx2, NarrowAvx2}
+#endif
+                                         });
+        k.bilinear = Pick<BilinearFn>(limit, {{Isa::Scalar, BilinearScalar}
+#ifdef LAB2_X86
+                                              , {Isa::Sse2, BilinearSse2}, {Isa::Avx2, BilinearAvx2}
+#endif
+                                             });
+        return k;
+    }
+
+    std::string Report() const
+    {
+        std::string text = "luma: ";
+        text += CpuDispatch::Name(luma.isa);
+        text += ", mask: ";
+        text += CpuDispatch::Name(mask.isa);
+        text += ", expand: ";
+        text += CpuDispatch::Name(expand.isa);
+        text += ", narrow: ";
+        text += CpuDispatch::Name(narrow.isa);
+        text += ", bilinear: ";
+        text += CpuDispatch::Name(bilinear.isa);
+        return text;
+    }
+
+private:
+    template <typename Fn>
+    struct Variant
+    {
+        Isa isa;
+        Fn fn;
+    };
+
+    template <typename Fn>
+    static Binding<Fn> Pick(Isa limit, std::initializer_list<Variant<Fn>> variants)
+    {
+        Binding<Fn> best;
+        for (const Variant<Fn> &v : variants)
+        {
+            if (v.isa <= limit && (best.fn == nullptr || v.isa > best.isa))
+            {
+                best.fn = v.fn;
+                best.isa = v.isa;
+            }
+        }
+        return best;
+    }
+
+    static uint8_t LumaOf(const uint8_t *p)
+    {
+        return (uint8_t)(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]);
+    }
+
+    static uint8_t NarrowOf(uint16_t v)
+    {
+        uint32_t x = (uint32_t)v + 128;
+        return (uint8_t)((x - (x >> 8)) >> 8);
+    }
+
+    // The scalar loops also finish the tails of the SIMD variants. They must not
+    // be inlined there: an AVX-512 target allows FMA, and a fused multiply-add
+    // rounds differently from the separate multiply and add used in LumaOf.
+    LAB2_NOINLINE
+    static void LumaScalar(const uint8_t *rgba, uint8_t *luma, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            luma[i] = LumaOf(rgba + i * 4);
+    }
+
+    LAB2_NOINLINE
+    static void MaskScalar(const uint8_t *rgba, uint8_t *mask, size_t count, uint8_t threshold)
+    {
+        for (size_t i = 0; i < count; ++i)
+            mask[i] = LumaOf(rgba + i * 4) < threshold ? 1 : 0;
+    }
+
+    static void ExpandScalar(const uint8_t *luma, uint8_t *rgba, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            rgba[i * 4] = luma[i];
+            rgba[i * 4 + 1] = luma[i];
+            rgba[i * 4 + 2] = luma[i];
+            rgba[i * 4 + 3] = 255;
+        }
+    }
+
+    static void NarrowScalar(const uint16_t *in, uint8_t *out, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = NarrowOf(in[i]);
+    }
+
+    // Vertical blend first, then horizontal, each rounded to 8 bits in
+    // 16-bit arithmetic exactly as the SIMD variant does it.
+    static void BilinearScalar(const uint8_t *rgba, size_t stride, uint8_t *out, size_t count,
+                               int64_t x, int64_t y, int64_t stepX, int64_t stepY)
+    {
+        for (size_t i = 0; i < count; ++i, x += stepX, y += stepY)
+        {
+            const uint8_t *top = rgba + (size_t)(y >> 16) * stride + (size_t)(x >> 16) * 4;
+            const uint8_t *bottom = top + stride;
+            const uint32_t fx = (uint32_t)(x >> 8) & 255;
+            const uint32_t fy = (uint32_t)(y >> 8) & 255;
+            for (int c = 0; c < 4; ++c)
+            {
+                uint32_t left = (top[c] * (256 - fy) + bottom[c] * fy + 128) >> 8;
+                uint32_t right = (top[c + 4] * (256 - fy) + bottom[c + 4] * fy + 128) >> 8;
+                out[i * 4 + c] = (uint8_t)((left * (256 - fx) + right * fx + 128) >> 8);
+            }
+        }
+    }
+
+#ifdef LAB2_X86
+    // The float formula is evaluated as mul, mul, add, mul, add in every
+    // variant (no FMA), which keeps the results bit-identical to LumaOf.
+    LAB2_TARGET("sse2")
+    static __m128i Luma4Sse2(__m128i px)
+    {
+        const __m128i byteMask = _mm_set1_epi32(0xFF);
+        __m128 r = _mm_cvtepi32_ps(_mm_and_si128(px, byteMask));
+        __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), byteMask));
+        __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), byteMask));
+        __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.299f)), _mm_mul_ps(g, _mm_set1_ps(0.587f))),
+                              _mm_mul_ps(b, _mm_set1_ps(0.114f)));
+        return _mm_cvttps_epi32(l);
+    }
+
+    LAB2_TARGET("sse2")
+    static __m128i Luma16Sse2(const uint8_t *rgba)
+    {
+        __m128i a = Luma4Sse2(_mm_loadu_si128((const __m128i *)rgba));
+        __m128i b = Luma4Sse2(_mm_loadu_si128((const __m128i *)(rgba + 16)));
+        __m128i c = Luma4Sse2(_mm_loadu_si128((const __m128i *)(rgba + 32)));
+        __m128i d = Luma4Sse2(_mm_loadu_si128((const __m128i *)(rgba + 48)));
+        return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    }
+
+    LAB2_TARGET("sse2")
+    static __m128i Below16Sse2(__m128i luma, __m128i threshold)
+    {
+        __m128i notBelow = _mm_cmpeq_epi8(_mm_subs_epu8(threshold, luma), _mm_setzero_si128());
+        return _mm_andnot_si128(notBelow, _mm_set1_epi8(1));
+    }
+
+    // One pixel per step: the two source pixels of each row are loaded
+    // together and widened to eight 16-bit lanes.
+    LAB2_TARGET("sse2")
+    static void BilinearSse2(const uint8_t *rgba, size_t stride, uint8_t *out, size_t count,
+                             int64_t x, int64_t y, int64_t stepX, int64_t stepY)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i half = _mm_set1_epi16(128);
+        for (size_t i = 0; i < count; ++i, x += stepX, y += stepY)
+        {
+            const uint8_t *p = rgba + (size_t)(y >> 16) * stride + (size_t)(x >> 16) * 4;
+            const short fx = (short)((x >> 8) & 255);
+            const short fy = (short)((y >> 8) & 255);
+
+            __m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), zero);
+            __m128i bottom = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + stride)), zero);
+            __m128i v = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16((short)(256 - fy))),
+                                      _mm_mullo_epi16(bottom, _mm_set1_epi16(fy)));
+            v = _mm_srli_epi16(_mm_add_epi16(v, half), 8);
+
+            const short ifx = (short)(256 - fx);
+            __m128i h = _mm_mullo_epi16(v, _mm_set_epi16(fx, fx, fx, fx, ifx, ifx, ifx, ifx));
+            h = _mm_add_epi16(h, _mm_srli_si128(h, 8));
+            h = _mm_srli_epi16(_mm_add_epi16(h, half), 8);
+            int pixel = _mm_cvtsi128_si32(_mm_packus_epi16(h, h));
+            std::memcpy(out + i * 4, &pixel, 4);
+        }
+    }
+
+    LAB2_TARGET("sse2")
+    static void LumaSse2(const uint8_t *rgba, uint8_t *luma, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            _mm_storeu_si128((__m128i *)(luma + i), Luma16Sse2(rgba + i * 4));
+        LumaScalar(rgba + i * 4, luma + i, count - i);
+    }
+
+    LAB2_TARGET("sse2")
+    static void MaskSse2(const uint8_t *rgba, uint8_t *mask, size_t count, uint8_t threshold)
+    {
+        const __m128i vThreshold = _mm_set1_epi8((char)threshold);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            _mm_storeu_si128((__m128i *)(mask + i), Below16Sse2(Luma16Sse2(rgba + i * 4), vThreshold));
+        MaskScalar(rgba + i * 4, mask + i, count - i, threshold);
+    }
+
+    LAB2_TARGET("sse2")
+    static void ExpandSse2(const uint8_t *luma, uint8_t *rgba, size_t count)
+    {
+        const __m128i opaque = _mm_set1_epi8((char)0xFF);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i l = _mm_loadu_si128((const __m128i *)(luma + i));
+            __m128i llLo = _mm_unpacklo_epi8(l, l);
+            __m128i llHi = _mm_unpackhi_epi8(l, l);
+            __m128i laLo = _mm_unpacklo_epi8(l, opaque);
+            __m128i laHi = _mm_unpackhi_epi8(l, opaque);
+
+            __m128i *out = (__m128i *)(rgba + i * 4);
+            _mm_storeu_si128(out, _mm_unpacklo_epi16(llLo, laLo));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(llLo, laLo));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(llHi, laHi));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(llHi, laHi));
+        }
+        ExpandScalar(luma + i, rgba + i * 4, count - i);
+    }
+
+    LAB2_TARGET("sse2")
+    static __m128i Narrow4Sse2(__m128i v)
+    {
+        __m128i x = _mm_add_epi32(v, _mm_set1_epi32(128));
+        return _mm_srli_epi32(_mm_sub_epi32(x, _mm_srli_epi32(x, 8)), 8);
+    }
+
+    LAB2_TARGET("sse2")
+    static void NarrowSse2(const uint16_t *in, uint8_t *out, size_t count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 8));
+            __m128i lo = _mm_packs_epi32(Narrow4Sse2(_mm_unpacklo_epi16(a, zero)), Narrow4Sse2(_mm_unpackhi_epi16(a, zero)));
+            __m128i hi = _mm_packs_epi32(Narrow4Sse2(_mm_unpacklo_epi16(b, zero)), Narrow4Sse2(_mm_unpackhi_epi16(b, zero)));
+            _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+        }
+        NarrowScalar(in + i, out + i, count - i);
+    }
+
+    // SSE4.1 packs unsigned 32-bit lanes directly and widens bytes and words
+    // with one pmovzx, instead of the SSE2 signed pack and unpacks with zero.
+    LAB2_TARGET("sse4.1")
+    static __m128i Luma16Sse41(const uint8_t *rgba)
+    {
+        __m128i a = Luma4Sse2(_mm_loadu_si128((const __m128i *)rgba));
+        __m128i b = Luma4Sse2(_mm_loadu_si128((const __m128i *)(rgba + 16)));
+        __m128i c = Luma4Sse2(_mm_loadu_si128((const __m128i *)(rgba + 32)));
+        __m128i d = Luma4Sse2(_mm_loadu_si128((const __m128i *)(rgba + 48)));
+        return _mm_packus_epi16(_mm_packus_epi32(a, b), _mm_packus_epi32(c, d));
+    }
+
+    LAB2_TARGET("sse4.1")
+    static void LumaSse41(const uint8_t *rgba, uint8_t *luma, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            _mm_storeu_si128((__m128i *)(luma + i), Luma16Sse41(rgba + i * 4));
+        LumaScalar(rgba + i * 4, luma + i, count - i);
+    }
+
+    LAB2_TARGET("sse4.1")
+    static void MaskSse41(const uint8_t *rgba, uint8_t *mask, size_t count, uint8_t threshold)
+    {
+        const __m128i vThreshold = _mm_set1_epi8((char)threshold);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            _mm_storeu_si128((__m128i *)(mask + i), Below16Sse2(Luma16Sse41(rgba + i * 4), vThreshold));
+        MaskScalar(rgba + i * 4, mask + i, count - i, threshold);
+    }
+
+    LAB2_TARGET("sse4.1")
+    static void ExpandSse41(const uint8_t *luma, uint8_t *rgba, size_t count)
+    {
+        const __m128i spread = _mm_set1_epi32(0x010101);
+        const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            int packed;
+            std::memcpy(&packed, luma + i, 4);
+            __m128i l = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+            _mm_storeu_si128((__m128i *)(rgba + i * 4), _mm_or_si128(_mm_mullo_epi32(l, spread), opaque));
+        }
+        ExpandScalar(luma + i, rgba + i * 4, count - i);
+    }
+
+    LAB2_TARGET("sse4.1")
+    static __m128i Narrow4Sse41(const uint16_t *in)
+    {
+        return Narrow4Sse2(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)in)));
+    }
+
+    LAB2_TARGET("sse4.1")
+    static void NarrowSse41(const uint16_t *in, uint8_t *out, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i lo = _mm_packus_epi32(Narrow4Sse41(in + i), Narrow4Sse41(in + i + 4));
+            __m128i hi = _mm_packus_epi32(Narrow4Sse41(in + i + 8), Narrow4Sse41(in + i + 12));
+            _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+        }
+        NarrowScalar(in + i, out + i, count - i);
+    }
+
+    LAB2_TARGET("avx2")
+    static __m256i Luma8Avx2(__m256i px)
+    {
+        const __m256i byteMask = _mm256_set1_epi32(0xFF);
+        __m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(px, byteMask));
+        __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), byteMask));
+        __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), byteMask));
+        __m256 l = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(0.299f)), _mm256_mul_ps(g, _mm256_set1_ps(0.587f))),
+                                 _mm256_mul_ps(b, _mm256_set1_ps(0.114f)));
+        return _mm256_cvttps_epi32(l);
+    }
+
+    // Packs four vectors of eight 32-bit values in 0..255 into 32 bytes in order;
+    // the packs work per 128-bit lane, so the 32-bit groups are reordered after.
+    LAB2_TARGET("avx2")
+    static __m256i Pack32Avx2(__m256i a, __m256i b, __m256i c, __m256i d)
+    {
+        __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        return _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    }
+
+    LAB2_TARGET("avx2")
+    static __m256i Luma32Avx2(const uint8_t *rgba)
+    {
+        return Pack32Avx2(Luma8Avx2(_mm256_loadu_si256((const __m256i *)rgba)),
+                          Luma8Avx2(_mm256_loadu_si256((const __m256i *)(rgba + 32))),
+                          Luma8Avx2(_mm256_loadu_si256((const __m256i *)(rgba + 64))),
+                          Luma8Avx2(_mm256_loadu_si256((const __m256i *)(rgba + 96))));
+    }
+
+    LAB2_TARGET("avx2")
+    static void LumaAvx2(const uint8_t *rgba, uint8_t *luma, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+            _mm256_storeu_si256((__m256i *)(luma + i), Luma32Avx2(rgba + i * 4));
+        LumaScalar(rgba + i * 4, luma + i, count - i);
+    }
+
+    LAB2_TARGET("avx2")
+    static void MaskAvx2(const uint8_t *rgba, uint8_t *mask, size_t count, uint8_t threshold)
+    {
+        const __m256i vThreshold = _mm256_set1_epi8((char)threshold);
+        const __m256i one = _mm256_set1_epi8(1);
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i l = Luma32Avx2(rgba + i * 4);
+            __m256i notBelow = _mm256_cmpeq_epi8(_mm256_subs_epu8(vThreshold, l), _mm256_setzero_si256());
+            _mm256_storeu_si256((__m256i *)(mask + i), _mm256_andnot_si256(notBelow, one));
+        }
+        MaskScalar(rgba + i * 4, mask + i, count - i, threshold);
+    }
+
+    LAB2_TARGET("avx2")
+    static void ExpandAvx2(const uint8_t *luma, uint8_t *rgba, size_t count)
+    {
+        const __m256i spread = _mm256_set1_epi32(0x010101);
+        const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i l = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(luma + i)));
+            _mm256_storeu_si256((__m256i *)(rgba + i * 4), _mm256_or_si256(_mm256_mullo_epi32(l, spread), opaque));
+        }
+        ExpandScalar(luma + i, rgba + i * 4, count - i);
+    }
+
+    LAB2_TARGET("avx2")
+    static __m256i Narrow8Avx2(const uint16_t *in)
+    {
+        __m256i x = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)in)), _mm256_set1_epi32(128));
+        return _mm256_srli_epi32(_mm256_sub_epi32(x, _mm256_srli_epi32(x, 8)), 8);
+    }
+
+    // Two pixels per step, one in each 128-bit half.
+    LAB2_TARGET("avx2")
+    static void BilinearAvx2(const uint8_t *rgba, size_t stride, uint8_t *out, size_t count,
+                             int64_t x, int64_t y, int64_t stepX, int64_t stepY)
+    {
+        const __m256i half = _mm256_set1_epi16(128);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2, x += 2 * stepX, y += 2 * stepY)
+        {
+            const int64_t x1 = x + stepX;
+            const int64_t y1 = y + stepY;
+            const uint8_t *p0 = rgba + (size_t)(y >> 16) * stride + (size_t)(x >> 16) * 4;
+            const uint8_t *p1 = rgba + (size_t)(y1 >> 16) * stride + (size_t)(x1 >> 16) * 4;
+            const short fx0 = (short)((x >> 8) & 255);
+            const short fy0 = (short)((y >> 8) & 255);
+            const short fx1 = (short)((x1 >> 8) & 255);
+            const short fy1 = (short)((y1 >> 8) & 255);
+
+            __m256i top = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)p0),
+                                                                  _mm_loadl_epi64((const __m128i *)p1)));
+            __m256i bottom = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(p0 + stride)),
+                                                                     _mm_loadl_epi64((const __m128i *)(p1 + stride))));
+            __m256i wy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi16(fy0)), _mm_set1_epi16(fy1), 1);
+            __m256i v = _mm256_add_epi16(_mm256_mullo_epi16(top, _mm256_sub_epi16(_mm256_set1_epi16(256), wy)),
+                                         _mm256_mullo_epi16(bottom, wy));
+            v = _mm256_srli_epi16(_mm256_add_epi16(v, half), 8);
+
+            const short ifx0 = (short)(256 - fx0);
+            const short ifx1 = (short)(256 - fx1);
+            __m256i wx = _mm256_set_epi16(fx1, fx1, fx1, fx1, ifx1, ifx1, ifx1, ifx1,
+                                          fx0, fx0, fx0, fx0, ifx0, ifx0, ifx0, ifx0);
+            __m256i h = _mm256_mullo_epi16(v, wx);
+            h = _mm256_add_epi16(h, _mm256_srli_si256(h, 8));
+            h = _mm256_srli_epi16(_mm256_add_epi16(h, half), 8);
+            h = _mm256_packus_epi16(h, h);
+            int pixel0 = _mm_cvtsi128_si32(_mm256_castsi256_si128(h));
+            int pixel1 = _mm_cvtsi128_si32(_mm256_extracti128_si256(h, 1));
+            std::memcpy(out + i * 4, &pixel0, 4);
+            std::memcpy(out + i * 4 + 4, &pixel1, 4);
+        }
+        BilinearSse2(rgba, stride, out + i * 4, count - i, x, y, stepX, stepY);
+    }
+
+    LAB2_TARGET("avx2")
+    static void NarrowAvx2(const uint16_t *in, uint8_t *out, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i bytes = Pack32Avx2(Narrow8Avx2(in + i), Narrow8Avx2(in + i + 8),
+                                       Narrow8Avx2(in + i + 16), Narrow8Avx2(in + i + 24));
+            _mm256_storeu_si256((__m256i *)(out + i), bytes);
+        }
+        NarrowScalar(in + i, out + i, count - i);
+    }
+
+    // GCC 12 reports the _mm512_undefined_* operands inside the AVX-512
+    // intrinsics as maybe-uninitialized once they are inlined here.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+    LAB2_TARGET("avx512f,avx512bw")
+    static __m128i Luma16Avx512(const uint8_t *rgba)
+    {
+        const __m512i byteMask = _mm512_set1_epi32(0xFF);
+        __m512i px = _mm512_loadu_si512((const void *)rgba);
+        __m512 r = _mm512_cvtepi32_ps(_mm512_and_si512(px, byteMask));
+        __m512 g = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(px, 8), byteMask));
+        __m512 b = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(px, 16), byteMask));
+        // AVX-512F implies FMA, so the explicitly rounded forms are used to keep
+        // the compiler from fusing the multiplies into the adds.
+        const int mode = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+        __m512 rg = _mm512_add_round_ps(_mm512_mul_round_ps(r, _mm512_set1_ps(0.299f), mode),
+                                        _mm512_mul_round_ps(g, _mm512_set1_ps(0.587f), mode), mode);
+        __m512 l = _mm512_add_round_ps(rg, _mm512_mul_round_ps(b, _mm512_set1_ps(0.114f), mode), mode);
+        return _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(l));
+    }
+
+    LAB2_TARGET("avx512f,avx512bw")
+    static void LumaAvx512(const uint8_t *rgba, uint8_t *luma, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            _mm_storeu_si128((__m128i *)(luma + i), Luma16Avx512(rgba + i * 4));
+        LumaScalar(rgba + i * 4, luma + i, count - i);
+    }
+
+    LAB2_TARGET("avx512f,avx512bw")
+    static void MaskAvx512(const uint8_t *rgba, uint8_t *mask, size_t count, uint8_t threshold)
+    {
+        const __m128i vThreshold = _mm_set1_epi8((char)threshold);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            _mm_storeu_si128((__m128i *)(mask + i), Below16Sse2(Luma16Avx512(rgba + i * 4), vThreshold));
+        MaskScalar(rgba + i * 4, mask + i, count - i, threshold);
+    }
+
+    LAB2_TARGET("avx512f,avx512bw")
+    static void ExpandAvx512(const uint8_t *luma, uint8_t *rgba, size_t count)
+    {
+        const __m512i spread = _mm512_set1_epi32(0x010101);
+        const __m512i opaque = _mm512_set1_epi32((int)0xFF000000);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m512i l = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(luma + i)));
+            _mm512_storeu_si512((void *)(rgba + i * 4), _mm512_or_si512(_mm512_mullo_epi32(l, spread), opaque));
+        }
+        ExpandScalar(luma + i, rgba + i * 4, count - i);
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+};
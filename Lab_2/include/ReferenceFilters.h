@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+#include "ImageProcessor.h"
+
+// Frozen copies of the original per-pixel median, Bernsen and Niblack loops,
+// together with the luminance, decision and write helpers they depend on.
+// Every implementation registered in ImageProcessor must reproduce these
+// bit for bit; Lab_2_fuzz checks that. Do not optimize or share code with
+// ImageProcessor here, or the reference would drift with what it checks.
+class ReferenceFilters
+{
+public:
+    template <typename T>
+    using ImageT = ImageProcessor::ImageT<T>;
+
+    template <typename T>
+    static void Median(const ImageT<T> &src, ImageT<T> &dst, int kernelSize)
+    {
+        Prepare(src, dst);
+        int radius = kernelSize / 2;
+        std::vector<T> window;
+        window.reserve((size_t)kernelSize * kernelSize);
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            for (int x = 0; x < src.width; ++x)
+            {
+                window.clear();
+                for (int ky = -radius; ky <= radius; ++ky)
+                {
+                    for (int kx = -radius; kx <= radius; ++kx)
+                    {
+                        window.push_back(GetLum(src, x + kx, y + ky));
+                    }
+                }
+                std::sort(window.begin(), window.end());
+                T med = window[window.size() / 2];
+
+                WritePixel(dst, x, y, med);
+            }
+        }
+    }
+
+    // `otsuLevel` < 0 compares flat windows with mid-grey, otherwise with the
+    // lowest value above that histogram bin.
+    template <typename T>
+    static void Bernsen(const ImageT<T> &src, ImageT<T> &dst, int kernelSize, int contrastLimit, int otsuLevel = -1)
+    {
+        using Sum = typename PixelTraits<T>::Sum;
+        const Sum contrastLimitT = PixelTraits<T>::FromU8(contrastLimit);
+        const Sum midLevel = FlatLevel<T>(otsuLevel);
+
+        Prepare(src, dst);
+        int radius = kernelSize / 2;
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            for (int x = 0; x < src.width; ++x)
+            {
+                T minVal = PixelTraits<T>::Max;
+                T maxVal = 0;
+
+                for (int ky = -radius; ky <= radius; ++ky)
+                {
+                    for (int kx = -radius; kx <= radius; ++kx)
+                    {
+                        T val = GetLum(src, x + kx, y + ky);
+                        if (val < minVal)
+                            minVal = val;
+                        if (val > maxVal)
+                            maxVal = val;
+                    }
+                }
+
+                Sum mid = ((Sum)minVal + (Sum)maxVal) / 2;
+                Sum contrast = (Sum)maxVal - (Sum)minVal;
+                T pixel = GetLum(src, x, y);
+
+                T res;
+                if (contrast < contrastLimitT)
+                    res = (mid >= midLevel) ? PixelTraits<T>::Max : 0;
+                else
+                    res = (pixel >= mid) ? PixelTraits<T>::Max : 0;
+                WritePixel(dst, x, y, res);
+            }
+        }
+    }
+
+    template <typename T>
+    static void Niblack(const ImageT<T> &src, ImageT<T> &dst, int kernelSize, float k)
+    {
+        using Real = typename PixelTraits<T>::Real;
+
+        Prepare(src, dst);
+        int radius = kernelSize / 2;
+        int N = kernelSize * kernelSize;
+
+        for (int y = 0; y < src.height; ++y)
+        {
+            for (int x = 0; x < src.width; ++x)
+            {
+                Real sum = 0;
+                Real sumSq = 0;
+
+                for (int ky = -radius; ky <= radius; ++ky)
+                {
+                    for (int kx = -radius; kx <= radius; ++kx)
+                    {
+                        Real val = GetLum(src, x + kx, y + ky);
+                        sum += val;
+                        sumSq += (val * val);
+                    }
+                }
+
+                Real mean = sum / N;
+                Real variance = (sumSq / N) - (mean * mean);
+                Real sigma = std::sqrt(std::max((Real)0, variance));
+
+                Real threshold = mean + k * sigma;
+
+                T pixel = GetLum(src, x, y);
+                T res = (pixel > threshold) ? PixelTraits<T>::Max : 0;
+
+                WritePixel(dst, x, y, res);
+            }
+        }
+    }
+
+private:
+    template <typename T>
+    static void Prepare(const ImageT<T> &src, ImageT<T> &dst)
+    {
+        dst.width = src.width;
+        dst.height = src.height;
+        dst.channels = src.channels;
+        dst.data.assign(src.data.size(), 0);
+    }
+
+    template <typename T>
+    static T GetLum(const ImageT<T> &img, int x, int y)
+    {
+        x = std::max(0, std::min(x, img.width - 1));
+        y = std::max(0, std::min(y, img.height - 1));
+
+        int idx = (y * img.width + x) * 4;
+        T r = img.data[idx];
+        T g = img.data[idx + 1];
+        T b = img.data[idx + 2];
+
+        return static_cast<T>(0.299f * r + 0.587f * g + 0.114f * b);
+    }
+
+    template <typename T>
+    static void WritePixel(ImageT<T> &dst, int x, int y, T value)
+    {
+        int idx = (y * dst.width + x) * 4;
+        dst.data[idx] = value;
+        dst.data[idx + 1] = value;
+        dst.data[idx + 2] = value;
+        dst.data[idx + 3] = PixelTraits<T>::Max;
+    }
+
+    template <typename T>
+    static typename PixelTraits<T>::Sum FlatLevel(int otsuLevel)
+    {
+        using Sum = typename PixelTraits<T>::Sum;
+        if (otsuLevel < 0)
+            return PixelTraits<T>::FromU8(128);
+        const int bin = otsuLevel + 1;
+        if constexpr (std::is_same<T, unsigned char>::value)
+            return (Sum)bin;
+        else if constexpr (std::is_same<T, unsigned short>::value)
+            return (Sum)bin << 8;
+        else
+            return (bin - 0.5) / 255.0;
+    }
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Non-owning view of scratch memory handed out by ScratchArena.
+template <typename T>
+struct ScratchBuffer
+{
+    T *ptr = nullptr;
+    size_t count = 0;
+
+    T *data() const { return ptr; }
+    size_t size() const { return count; }
+    T *begin() const { return ptr; }
+    T *end() const { return ptr + count; }
+    T &operator[](size_t i) const { return ptr[i]; }
+};
+
+// Per-thread bump allocator for filter temporaries. Allocations are aligned to
+// a cache line and are only released by rewinding a Scope, so a filter that
+// opens a Scope returns all of its scratch memory when it finishes. Once the
+// arena has grown to the largest job it keeps that memory, and later jobs of
+// the same size do no heap allocation at all.
+class ScratchArena
+{
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    class Scope
+    {
+    public:
+        Scope() : Scope(ForThread()) {}
+        explicit Scope(ScratchArena &owner) : arena(owner), mark(owner.GetMark()) {}
+        ~Scope() { arena.Rewind(mark); }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        ScratchArena &arena;
+        size_t mark;
+    };
+
+    ScratchArena() = default;
+    ScratchArena(const ScratchArena &) = delete;
+    ScratchArena &operator=(const ScratchArena &) = delete;
+
+    ~ScratchArena()
+    {
+        for (Block &b : blocks)
+            ::operator delete(b.data, std::align_val_t(ALIGNMENT));
+    }
+
+    static ScratchArena &ForThread()
+    {
+        thread_local ScratchArena arena;
+        return arena;
+    }
+
+    // Uninitialized storage for `count` objects; T must be trivial.
+    template <typename T>
+    ScratchBuffer<T> Allocate(size_t count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                      "scratch memory is never constructed or destroyed");
+        return ScratchBuffer<T>{static_cast<T *>(AllocateBytes(count * sizeof(T))), count};
+    }
+
+    template <typename T>
+    ScratchBuffer<T> Allocate(size_t count, T value)
+    {
+        ScratchBuffer<T> buffer = Allocate<T>(count);
+        std::fill(buffer.begin(), buffer.end(), value);
+        return buffer;
+    }
+
+    void *AllocateBytes(size_t bytes)
+    {
+        bytes = RoundUp(std::max<size_t>(bytes, 1));
+
+        while (current < blocks.size() && blocks[current].used + bytes > blocks[current].size)
+        {
+            ++current;
+            if (current < blocks.size())
+                blocks[current].used = 0;
+        }
+        if (current == blocks.size())
+            AddBlock(bytes);
+
+        Block &b = blocks[current];
+        void *p = b.data + b.used;
+        b.used += bytes;
+        inUse += bytes;
+        highWater = std::max(highWater, inUse);
+        return p;
+    }
+
+    size_t BytesInUse() const { return inUse; }
+    size_t HighWater() const { return highWater; }
+
+    size_t Capacity() const
+    {
+        size_t total = 0;
+        for (const Block &b : blocks)
+            total += b.size;
+        return total;
+    }
+
+    // Number of blocks obtained from the system heap by all arenas.
+    static size_t SystemAllocations()
+    {
+        return BlockCounter().load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t MIN_BLOCK = 1 << 20;
+
+    struct Block
+    {
+        char *data;
+        size_t size;
+        size_t used;
+    };
+
+    std::vector<Block> blocks;
+    size_t current = 0;
+    size_t inUse = 0;
+    size_t highWater = 0;
+
+    static std::atomic<size_t> &BlockCounter()
+    {
+        static std::atomic<size_t> counter{0};
+        return counter;
+    }
+
+    static size_t RoundUp(size_t bytes)
+    {
+        return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    void AddBlock(size_t bytes)
+    {
+        size_t size = std::max({bytes, MIN_BLOCK, Capacity()});
+        char *data = static_cast<char *>(::operator new(size, std::align_val_t(ALIGNMENT)));
+        BlockCounter().fetch_add(1, std::memory_order_relaxed);
+        blocks.push_back(Block{data, size, 0});
+    }
+
+    // A mark is the number of bytes in use; rewinding walks back through the
+    // blocks, since every block before `current` is full up to its `used`.
+    size_t GetMark() const { return inUse; }
+
+    void Rewind(size_t mark)
+    {
+        while (inUse > mark)
+        {
+            Block &b = blocks[current];
+            size_t release = std::min(b.used, inUse - mark);
+            b.used -= release;
+            inUse -= release;
+            if (b.used == 0 && current > 0 && inUse > mark)
+                --current;
+        }
+
+        if (inUse == 0 && blocks.size() > 1)
+            Coalesce();
+    }
+
+    // After a job spilled into several blocks, replace them by one block
+    // large enough for the whole job, so the next job fits in a single block.
+    void Coalesce()
+    {
+        size_t size = RoundUp(highWater);
+        for (Block &b : blocks)
+            ::operator delete(b.data, std::align_val_t(ALIGNMENT));
+        blocks.clear();
+        current = 0;
+
+        char *data = static_cast<char *>(::operator new(size, std::align_val_t(ALIGNMENT)));
+        BlockCounter().fetch_add(1, std::memory_order_relaxed);
+        blocks.push_back(Block{data, size, 0});
+    }
+};
@@ -0,0 +1,480 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ImageProcessor.h"
+#include "Parallel.h"
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+
+// Skew of a scanned page and its correction. Text lines are found with a
+// Hough accumulator over the lower edges of dark strokes: every edge pixel
+// votes for rho = y cos(a) + x sin(a) at each candidate angle a, and the angle
+// whose rho histogram is most peaked (largest sum of squared bins) is the
+// angle of the lines. Angles are in degrees, positive when the lines rise
+// to the right.
+class SkewCorrection
+{
+public:
+    template <typename T>
+    static double EstimateSkew(const ImageProcessor::ImageT<T> &img, double maxAngle = 15.0)
+    {
+        if (img.width < 2 || img.height <= EDGE_ROW_STEP || img.channels != 4)
+            return 0.0;
+
+        T threshold;
+        if (!ForegroundThreshold(img, threshold))
+            return 0.0;
+
+        std::vector<Point> points;
+        CollectEdges(img, threshold, points);
+        if (points.size() < MIN_POINTS)
+            return 0.0;
+        Thin(points, MAX_POINTS);
+
+        // The coarse pass only has to land within one step of the peak, and
+        // a quarter of the votes is enough for that.
+        std::vector<Point> coarse = points;
+        Thin(coarse, MAX_POINTS / 4);
+        double best = BestAngle(coarse, img.width, img.height, -maxAngle, maxAngle, COARSE_STEP);
+        return BestAngle(points, img.width, img.height, best - COARSE_STEP, best + COARSE_STEP, FINE_STEP);
+    }
+
+    // Bilinear rotation about the centre by `angle` degrees counterclockwise;
+    // the size is kept and uncovered corners are filled with white.
+    template <typename T>
+    static void Rotate(const ImageProcessor::ImageT<T> &src, ImageProcessor::ImageT<T> &dst, double angle)
+    {
+        dst.width = src.width;
+        dst.height = src.height;
+        dst.channels = src.channels;
+        dst.data.resize(src.data.size());
+        if (src.data.empty() || src.channels != 4)
+            return;
+
+        const double rad = angle * PI / 180.0;
+        const float c = (float)std::cos(rad);
+        const float s = (float)std::sin(rad);
+        const float cx = (src.width - 1) * 0.5f;
+        const float cy = (src.height - 1) * 0.5f;
+
+        // A whole output row runs diagonally across many source rows; a strip
+        // of TILE_WIDTH columns touches only a few, and they stay in cache from
+        // one output row to the next.
+        Parallel::For(0, src.height, [&](int y0, int y1, int)
+                      {
+                          for (int x0 = 0; x0 < src.width; x0 += TILE_WIDTH)
+                          {
+                              const int x1 = std::min(src.width, x0 + TILE_WIDTH);
+                              for (int y = y0; y < y1; ++y)
+                              {
+                                  const float dy = y - cy;
+                                  T *out = dst.data.data() + (size_t)y * src.width * 4;
+                                  if constexpr (std::is_same<T, unsigned char>::value)
+                                      RotateSpan8(src, out, x0, x1, cx - cx * c - dy * s, cy - cx * s + dy * c, c, s);
+                                  else
+                                      RotateSpan(src, out, x0, x1, cx - cx * c - dy * s, cy - cx * s + dy * c, c, s);
+                              }
+                          }
+                      },
+                      MIN_ROWS_PER_WORKER);
+    }
+
+    // Returns the detected skew; dst is src rotated back by it.
+    template <typename T>
+    static double Deskew(const ImageProcessor::ImageT<T> &src, ImageProcessor::ImageT<T> &dst, double maxAngle = 15.0)
+    {
+        double angle = EstimateSkew(src, maxAngle);
+        if (std::fabs(angle) < FINE_STEP)
+            dst = src;
+        else
+            Rotate(src, dst, -angle);
+        return angle;
+    }
+
+private:
+    static constexpr double PI = 3.14159265358979323846;
+    static constexpr double COARSE_STEP = 0.5;
+    static constexpr double FINE_STEP = 0.05;
+    static constexpr int HISTOGRAM_BINS = ImageProcessor::HISTOGRAM_BINS;
+    static constexpr int HISTOGRAM_ROW_STEP = 8;
+    static constexpr int EDGE_ROW_STEP = 2;
+    static constexpr int MIN_ROWS_PER_WORKER = 64;
+    static constexpr int TILE_WIDTH = 64;
+    static constexpr int MIN_POINTS_PER_WORKER = 4096;
+    static constexpr size_t MIN_POINTS = 32;
+    // More votes than this only refine an already sharp peak.
+    static constexpr size_t MAX_POINTS = 16384;
+    // Foreground needs this much spread between the dark and light ends of
+    // the histogram (in 8-bit levels), otherwise the page is treated as blank.
+    static constexpr int MIN_CONTRAST = 24;
+
+    struct Point
+    {
+        int x;
+        int y;
+    };
+
+    template <typename T>
+    static void LumaRow(const ImageProcessor::ImageT<T> &img, int y, T *out)
+    {
+        if constexpr (std::is_same<T, unsigned char>::value)
+        {
+            PixelKernels::Get().luma.fn(img.data.data() + (size_t)y * img.width * 4, out, img.width);
+        }
+        else
+        {
+            for (int x = 0; x < img.width; ++x)
+                out[x] = ImageProcessor::GetLum(img, x, y);
+        }
+    }
+
+    // 1 where the pixel is darker than the threshold, 0 elsewhere.
+    template <typename T>
+    static void DarkRow(const ImageProcessor::ImageT<T> &img, int y, T threshold, T *lum, uint8_t *dark)
+    {
+        if constexpr (std::is_same<T, unsigned char>::value)
+        {
+            (void)lum;
+            PixelKernels::Get().mask.fn(img.data.data() + (size_t)y * img.width * 4, dark, img.width, threshold);
+        }
+        else
+        {
+            LumaRow(img, y, lum);
+            for (int x = 0; x < img.width; ++x)
+                dark[x] = lum[x] < threshold ? 1 : 0;
+        }
+    }
+
+    // Midpoint between the 5th and 95th luminance percentiles, taken over
+    // every HISTOGRAM_ROW_STEP-th row.
+    template <typename T>
+    static bool ForegroundThreshold(const ImageProcessor::ImageT<T> &img, T &threshold)
+    {
+        using Histogram = std::array<long long, HISTOGRAM_BINS>;
+        const int rows = (img.height + HISTOGRAM_ROW_STEP - 1) / HISTOGRAM_ROW_STEP;
+        std::vector<Histogram> partial(Parallel::WorkerCount(rows, MIN_ROWS_PER_WORKER));
+        for (Histogram &h : partial)
+            h.fill(0);
+
+        Parallel::For(0, rows, [&](int r0, int r1, int worker)
+                      {
+                          ScratchArena &arena = ScratchArena::ForThread();
+                          ScratchArena::Scope scope(arena);
+                          ScratchBuffer<T> lum = arena.Allocate<T>(img.width);
+                          Histogram &h = partial[worker];
+                          for (int r = r0; r < r1; ++r)
+                          {
+                              LumaRow(img, r * HISTOGRAM_ROW_STEP, lum.data());
+                              for (int x = 0; x < img.width; ++x)
+                                  ++h[ImageProcessor::HistogramBin(lum[x])];
+                          }
+                      },
+                      MIN_ROWS_PER_WORKER);
+
+        Histogram total = {};
+        for (const Histogram &h : partial)
+            for (int i = 0; i < HISTOGRAM_BINS; ++i)
+                total[i] += h[i];
+
+        const long long pixels = (long long)img.width * rows;
+        int lo = 0;
+        int hi = HISTOGRAM_BINS - 1;
+        long long acc = 0;
+        while (lo < HISTOGRAM_BINS - 1 && (acc += total[lo]) < pixels / 20)
+            ++lo;
+        acc = 0;
+        while (hi > 0 && (acc += total[hi]) < pixels / 20)
+            --hi;
+        if (hi - lo < MIN_CONTRAST)
+            return false;
+
+        threshold = PixelTraits<T>::Round((lo + hi) * 0.5 * PixelTraits<T>::Max / (HISTOGRAM_BINS - 1));
+        return true;
+    }
+
+    // Dark pixels with a light pixel EDGE_ROW_STEP rows below: one point per
+    // stroke bottom keeps the lines sharp in the accumulator and the vote
+    // count low, and only every EDGE_ROW_STEP-th row has to be classified.
+    // The rows are compared eight pixels per word; empty words are skipped,
+    // and the points of the others are stored without branching, since inside
+    // text the edges are too irregular to predict.
+    template <typename T>
+    static void CollectEdges(const ImageProcessor::ImageT<T> &img, T threshold, std::vector<Point> &points)
+    {
+        const int rows = (img.height - 1) / EDGE_ROW_STEP;
+        const int minRows = MIN_ROWS_PER_WORKER / EDGE_ROW_STEP;
+        std::vector<std::vector<Point>> partial(Parallel::WorkerCount(rows, minRows));
+
+        Parallel::For(0, rows, [&](int r0, int r1, int worker)
+                      {
+                          ScratchArena &arena = ScratchArena::ForThread();
+                          ScratchArena::Scope scope(arena);
+                          ScratchBuffer<T> lum = arena.Allocate<T>(img.width);
+                          ScratchBuffer<uint8_t> row = arena.Allocate<uint8_t>(img.width + 8, 0);
+                          ScratchBuffer<uint8_t> below = arena.Allocate<uint8_t>(img.width + 8, 0);
+                          std::vector<Point> &out = partial[worker];
+                          size_t count = 0;
+
+                          DarkRow(img, r0 * EDGE_ROW_STEP, threshold, lum.data(), row.data());
+                          for (int r = r0; r < r1; ++r)
+                          {
+                              const int y = r * EDGE_ROW_STEP;
+                              DarkRow(img, y + EDGE_ROW_STEP, threshold, lum.data(), below.data());
+                              // The padding after the row is zero, so the last
+                              // word has no edges past the width.
+                              for (int x = 0; x < img.width; x += 8)
+                              {
+                                  uint64_t a, b;
+                                  std::memcpy(&a, row.data() + x, 8);
+                                  std::memcpy(&b, below.data() + x, 8);
+                                  uint64_t edges = a & ~b;
+                                  if (edges == 0)
+                                      continue;
+                                  if (count + 8 > out.size())
+                                      out.resize(std::max<size_t>(out.size() * 2, 4096));
+                                  for (int i = 0; i < 8; ++i)
+                                  {
+                                      out[count] = {x + i, y};
+                                      count += (edges >> (8 * i)) & 1;
+                                  }
+                              }
+                              std::swap(row, below);
+                          }
+                          out.resize(count);
+                      },
+                      minRows);
+
+        size_t count = 0;
+        for (const std::vector<Point> &p : partial)
+            count += p.size();
+        points.reserve(count);
+        for (const std::vector<Point> &p : partial)
+            points.insert(points.end(), p.begin(), p.end());
+    }
+
+    // Keeps an evenly spread subset of at most `limit` points.
+    static void Thin(std::vector<Point> &points, size_t limit)
+    {
+        if (points.size() <= limit)
+            return;
+        const size_t step = (points.size() + limit - 1) / limit;
+        size_t kept = 0;
+        for (size_t i = 0; i < points.size(); i += step)
+            points[kept++] = points[i];
+        points.resize(kept);
+    }
+
+    // Each worker fills its own accumulator over a share of the points; the
+    // accumulators are summed before scoring.
+    static double BestAngle(const std::vector<Point> &points, int width, int height, double from, double to, double step)
+    {
+        const int angles = (int)std::floor((to - from) / step + 0.5) + 1;
+        const double reach = std::max(std::fabs(from), std::fabs(to)) * PI / 180.0;
+        const int offset = (int)std::ceil(width * std::sin(std::min(reach, PI / 2))) + 1;
+        const int bins = height + 2 * offset + 1;
+
+        std::vector<float> cosA(angles);
+        std::vector<float> sinA(angles);
+        for (int a = 0; a < angles; ++a)
+        {
+            double rad = (from + a * step) * PI / 180.0;
+            cosA[a] = (float)std::cos(rad);
+            sinA[a] = (float)std::sin(rad);
+        }
+
+        const int count = (int)points.size();
+        std::vector<std::vector<int32_t>> partial(Parallel::WorkerCount(count, MIN_POINTS_PER_WORKER));
+
+        Parallel::For(0, count, [&](int p0, int p1, int worker)
+                      {
+                          std::vector<int32_t> &acc = partial[worker];
+                          acc.assign((size_t)angles * bins, 0);
+                          for (int a = 0; a < angles; ++a)
+                          {
+                              int32_t *line = acc.data() + (size_t)a * bins;
+                              const float c = cosA[a];
+                              const float s = sinA[a];
+                              for (int i = p0; i < p1; ++i)
+                              {
+                                  float rho = points[i].y * c + points[i].x * s + offset + 0.5f;
+                                  ++line[(int)rho];
+                              }
+                          }
+                      },
+                      MIN_POINTS_PER_WORKER);
+
+        std::vector<int32_t> &total = partial[0];
+        for (size_t w = 1; w < partial.size(); ++w)
+            for (size_t i = 0; i < total.size(); ++i)
+                total[i] += partial[w][i];
+
+        int best = 0;
+        double bestScore = -1.0;
+        for (int a = 0; a < angles; ++a)
+        {
+            const int32_t *line = total.data() + (size_t)a * bins;
+            double score = 0.0;
+            for (int i = 0; i < bins; ++i)
+                score += (double)line[i] * line[i];
+            // Ties go to the angle closest to zero.
+            if (score > bestScore || (score == bestScore && std::fabs(from + a * step) < std::fabs(from + best * step)))
+            {
+                bestScore = score;
+                best = a;
+            }
+        }
+        return from + best * step;
+    }
+
+    // Output pixels [x0, x1) of a row whose pixel x is read from
+    // (startX + x * c, startY + x * s).
+    template <typename T>
+    static void RotateSpan(const ImageProcessor::ImageT<T> &src, T *out, int x0, int x1,
+                           float startX, float startY, float c, float s)
+    {
+        const float maxX = (float)(src.width - 1);
+        const float maxY = (float)(src.height - 1);
+        for (int x = x0; x < x1; ++x)
+        {
+            const float sx = startX + x * c;
+            const float sy = startY + x * s;
+            T *p = out + (size_t)x * 4;
+            if (sx < 0.0f || sy < 0.0f || sx > maxX || sy > maxY)
+            {
+                p[0] = p[1] = p[2] = p[3] = PixelTraits<T>::Max;
+                continue;
+            }
+            Sample(src, sx, sy, p);
+        }
+    }
+
+    // 8-bit rows step through the source in 16.16 fixed point. The covered
+    // part of the span is found first; inside it, where both neighbours of a
+    // sample exist, the pixels go to the dispatched bilinear kernel, and only
+    // the samples on the last row or column take the guarded loop.
+    static void RotateSpan8(const ImageProcessor::Image &src, unsigned char *out, int x0, int x1,
+                            float startX, float startY, float c, float s)
+    {
+        const int64_t one = 1 << 16;
+        const int64_t maxX = (int64_t)(src.width - 1) * one;
+        const int64_t maxY = (int64_t)(src.height - 1) * one;
+        const int64_t stepX = (int64_t)std::llround(c * one);
+        const int64_t stepY = (int64_t)std::llround(s * one);
+        const int64_t baseX = (int64_t)std::llround(startX * one);
+        const int64_t baseY = (int64_t)std::llround(startY * one);
+
+        int begin = x0;
+        int end = x1;
+        ClipSpan(baseX, stepX, maxX, begin, end);
+        ClipSpan(baseY, stepY, maxY, begin, end);
+
+        int inner = begin;
+        int innerEnd = end;
+        ClipSpan(baseX, stepX, maxX - 1, inner, innerEnd);
+        ClipSpan(baseY, stepY, maxY - 1, inner, innerEnd);
+        if (inner == innerEnd)
+            inner = innerEnd = end;
+
+        uint32_t *row = reinterpret_cast<uint32_t *>(out);
+        std::fill(row + x0, row + begin, 0xFFFFFFFFu);
+        std::fill(row + end, row + x1, 0xFFFFFFFFu);
+
+        EdgeSpan(src, row, begin, inner, baseX, baseY, stepX, stepY);
+        if (inner < innerEnd)
+            PixelKernels::Get().bilinear.fn(src.data.data(), (size_t)src.width * 4, out + (size_t)inner * 4,
+                                            (size_t)(innerEnd - inner), baseX + stepX * inner, baseY + stepY * inner,
+                                            stepX, stepY);
+        EdgeSpan(src, row, innerEnd, end, baseX, baseY, stepX, stepY);
+    }
+
+    static void EdgeSpan(const ImageProcessor::Image &src, uint32_t *row, int begin, int end,
+                         int64_t baseX, int64_t baseY, int64_t stepX, int64_t stepY)
+    {
+        const uint32_t *pixels = reinterpret_cast<const uint32_t *>(src.data.data());
+        for (int x = begin; x < end; ++x)
+        {
+            const int64_t sx = baseX + stepX * x;
+            const int64_t sy = baseY + stepY * x;
+            const int x0 = (int)(sx >> 16);
+            const int y0 = (int)(sy >> 16);
+            const int dx = x0 + 1 < src.width ? 1 : 0;
+            const size_t dy = y0 + 1 < src.height ? (size_t)src.width : 0;
+            const uint32_t fx = (uint32_t)(sx >> 8) & 255;
+            const uint32_t fy = (uint32_t)(sy >> 8) & 255;
+
+            const uint32_t *p = pixels + (size_t)y0 * src.width + x0;
+            row[x] = Blend(Blend(p[0], p[dy], fy), Blend(p[dx], p[dy + dx], fy), fx);
+        }
+    }
+
+    // Narrows [begin, end) to the x where base + step * x lies in [0, limit].
+    static void ClipSpan(int64_t base, int64_t step, int64_t limit, int &begin, int &end)
+    {
+        if (step == 0)
+        {
+            if (base < 0 || base > limit)
+                begin = end;
+            return;
+        }
+
+        int64_t lo = step > 0 ? CeilDiv(-base, step) : CeilDiv(limit - base, step);
+        int64_t hi = step > 0 ? FloorDiv(limit - base, step) : FloorDiv(-base, step);
+        const int64_t from = std::max<int64_t>(begin, lo);
+        const int64_t to = std::min<int64_t>(end, hi + 1);
+        if (from >= to)
+            begin = end;
+        else
+        {
+            begin = (int)from;
+            end = (int)to;
+        }
+    }
+
+    static int64_t FloorDiv(int64_t a, int64_t b)
+    {
+        int64_t q = a / b;
+        return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+    }
+
+    static int64_t CeilDiv(int64_t a, int64_t b)
+    {
+        return -FloorDiv(-a, b);
+    }
+
+    // a + (b - a) * w / 256 on all four channels at once.
+    static uint32_t Blend(uint32_t a, uint32_t b, uint32_t w)
+    {
+        const uint32_t iw = 256 - w;
+        uint32_t rb = ((a & 0x00FF00FFu) * iw + (b & 0x00FF00FFu) * w + 0x00800080u) >> 8;
+        uint32_t ga = (((a >> 8) & 0x00FF00FFu) * iw + ((b >> 8) & 0x00FF00FFu) * w + 0x00800080u) >> 8;
+        return (rb & 0x00FF00FFu) | ((ga & 0x00FF00FFu) << 8);
+    }
+
+    template <typename T>
+    static void Sample(const ImageProcessor::ImageT<T> &src, float sx, float sy, T *out)
+    {
+        const int x0 = (int)sx;
+        const int y0 = (int)sy;
+        const int x1 = std::min(x0 + 1, src.width - 1);
+        const int y1 = std::min(y0 + 1, src.height - 1);
+        const float fx = sx - x0;
+        const float fy = sy - y0;
+
+        const T *p00 = src.data.data() + ((size_t)y0 * src.width + x0) * 4;
+        const T *p01 = src.data.data() + ((size_t)y0 * src.width + x1) * 4;
+        const T *p10 = src.data.data() + ((size_t)y1 * src.width + x0) * 4;
+        const T *p11 = src.data.data() + ((size_t)y1 * src.width + x1) * 4;
+        for (int c = 0; c < 4; ++c)
+        {
+            float top = p00[c] + (p01[c] - (float)p00[c]) * fx;
+            float bottom = p10[c] + (p11[c] - (float)p10[c]) * fx;
+            out[c] = PixelTraits<T>::Round(top + (bottom - top) * fy);
+        }
+    }
+};
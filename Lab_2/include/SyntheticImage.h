@@ -0,0 +1,368 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include "ImageProcessor.h"
+#include "Parallel.h"
+#include "PixelKernels.h"
+#include "ScratchArena.h"
+
+// Reproducible test pages of any size: text lines, a brightness gradient, a
+// soft shadow, a checkerboard, Gaussian and salt-and-pepper noise. Every row
+// draws from its own generator seeded by (seed, row), so the result depends
+// only on the parameters and not on the number of threads, and a file can be
+// written band by band without holding the whole image.
+class SyntheticImage
+{
+public:
+    enum class Preset
+    {
+        Noise,
+        Shadow,
+        Faint,
+        Text
+    };
+
+    // Levels are in 0-255 whatever the output pixel type.
+    struct Params
+    {
+        int width = 1024;
+        int height = 1024;
+        uint64_t seed = 1;
+
+        float paper = 235.0f;
+        float ink = 30.0f;
+        // Paper gets this much darker from the top-left to the bottom-right corner.
+        float gradient = 0.0f;
+        // Darkening at the centre of the shadow (0-1) and its radius as a
+        // fraction of the page diagonal.
+        float shadow = 0.0f;
+        float shadowRadius = 0.4f;
+        // Checkerboard of paper and ink cells under the text, 0 for none.
+        int checker = 0;
+
+        bool text = true;
+        int lineHeight = 18;
+        int linePitch = 36;
+
+        // Standard deviation in levels and the fraction of impulse pixels.
+        float gaussian = 0.0f;
+        float saltPepper = 0.0f;
+    };
+
+    // Counterparts of the three sample photos and a clean page.
+    static Params MakePreset(Preset preset, int width, int height, uint64_t seed = 1)
+    {
+        Params p;
+        p.width = width;
+        p.height = height;
+        p.seed = seed;
+        switch (preset)
+        {
+        case Preset::Noise:
+            p.text = false;
+            p.paper = 200.0f;
+            p.ink = 60.0f;
+            p.checker = 16;
+            p.gaussian = 9.0f;
+            p.saltPepper = 0.05f;
+            break;
+        case Preset::Shadow:
+            p.gradient = 40.0f;
+            p.shadow = 0.7f;
+            p.gaussian = 3.0f;
+            break;
+        case Preset::Faint:
+            p.paper = 205.0f;
+            p.ink = 175.0f;
+            p.gaussian = 4.0f;
+            break;
+        case Preset::Text:
+            break;
+        }
+        return p;
+    }
+
+    static const char *PresetName(Preset preset)
+    {
+        switch (preset)
+        {
+        case Preset::Noise:
+            return "noise";
+        case Preset::Shadow:
+            return "shadow";
+        case Preset::Faint:
+            return "faint";
+        case Preset::Text:
+            return "text";
+        }
+        return "";
+    }
+
+    static bool ParsePreset(const char *name, Preset &preset)
+    {
+        const Preset all[] = {Preset::Noise, Preset::Shadow, Preset::Faint, Preset::Text};
+        for (Preset p : all)
+        {
+            if (std::strcmp(name, PresetName(p)) == 0)
+            {
+                preset = p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Gray RGBA image with opaque alpha, rows filled in parallel.
+    template <typename T>
+    static void Generate(const Params &p, ImageProcessor::ImageT<T> &img)
+    {
+        img.width = std::max(0, p.width);
+        img.height = std::max(0, p.height);
+        img.channels = 4;
+        img.data.resize((size_t)img.width * img.height * 4);
+        if (img.data.empty())
+            return;
+
+        const Layout layout = MakeLayout(p);
+        Parallel::For(0, img.height, [&](int y0, int y1, int)
+                      {
+                          ScratchArena &arena = ScratchArena::ForThread();
+                          ScratchArena::Scope scope(arena);
+                          ScratchBuffer<T> gray = arena.Allocate<T>(img.width);
+                          ScratchBuffer<uint8_t> cover = arena.Allocate<uint8_t>(img.width);
+
+                          for (int y = y0; y < y1; ++y)
+                          {
+                              RenderRow(p, layout, y, gray.data(), cover.data());
+                              T *out = img.data.data() + (size_t)y * img.width * 4;
+                              if constexpr (std::is_same<T, unsigned char>::value)
+                              {
+                                  PixelKernels::Get().expand.fn(gray.data(), out, img.width);
+                              }
+                              else
+                              {
+                                  for (int x = 0; x < img.width; ++x)
+                                  {
+                                      out[x * 4 + 0] = out[x * 4 + 1] = out[x * 4 + 2] = gray[x];
+                                      out[x * 4 + 3] = PixelTraits<T>::Max;
+                                  }
+                              }
+                          }
+                      },
+                      ROW_CHUNK);
+    }
+
+    static ImageProcessor::Image Generate(const Params &p)
+    {
+        ImageProcessor::Image img;
+        Generate(p, img);
+        return img;
+    }
+
+    // Writes a binary P5 graymap (maxval 255, or 65535 when `wide`). Bands of
+    // rows are rendered in parallel into one scratch buffer and written out,
+    // so pages far larger than memory can be produced.
+    static bool Save(const char *filename, const Params &p, bool wide = false)
+    {
+        if (p.width <= 0 || p.height <= 0)
+            return false;
+
+        FILE *file = std::fopen(filename, "wb");
+        if (!file)
+            return false;
+        std::fprintf(file, "P5\n%d %d\n%d\n", p.width, p.height, wide ? 65535 : 255);
+
+        const Layout layout = MakeLayout(p);
+        const size_t rowBytes = (size_t)p.width * (wide ? 2 : 1);
+        const int bandRows = (int)std::max<size_t>(ROW_CHUNK, BAND_BYTES / rowBytes);
+
+        ScratchArena &arena = ScratchArena::ForThread();
+        ScratchArena::Scope scope(arena);
+        ScratchBuffer<uint8_t> band = arena.Allocate<uint8_t>(rowBytes * std::min(bandRows, p.height));
+
+        bool written = true;
+        for (int top = 0; top < p.height && written; top += bandRows)
+        {
+            const int rows = std::min(bandRows, p.height - top);
+            Parallel::For(0, rows, [&](int r0, int r1, int)
+                          {
+                              ScratchArena &local = ScratchArena::ForThread();
+                              ScratchArena::Scope localScope(local);
+                              ScratchBuffer<unsigned short> gray16 = local.Allocate<unsigned short>(p.width);
+                              ScratchBuffer<uint8_t> cover = local.Allocate<uint8_t>(p.width);
+
+                              for (int r = r0; r < r1; ++r)
+                              {
+                                  uint8_t *out = band.data() + (size_t)r * rowBytes;
+                                  if (!wide)
+                                  {
+                                      RenderRow(p, layout, top + r, out, cover.data());
+                                      continue;
+                                  }
+                                  RenderRow(p, layout, top + r, gray16.data(), cover.data());
+                                  for (int x = 0; x < p.width; ++x)
+                                  {
+                                      out[2 * x] = (uint8_t)(gray16[x] >> 8);
+                                      out[2 * x + 1] = (uint8_t)gray16[x];
+                                  }
+                              }
+                          },
+                          ROW_CHUNK);
+            written = std::fwrite(band.data(), rowBytes * rows, 1, file) == 1;
+        }
+
+        return std::fclose(file) == 0 && written;
+    }
+
+    // SplitMix64: one add and three multiply-xorshift steps per value, and any
+    // seed, including 0, gives a full-period stream.
+    struct Random
+    {
+        uint64_t state;
+
+        explicit Random(uint64_t seed) : state(seed) {}
+
+        uint64_t Next()
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // Uniform in [0, 1).
+        float Uniform() { return (float)(Next() >> 40) * (1.0f / 16777216.0f); }
+
+        int Range(int lo, int hi) { return lo + (int)((Next() >> 33) % (uint64_t)(hi - lo + 1)); }
+    };
+
+    // Independent streams for rows, text lines and the page layout.
+    static Random Stream(uint64_t seed, uint64_t stream, uint64_t index)
+    {
+        Random mix(seed ^ (stream << 56));
+        mix.state ^= index * 0xD1B54A32D192ED03ull;
+        return Random(mix.Next());
+    }
+
+private:
+    static constexpr int ROW_CHUNK = 16;
+    static constexpr size_t BAND_BYTES = 8u << 20;
+
+    static constexpr uint64_t STREAM_NOISE = 1;
+    static constexpr uint64_t STREAM_LINE = 2;
+    static constexpr uint64_t STREAM_PAGE = 3;
+
+    // Glyphs are 3x5 cells, scaled to the line height.
+    static constexpr int GLYPH_COLUMNS = 3;
+    static constexpr int GLYPH_ROWS = 5;
+
+    struct Layout
+    {
+        int marginX = 0;
+        int marginY = 0;
+        int glyphWidth = 0;
+        float shadowX = 0.0f;
+        float shadowY = 0.0f;
+        float shadowScale = 0.0f;
+    };
+
+    static Layout MakeLayout(const Params &p)
+    {
+        Layout layout;
+        layout.marginX = p.width / 20;
+        layout.marginY = p.height / 20;
+        layout.glyphWidth = std::max(GLYPH_COLUMNS, p.lineHeight * 3 / 5);
+
+        Random page = Stream(p.seed, STREAM_PAGE, 0);
+        layout.shadowX = (0.2f + 0.6f * page.Uniform()) * p.width;
+        layout.shadowY = (0.2f + 0.6f * page.Uniform()) * p.height;
+        const float radius = p.shadowRadius * std::sqrt((float)p.width * p.width + (float)p.height * p.height);
+        layout.shadowScale = radius > 0.0f ? 1.0f / (radius * radius) : 0.0f;
+        return layout;
+    }
+
+    // Marks the ink columns of row y. A line's words and glyph shapes come
+    // from that line's own stream, so each row of the line lays it out again.
+    static void TextCoverage(const Params &p, const Layout &layout, int y, uint8_t *cover)
+    {
+        std::memset(cover, 0, (size_t)p.width);
+        if (!p.text || p.lineHeight < GLYPH_ROWS || p.linePitch <= 0 || y < layout.marginY)
+            return;
+
+        const int line = (y - layout.marginY) / p.linePitch;
+        const int top = layout.marginY + line * p.linePitch;
+        if (y >= top + p.lineHeight || top + p.lineHeight > p.height - layout.marginY)
+            return;
+
+        const int glyphRow = (y - top) * GLYPH_ROWS / p.lineHeight;
+        const int right = p.width - layout.marginX;
+        const int gap = std::max(1, p.lineHeight / 6);
+        const int gw = layout.glyphWidth;
+
+        Random rng = Stream(p.seed, STREAM_LINE, (uint64_t)line);
+        for (int x = layout.marginX; x < right;)
+        {
+            const int letters = rng.Range(1, 8);
+            for (int i = 0; i < letters && x + gw <= right; ++i)
+            {
+                // 15 bits of shape; the middle column is always inked so no
+                // glyph is blank.
+                const uint32_t shape = (uint32_t)rng.Next() | 0x2492u;
+                const uint32_t bits = (shape >> (glyphRow * GLYPH_COLUMNS)) & 7u;
+                for (int c = 0; c < GLYPH_COLUMNS; ++c)
+                    if (bits & (1u << c))
+                        std::memset(cover + x + c * gw / GLYPH_COLUMNS, 1, (size_t)((c + 1) * gw / GLYPH_COLUMNS - c * gw / GLYPH_COLUMNS));
+                x += gw + gap;
+            }
+            x += p.lineHeight / 2 + rng.Range(0, p.lineHeight / 2);
+        }
+    }
+
+    template <typename T>
+    static void RenderRow(const Params &p, const Layout &layout, int y, T *out, uint8_t *cover)
+    {
+        TextCoverage(p, layout, y, cover);
+
+        const float scale = (float)PixelTraits<T>::Max / 255.0f;
+        const float slope = p.gradient / std::max(1, p.width + p.height);
+        const float dy = ((float)y - layout.shadowY) * layout.shadowScale * ((float)y - layout.shadowY);
+        const bool noisy = p.gaussian > 0.0f || p.saltPepper > 0.0f;
+        const uint64_t impulse = (uint64_t)(std::min(1.0f, std::max(0.0f, p.saltPepper)) * 65536.0f);
+        // Four 12-bit uniforms summed have mean 8190 and deviation 4096 / sqrt(3).
+        const float gaussScale = p.gaussian * 1.7320508f / 4096.0f;
+
+        Random rng = Stream(p.seed, STREAM_NOISE, (uint64_t)y);
+        for (int x = 0; x < p.width; ++x)
+        {
+            bool dark = cover[x] != 0;
+            if (p.checker > 0)
+                dark = dark != ((((x / p.checker) + (y / p.checker)) & 1) == 0);
+
+            float v = dark ? p.ink : p.paper - slope * (float)(x + y);
+            if (p.shadow > 0.0f)
+            {
+                const float dx = (float)x - layout.shadowX;
+                const float d = std::max(0.0f, 1.0f - dx * dx * layout.shadowScale - dy);
+                v *= 1.0f - p.shadow * d * d;
+            }
+
+            if (noisy)
+            {
+                const uint64_t r = rng.Next();
+                const float sum = (float)((r & 0xFFF) + ((r >> 12) & 0xFFF) + ((r >> 24) & 0xFFF) + ((r >> 36) & 0xFFF));
+                v += (sum - 8190.0f) * gaussScale;
+                const uint64_t u = r >> 48;
+                if (u < impulse)
+                    v = (u & 1) ? 255.0f : 0.0f;
+            }
+
+            out[x] = PixelTraits<T>::Round(std::min(255.0f, std::max(0.0f, v)) * scale);
+        }
+    }
+};
@@ -0,0 +1,545 @@
+#pragma once
+
+#include "imgui.h"
+#include <GL/gl.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+#include "ImageProcessor.h"
+
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+// GPU-resident tiles shared by all views. Tiles are evicted in LRU order once
+// the memory budget is exceeded, and the time spent filling new tiles is
+// limited per frame so that large images never stall the UI.
+class TileCache
+{
+public:
+    struct Key
+    {
+        const void *owner;
+        int level;
+        int tx;
+        int ty;
+
+        bool operator==(const Key &other) const
+        {
+            return owner == other.owner && level == other.level && tx == other.tx && ty == other.ty;
+        }
+    };
+
+    explicit TileCache(size_t budgetBytes = DEFAULT_BUDGET) : budget(budgetBytes) {}
+
+    ~TileCache()
+    {
+        for (auto &entry : entries)
+            glDeleteTextures(1, &entry.second.tex);
+    }
+
+    TileCache(const TileCache &) = delete;
+    TileCache &operator=(const TileCache &) = delete;
+
+    void BeginFrame()
+    {
+        ++frame;
+        frameStart = std::chrono::steady_clock::now();
+        filledThisFrame = false;
+    }
+
+    bool CanFill() const
+    {
+        if (!filledThisFrame)
+            return true;
+        std::chrono::duration<double, std::milli> spent = std::chrono::steady_clock::now() - frameStart;
+        return spent.count() < FILL_BUDGET_MS;
+    }
+
+    GLuint Find(const Key &key)
+    {
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return 0;
+        Touch(it->second);
+        return it->second.tex;
+    }
+
+    // The tile's 2x reduction, kept on the CPU so that the next coarser level
+    // is assembled without reading textures back. Marks the tile as used.
+    const ImageProcessor::Image *FindReduced(const Key &key)
+    {
+        auto it = entries.find(key);
+        if (it == entries.end() || it->second.reduced.data.empty())
+            return nullptr;
+        Touch(it->second);
+        return &it->second.reduced;
+    }
+
+    GLuint Insert(const Key &key, const ImageProcessor::Image &tile, ImageProcessor::Image reduced = {})
+    {
+        size_t bytes = (size_t)tile.width * tile.height * 4 + reduced.data.size();
+        EvictFor(bytes);
+
+        GLuint tex;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tile.width, tile.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, tile.data.data());
+
+        lru.push_front(key);
+        entries[key] = {tex, bytes, frame, lru.begin(), std::move(reduced)};
+        resident += bytes;
+        filledThisFrame = true;
+        return tex;
+    }
+
+    void Remove(const void *owner)
+    {
+        RemoveIf(owner, [](const Key &) { return true; });
+    }
+
+    void RemoveIf(const void *owner, const std::function<bool(const Key &)> &predicate)
+    {
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (it->first.owner == owner && predicate(it->first))
+            {
+                glDeleteTextures(1, &it->second.tex);
+                resident -= it->second.bytes;
+                lru.erase(it->second.lruPos);
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    size_t ResidentBytes() const { return resident; }
+    size_t Budget() const { return budget; }
+    void SetBudget(size_t bytes) { budget = bytes; }
+
+    static int MaxTextureSize()
+    {
+        static GLint maxSize = 0;
+        if (maxSize == 0)
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        return maxSize > 0 ? maxSize : 1024;
+    }
+
+private:
+    static constexpr size_t DEFAULT_BUDGET = 256u << 20;
+    static constexpr double FILL_BUDGET_MS = 8.0;
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const
+        {
+            size_t h = std::hash<const void *>()(key.owner);
+            h = h * 31 + (size_t)key.level;
+            h = h * 1000003 + (size_t)key.tx;
+            h = h * 1000003 + (size_t)key.ty;
+            return h;
+        }
+    };
+
+    struct Entry
+    {
+        GLuint tex;
+        size_t bytes;
+        long long lastFrame;
+        std::list<Key>::iterator lruPos;
+        ImageProcessor::Image reduced;
+    };
+
+    void Touch(Entry &entry)
+    {
+        lru.splice(lru.begin(), lru, entry.lruPos);
+        entry.lastFrame = frame;
+    }
+
+    void EvictFor(size_t bytes)
+    {
+        while (resident + bytes > budget && !lru.empty())
+        {
+            auto it = entries.find(lru.back());
+            if (it->second.lastFrame == frame)
+                break;
+            glDeleteTextures(1, &it->second.tex);
+            resident -= it->second.bytes;
+            entries.erase(it);
+            lru.pop_back();
+        }
+    }
+
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::list<Key> lru;
+    size_t budget;
+    size_t resident = 0;
+    long long frame = 0;
+    bool filledThisFrame = false;
+    std::chrono::steady_clock::time_point frameStart;
+};
+
+// Zoomable, pannable view of an image that is never uploaded as a whole.
+// Pixels are requested tile by tile, only for tiles that are on screen, from a
+// filler that produces full-resolution RGBA for a rectangle of the image.
+class TiledImageView
+{
+public:
+    using TileFiller = std::function<void(int x, int y, int w, int h, ImageProcessor::Image &tile)>;
+
+    explicit TiledImageView(TileCache &tileCache) : cache(tileCache) {}
+
+    ~TiledImageView()
+    {
+        cache.Remove(this);
+    }
+
+    TiledImageView(const TiledImageView &) = delete;
+    TiledImageView &operator=(const TiledImageView &) = delete;
+
+    void SetSource(int width, int height, TileFiller tileFiller)
+    {
+        bool sameSize = (width == imgWidth && height == imgHeight);
+        cache.Remove(this);
+        imgWidth = width;
+        imgHeight = height;
+        filler = std::move(tileFiller);
+        if (!sameSize)
+        {
+            fitPending = true;
+            ClearSelection();
+        }
+
+        maxLevel = 0;
+        while ((TileSize() << maxLevel) < std::max(imgWidth, imgHeight))
+            maxLevel++;
+    }
+
+    void Reset()
+    {
+        cache.Remove(this);
+        ClearSelection();
+        filler = nullptr;
+        imgWidth = 0;
+        imgHeight = 0;
+    }
+
+    void Invalidate()
+    {
+        cache.Remove(this);
+    }
+
+    void InvalidateRect(int x, int y, int w, int h)
+    {
+        cache.RemoveIf(this, [&](const TileCache::Key &key)
+                       {
+                           int tx, ty, tw, th;
+                           TileRect(key.level, key.tx, key.ty, tx, ty, tw, th);
+                           return tx < x + w && x < tx + tw && ty < y + h && y < ty + th;
+                       });
+    }
+
+    bool HasSource() const
+    {
+        return filler != nullptr && imgWidth > 0 && imgHeight > 0;
+    }
+
+    void EnableSelection(bool enable)
+    {
+        selectionEnabled = enable;
+    }
+
+    bool GetSelection(int &x, int &y, int &w, int &h) const
+    {
+        return hasSelection && GetSelectionRect(x, y, w, h);
+    }
+
+    void ClearSelection()
+    {
+        hasSelection = false;
+        selecting = false;
+    }
+
+    void Render()
+    {
+        ImVec2 canvasPos = ImGui::GetCursorScreenPos();
+        ImVec2 canvasSize = ImGui::GetContentRegionAvail();
+        canvasSize.x = std::max(canvasSize.x, 50.0f);
+        canvasSize.y = std::max(canvasSize.y, 50.0f);
+
+        ImGui::InvisibleButton("##tiled_view", canvasSize, ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+        if (!HasSource())
+            return;
+
+        if (fitPending)
+        {
+            zoom = std::min(canvasSize.x / imgWidth, canvasSize.y / imgHeight);
+            originX = 0.0f;
+            originY = 0.0f;
+            fitPending = false;
+        }
+
+        HandleInput(canvasPos);
+
+        ImDrawList *drawList = ImGui::GetWindowDrawList();
+        ImVec2 canvasEnd = ImVec2(canvasPos.x + canvasSize.x, canvasPos.y + canvasSize.y);
+        drawList->PushClipRect(canvasPos, canvasEnd, true);
+
+        int level = 0;
+        while (level < maxLevel && zoom * (float)(2 << level) <= 1.0f)
+            level++;
+
+        int levelTile = TileSize() << level;
+        float visX0 = std::max(0.0f, originX);
+        float visY0 = std::max(0.0f, originY);
+        float visX1 = std::min((float)imgWidth, originX + canvasSize.x / zoom);
+        float visY1 = std::min((float)imgHeight, originY + canvasSize.y / zoom);
+
+        if (visX1 > visX0 && visY1 > visY0)
+        {
+            int tx0 = (int)visX0 / levelTile;
+            int ty0 = (int)visY0 / levelTile;
+            int tx1 = ((int)std::ceil(visX1) - 1) / levelTile;
+            int ty1 = ((int)std::ceil(visY1) - 1) / levelTile;
+
+            for (int ty = ty0; ty <= ty1; ++ty)
+                for (int tx = tx0; tx <= tx1; ++tx)
+                    DrawTile(drawList, canvasPos, level, tx, ty);
+        }
+
+        int sx, sy, sw, sh;
+        if ((hasSelection || selecting) && GetSelectionRect(sx, sy, sw, sh))
+        {
+            ImVec2 p0 = ToScreen(canvasPos, (float)sx, (float)sy);
+            ImVec2 p1 = ToScreen(canvasPos, (float)(sx + sw), (float)(sy + sh));
+            drawList->AddRectFilled(p0, p1, IM_COL32(255, 220, 0, 40));
+            drawList->AddRect(p0, p1, IM_COL32(255, 220, 0, 255), 0.0f, 0, 2.0f);
+        }
+
+        drawList->PopClipRect();
+    }
+
+private:
+    TileCache &cache;
+    TileFiller filler;
+
+    int imgWidth = 0;
+    int imgHeight = 0;
+    int maxLevel = 0;
+
+    float zoom = 1.0f;
+    float originX = 0.0f;
+    float originY = 0.0f;
+    bool fitPending = true;
+
+    bool selectionEnabled = false;
+    bool selecting = false;
+    bool hasSelection = false;
+    int selStartX = 0;
+    int selStartY = 0;
+    int selEndX = 0;
+    int selEndY = 0;
+
+    static int TileSize()
+    {
+        return std::min(256, TileCache::MaxTextureSize());
+    }
+
+    void HandleInput(const ImVec2 &canvasPos)
+    {
+        ImGuiIO &io = ImGui::GetIO();
+
+        if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left))
+        {
+            originX -= io.MouseDelta.x / zoom;
+            originY -= io.MouseDelta.y / zoom;
+        }
+
+        if (selectionEnabled)
+            HandleSelection(canvasPos);
+
+        if (!ImGui::IsItemHovered())
+            return;
+
+        if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+        {
+            fitPending = true;
+            return;
+        }
+
+        if (io.MouseWheel != 0.0f)
+        {
+            float mx = io.MousePos.x - canvasPos.x;
+            float my = io.MousePos.y - canvasPos.y;
+            float imgX = originX + mx / zoom;
+            float imgY = originY + my / zoom;
+
+            zoom *= std::pow(1.2f, io.MouseWheel);
+            zoom = std::max(1.0f / (float)(TileSize() << maxLevel), std::min(zoom, 32.0f));
+
+            originX = imgX - mx / zoom;
+            originY = imgY - my / zoom;
+        }
+    }
+
+    void HandleSelection(const ImVec2 &canvasPos)
+    {
+        ImGuiIO &io = ImGui::GetIO();
+        int mx = (int)std::floor(originX + (io.MousePos.x - canvasPos.x) / zoom);
+        int my = (int)std::floor(originY + (io.MousePos.y - canvasPos.y) / zoom);
+        mx = std::max(0, std::min(mx, imgWidth));
+        my = std::max(0, std::min(my, imgHeight));
+
+        if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Right))
+        {
+            selecting = true;
+            hasSelection = false;
+            selStartX = selEndX = mx;
+            selStartY = selEndY = my;
+        }
+
+        if (!selecting)
+            return;
+
+        selEndX = mx;
+        selEndY = my;
+        if (ImGui::IsMouseReleased(ImGuiMouseButton_Right))
+        {
+            selecting = false;
+            int x, y, w, h;
+            hasSelection = GetSelectionRect(x, y, w, h);
+        }
+    }
+
+    bool GetSelectionRect(int &x, int &y, int &w, int &h) const
+    {
+        x = std::min(selStartX, selEndX);
+        y = std::min(selStartY, selEndY);
+        w = std::abs(selEndX - selStartX);
+        h = std::abs(selEndY - selStartY);
+        return w > 0 && h > 0;
+    }
+
+    void TileRect(int level, int tx, int ty, int &x, int &y, int &w, int &h) const
+    {
+        int levelTile = TileSize() << level;
+        x = tx * levelTile;
+        y = ty * levelTile;
+        w = std::min(levelTile, imgWidth - x);
+        h = std::min(levelTile, imgHeight - y);
+    }
+
+    // A level above 0 is assembled from the 2x reductions that its four
+    // children keep in the cache, so the filler is only asked for level-0
+    // tiles. Missing children are filled first, each only while the frame's
+    // fill budget lasts; until all of them are cached the tile is not built
+    // and 0 is returned, and the next frames carry on where this one stopped.
+    GLuint FillTile(int level, int tx, int ty)
+    {
+        int x, y, w, h;
+        TileRect(level, tx, ty, x, y, w, h);
+
+        ImageProcessor::Image tile;
+        if (level == 0)
+        {
+            filler(x, y, w, h, tile);
+        }
+        else
+        {
+            int childTile = TileSize() << (level - 1);
+            bool ready = true;
+            for (int j = 0; j < 2 && j * childTile < h; ++j)
+            {
+                for (int i = 0; i < 2 && i * childTile < w; ++i)
+                {
+                    TileCache::Key child = {this, level - 1, 2 * tx + i, 2 * ty + j};
+                    if (!cache.FindReduced(child) && (!cache.CanFill() || !FillTile(child.level, child.tx, child.ty)))
+                        ready = false;
+                }
+            }
+            if (!ready)
+                return 0;
+
+            int scale = 1 << level;
+            int half = TileSize() / 2;
+            tile.width = (w + scale - 1) / scale;
+            tile.height = (h + scale - 1) / scale;
+            for (int j = 0; j < 2 && j * childTile < h; ++j)
+            {
+                for (int i = 0; i < 2 && i * childTile < w; ++i)
+                {
+                    const ImageProcessor::Image &part = *cache.FindReduced({this, level - 1, 2 * tx + i, 2 * ty + j});
+                    if (tile.data.empty())
+                    {
+                        tile.channels = part.channels;
+                        tile.data.assign((size_t)tile.width * tile.height * tile.channels, 0);
+                    }
+
+                    size_t rowBytes = (size_t)part.width * part.channels;
+                    for (int row = 0; row < part.height; ++row)
+                    {
+                        const unsigned char *src = part.data.data() + (size_t)row * rowBytes;
+                        size_t offset = ((size_t)(j * half + row) * tile.width + (size_t)i * half) * tile.channels;
+                        std::copy(src, src + rowBytes, tile.data.data() + offset);
+                    }
+                }
+            }
+        }
+
+        ImageProcessor::Image reduced;
+        if (level < maxLevel)
+            ImageProcessor::Downsample(tile, 2, reduced);
+        return cache.Insert({this, level, tx, ty}, tile, std::move(reduced));
+    }
+
+    void DrawTile(ImDrawList *drawList, const ImVec2 &canvasPos, int level, int tx, int ty)
+    {
+        int x, y, w, h;
+        TileRect(level, tx, ty, x, y, w, h);
+
+        ImVec2 p0 = ToScreen(canvasPos, (float)x, (float)y);
+        ImVec2 p1 = ToScreen(canvasPos, (float)(x + w), (float)(y + h));
+
+        GLuint tex = cache.Find({this, level, tx, ty});
+        if (!tex && cache.CanFill())
+            tex = FillTile(level, tx, ty);
+        if (tex)
+        {
+            drawList->AddImage((ImTextureID)(intptr_t)tex, p0, p1);
+            return;
+        }
+
+        for (int parent = level + 1; parent <= maxLevel; ++parent)
+        {
+            int shift = parent - level;
+            GLuint parentTex = cache.Find({this, parent, tx >> shift, ty >> shift});
+            if (!parentTex)
+                continue;
+
+            int px, py, pw, ph;
+            TileRect(parent, tx >> shift, ty >> shift, px, py, pw, ph);
+            ImVec2 uv0((float)(x - px) / pw, (float)(y - py) / ph);
+            ImVec2 uv1((float)(x + w - px) / pw, (float)(y + h - py) / ph);
+            drawList->AddImage((ImTextureID)(intptr_t)parentTex, p0, p1, uv0, uv1);
+            return;
+        }
+
+        drawList->AddRectFilled(p0, p1, IM_COL32(60, 60, 60, 255));
+    }
+
+    ImVec2 ToScreen(const ImVec2 &canvasPos, float imgX, float imgY) const
+    {
+        return ImVec2(canvasPos.x + (imgX - originX) * zoom, canvasPos.y + (imgY - originY) * zoom);
+    }
+};
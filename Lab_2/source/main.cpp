@@ -11,7 +11,7 @@
 constexpr int WIDTH = 1280;
 constexpr int HEIGHT = 720;
 
-int main(int, char **)
+int main(int argc, char **argv)
 {
     if (!glfwInit())
         return 1;
@@ -40,6 +40,20 @@ int main(int, char **)
     io.Fonts->AddFontFromFileTTF("fonts/consola.ttf", 16.0f, NULL, io.Fonts->GetGlyphRangesCyrillic());
 
     ColorController controller;
+    printf("CPU: %s, kernels: %s\n", CpuDispatch::Name(CpuDispatch::Detected()), PixelKernels::Get().Report().c_str());
+
+    // Images given on the command line are decoded in parallel and put into
+    // the image cache; the first one is shown.
+    if (argc > 1)
+    {
+        std::vector<std::string> paths(argv + 1, argv + argc);
+        std::vector<ImageCache::Entry> entries = ImageCache::LoadBatch(paths);
+        for (size_t i = 0; i < entries.size(); ++i)
+            if (entries[i].Empty())
+                printf("Error loading image: %s\n", paths[i].c_str());
+        if (!entries[0].Empty())
+            controller.SetImage(entries[0]);
+    }
 
     while (!glfwWindowShouldClose(window))
     {
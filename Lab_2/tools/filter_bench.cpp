@@ -0,0 +1,268 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "../include/ImageProcessor.h"
+#include "../include/SkewCorrection.h"
+#include "../include/SyntheticImage.h"
+
+using Image = ImageProcessor::Image;
+using Filter = std::function<void(const Image &, Image &)>;
+
+// Every plain operator new in the process is counted, so a steady-state run of
+// a filter can be checked for heap allocations. Scratch arenas take their
+// blocks through the aligned form and count those themselves.
+static std::atomic<size_t> g_allocations{0};
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static size_t HeapAllocations()
+{
+    return g_allocations.load(std::memory_order_relaxed) + ScratchArena::SystemAllocations();
+}
+
+static double BestMs(const Filter &filter, const Image &src, Image &dst, int runs)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        filter(src, dst);
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+static void BenchKernels(const Image &src, int runs)
+{
+    const size_t count = (size_t)src.width * src.height;
+    std::vector<uint8_t> luma(count);
+    std::vector<uint8_t> mask(count);
+    std::vector<uint8_t> rgba(count * 4);
+    std::vector<uint16_t> wide(count * 4);
+    for (size_t i = 0; i < wide.size(); ++i)
+        wide[i] = (uint16_t)(src.data[i] * 257);
+
+    printf("%-8s %10s %10s %10s %10s %12s\n", "isa", "luma ms", "mask ms", "expand ms", "narrow ms", "bilinear ms");
+    const Isa levels[] = {Isa::Scalar, Isa::Sse2, Isa::Sse41, Isa::Avx2, Isa::Avx512};
+    for (Isa isa : levels)
+    {
+        if (isa > CpuDispatch::Active())
+            break;
+
+        PixelKernels k = PixelKernels::Bind(isa);
+        Image unused;
+        double lumaMs = BestMs([&](const Image &, Image &) { k.luma.fn(src.data.data(), luma.data(), count); }, src, unused, runs);
+        double maskMs = BestMs([&](const Image &, Image &) { k.mask.fn(src.data.data(), mask.data(), count, 128); }, src, unused, runs);
+        double expandMs = BestMs([&](const Image &, Image &) { k.expand.fn(luma.data(), rgba.data(), count); }, src, unused, runs);
+        double narrowMs = BestMs([&](const Image &, Image &) { k.narrow.fn(wide.data(), rgba.data(), wide.size()); }, src, unused, runs);
+        // Each row is resampled half a pixel down and slightly compressed.
+        double bilinearMs = BestMs([&](const Image &s, Image &)
+                                   {
+                                       for (int y = 0; y + 1 < s.height; ++y)
+                                           k.bilinear.fn(s.data.data(), (size_t)s.width * 4, rgba.data() + (size_t)y * s.width * 4,
+                                                         s.width - 1, 0, ((int64_t)y << 16) + 0x8000, 0xFF00, 0);
+                                   },
+                                   src, unused, runs);
+        printf("%-8s %10.3f %10.3f %10.3f %10.3f %12.3f\n", CpuDispatch::Name(isa), lumaMs, maskMs, expandMs, narrowMs,
+               bilinearMs);
+    }
+    printf("\n");
+}
+
+static void Compare(const char *name, int kernel, const Filter &generic, const Filter &fast, const Image &src, int runs)
+{
+    Image expected;
+    Image actual;
+    double genericMs = BestMs(generic, src, expected, runs);
+    double fastMs = BestMs(fast, src, actual, runs);
+
+    // The timed runs above have warmed up dst, the scratch arena and the
+    // calibration entry; one more run must not touch the heap.
+    size_t before = HeapAllocations();
+    fast(src, actual);
+    size_t allocs = HeapAllocations() - before;
+
+    printf("%-10s %3s %12.2f %12.2f %8.1fx %7zu  %s\n", name, kernel > 0 ? std::to_string(kernel).c_str() : "-", genericMs,
+           fastMs, genericMs / fastMs, allocs, expected.data == actual.data ? "ok" : "MISMATCH");
+}
+
+// ApplyMedian runs the histogram filter for integer pixels from K = 7 on, so
+// the median rows above time it there. This times both paths directly.
+template <int K>
+static void BenchMedianPaths(const Image &src, int runs)
+{
+    Image fixedOut;
+    Image histogramOut;
+    double fixedMs = BestMs([](const Image &s, Image &d) { ImageProcessor::ApplyMedianFixed<K>(s, d); }, src, fixedOut, runs);
+    double histogramMs = BestMs([](const Image &s, Image &d) { ImageProcessor::ApplyMedianHistogram(s, d, K); }, src,
+                                histogramOut, runs);
+    printf("%-10s %3d %12.2f %12.2f  %s\n", "median", K, fixedMs, histogramMs,
+           fixedOut.data == histogramOut.data ? "ok" : "MISMATCH");
+}
+
+static void BenchMedian(const Image &src, int runs)
+{
+    printf("\n%-10s %3s %12s %12s\n", "", "K", "fixed ms", "histogram ms");
+    BenchMedianPaths<3>(src, runs);
+    BenchMedianPaths<5>(src, runs);
+    BenchMedianPaths<7>(src, runs);
+    BenchMedianPaths<15>(src, runs);
+    BenchMedianPaths<31>(src, runs);
+}
+
+// Single-threaded Otsu level from GetLum, the reference for the parallel
+// histogram.
+static int SerialOtsuLevel(const Image &src)
+{
+    ImageProcessor::Histogram hist = {};
+    for (int y = 0; y < src.height; ++y)
+        for (int x = 0; x < src.width; ++x)
+            hist[ImageProcessor::GetLum(src, x, y)]++;
+    return ImageProcessor::OtsuLevel(hist);
+}
+
+static void GenericOtsu(const Image &src, Image &dst)
+{
+    const int level = SerialOtsuLevel(src);
+    dst = src;
+    for (int y = 0; y < src.height; ++y)
+    {
+        for (int x = 0; x < src.width; ++x)
+        {
+            unsigned char *p = dst.data.data() + ((size_t)y * src.width + x) * 4;
+            p[0] = p[1] = p[2] = ImageProcessor::GetLum(src, x, y) > level ? 255 : 0;
+            p[3] = 255;
+        }
+    }
+}
+
+// The luminance histogram should run close to memory bandwidth; the hybrid
+// Bernsen adds one histogram pass to the plain one.
+static void BenchOtsu(const Image &src, int runs)
+{
+    ImageProcessor::Histogram hist;
+    Image out;
+    double histMs = BestMs([&](const Image &s, Image &) { hist = ImageProcessor::LumHistogram(s); }, src, out, runs);
+    double otsuMs = BestMs([](const Image &s, Image &d) { ImageProcessor::ApplyOtsu(s, d); }, src, out, runs);
+    double bernsenMs = BestMs([](const Image &s, Image &d) { ImageProcessor::ApplyBernsen(s, d, 15); }, src, out, runs);
+    double hybridMs = BestMs([](const Image &s, Image &d) { ImageProcessor::ApplyBernsenOtsu(s, d, 15); }, src, out, runs);
+
+    printf("\notsu: level %d\n", ImageProcessor::OtsuLevel(hist));
+    printf("%-10s %12s %10s %12s %12s %14s\n", "", "histogram ms", "MB/s", "otsu ms", "bernsen ms", "bernsen+otsu ms");
+    printf("%-10s %12.2f %10.0f %12.2f %12.2f %14.2f\n", "K=15", histMs, src.data.size() / histMs / 1000.0, otsuMs,
+           bernsenMs, hybridMs);
+}
+
+// The deskew stage against the thresholds it prepares the page for.
+static void BenchDeskew(int width, int height, int runs)
+{
+    const double angle = 2.3;
+    Image page;
+    SkewCorrection::Rotate(SyntheticImage::Generate(SyntheticImage::MakePreset(SyntheticImage::Preset::Text, width, height)), page,
+                           angle);
+
+    Image out;
+    double found = 0.0;
+    double estimateMs = BestMs([&](const Image &s, Image &) { found = SkewCorrection::EstimateSkew(s); }, page, out, runs);
+    double rotateMs = BestMs([&](const Image &s, Image &d) { SkewCorrection::Rotate(s, d, -found); }, page, out, runs);
+    double deskewMs = BestMs([](const Image &s, Image &d) { SkewCorrection::Deskew(s, d); }, page, out, runs);
+    double niblackMs = BestMs([](const Image &s, Image &d) { ImageProcessor::ApplyNiblack(s, d, 15); }, page, out, runs);
+    double bernsenMs = BestMs([](const Image &s, Image &d) { ImageProcessor::ApplyBernsen(s, d, 15); }, page, out, runs);
+
+    printf("\ndeskew: skew %.2f, found %.2f\n", angle, found);
+    printf("%-10s %12s %12s %12s %12s %12s\n", "", "estimate ms", "rotate ms", "deskew ms", "niblack ms", "bernsen ms");
+    printf("%-10s %12.2f %12.2f %12.2f %12.2f %12.2f\n", "K=15", estimateMs, rotateMs, deskewMs, niblackMs, bernsenMs);
+}
+
+int main(int argc, char **argv)
+{
+    int width = argc > 1 ? atoi(argv[1]) : 1024;
+    int height = argc > 2 ? atoi(argv[2]) : 1024;
+    int runs = argc > 3 ? atoi(argv[3]) : 3;
+    SyntheticImage::Preset preset = SyntheticImage::Preset::Noise;
+    if (argc > 4 && !SyntheticImage::ParsePreset(argv[4], preset))
+    {
+        fprintf(stderr, "unknown preset %s (noise, shadow, faint, text)\n", argv[4]);
+        return 1;
+    }
+
+    Image src = SyntheticImage::Generate(SyntheticImage::MakePreset(preset, width, height));
+    printf("%dx%d %s, best of %d runs\n", width, height, SyntheticImage::PresetName(preset), runs);
+    printf("CPU: %s, active: %s%s\n", CpuDispatch::Name(CpuDispatch::Detected()), CpuDispatch::Name(CpuDispatch::Active()),
+           CpuDispatch::IsOverridden() ? " (LAB2_ISA)" : "");
+    printf("kernels: %s\n\n", PixelKernels::Get().Report().c_str());
+
+    BenchKernels(src, runs * 5);
+
+    printf("%-10s %3s %12s %12s %9s %7s\n", "filter", "K", "generic ms", "selected ms", "speedup", "allocs");
+
+    const int kernels[] = {3, 5, 7, 15, 31};
+    for (int k : kernels)
+    {
+        Compare("median", k,
+                [k](const Image &s, Image &d) { ImageProcessor::ApplyMedianGeneric(s, d, k); },
+                [k](const Image &s, Image &d) { ImageProcessor::ApplyMedian(s, d, k); },
+                src, runs);
+    }
+    for (int k : kernels)
+    {
+        Compare("bernsen", k,
+                [k](const Image &s, Image &d) { ImageProcessor::ApplyBernsenGeneric(s, d, k); },
+                [k](const Image &s, Image &d) { ImageProcessor::ApplyBernsen(s, d, k); },
+                src, runs);
+    }
+    for (int k : kernels)
+    {
+        Compare("niblack", k,
+                [k](const Image &s, Image &d) { ImageProcessor::ApplyNiblackGeneric(s, d, k); },
+                [k](const Image &s, Image &d) { ImageProcessor::ApplyNiblack(s, d, k); },
+                src, runs);
+    }
+
+    Compare("otsu", 0, GenericOtsu, [](const Image &s, Image &d) { ImageProcessor::ApplyOtsu(s, d); }, src, runs);
+    for (int k : kernels)
+    {
+        Compare("bern+otsu", k,
+                [k](const Image &s, Image &d) { ImageProcessor::ApplyBernsenGeneric(s, d, k, 15, SerialOtsuLevel(s)); },
+                [k](const Image &s, Image &d) { ImageProcessor::ApplyBernsenOtsu(s, d, k); },
+                src, runs);
+    }
+
+    BenchMedian(src, runs);
+    BenchOtsu(src, runs);
+    BenchDeskew(width, height, runs);
+
+    printf("\ncalibration (%s):\n%s", FilterCalibration::Path().c_str(), FilterCalibration::Report().c_str());
+    return 0;
+}
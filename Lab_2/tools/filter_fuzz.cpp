@@ -0,0 +1,208 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "../include/ImageProcessor.h"
+#include "../include/ReferenceFilters.h"
+#include "../include/SyntheticImage.h"
+
+// Lab_2_fuzz [cases] [seed]
+//
+// Runs random images, window sizes and parameters through every registered
+// implementation of median, Bernsen and Niblack for 8-bit, 16-bit and float
+// pixels, and compares each result with ReferenceFilters. Case i is generated
+// from (seed, i) alone, so a failure is reproduced by the same arguments.
+// LAB2_ISA selects which SIMD kernels the implementations use.
+
+static const int FIXED_KERNELS[] = {3, 5, 7, 15, 31};
+static const int MAX_SIZE = 80;
+static const int MAX_REPORTS = 20;
+
+struct Case
+{
+    int index;
+    int width;
+    int height;
+    int kernel;
+    int contrastLimit;
+    int otsuLevel;
+    float k;
+    const char *input;
+};
+
+static int g_failures = 0;
+static size_t g_runs = 0;
+
+template <typename T>
+static T RandomSample(SyntheticImage::Random &rng)
+{
+    if constexpr (std::is_same<T, float>::value)
+        return rng.Uniform();
+    else
+        return (T)((rng.Next() >> 40) % ((unsigned)PixelTraits<T>::Max + 1));
+}
+
+template <typename T>
+static void MakeInput(SyntheticImage::Random &rng, Case &c, ImageProcessor::ImageT<T> &img)
+{
+    const int kind = rng.Range(0, 3);
+    if (kind == 0)
+    {
+        const SyntheticImage::Preset preset = (SyntheticImage::Preset)rng.Range(0, 3);
+        SyntheticImage::Params p = SyntheticImage::MakePreset(preset, c.width, c.height, rng.Next());
+        p.lineHeight = rng.Range(5, 12);
+        p.linePitch = p.lineHeight + rng.Range(1, 8);
+        p.checker = p.checker ? rng.Range(1, 9) : 0;
+        SyntheticImage::Generate(p, img);
+        c.input = SyntheticImage::PresetName(preset);
+        return;
+    }
+
+    img.width = c.width;
+    img.height = c.height;
+    img.channels = 4;
+    img.data.resize((size_t)c.width * c.height * 4);
+
+    // Colour noise, a handful of levels (many ties in every window) or a
+    // constant image (zero contrast everywhere).
+    T palette[4];
+    for (T &v : palette)
+        v = RandomSample<T>(rng);
+    for (size_t i = 0; i < img.data.size(); ++i)
+    {
+        if (kind == 1)
+            img.data[i] = RandomSample<T>(rng);
+        else if (kind == 2)
+            img.data[i] = palette[rng.Range(0, 3)];
+        else
+            img.data[i] = palette[i % 4];
+    }
+    c.input = kind == 1 ? "colour noise" : kind == 2 ? "palette" : "constant";
+}
+
+template <typename T>
+static void Report(const Case &c, const char *family, const char *variant, const std::string &what)
+{
+    ++g_failures;
+    if (g_failures > MAX_REPORTS)
+        return;
+    printf("MISMATCH case %d %s %s/%s: %dx%d %s, K=%d limit=%d level=%d k=%.4f\n  %s\n", c.index, PixelTraits<T>::Name,
+           family, variant, c.width, c.height, c.input, c.kernel, c.contrastLimit, c.otsuLevel, c.k, what.c_str());
+}
+
+// Same size as the reference, opaque, and binary where the filter thresholds;
+// then the first pixel that differs from the reference.
+template <typename T>
+static void Check(const Case &c, const char *family, const char *variant, bool binary,
+                  const ImageProcessor::ImageT<T> &expected, const ImageProcessor::ImageT<T> &actual)
+{
+    char text[160];
+    if (actual.width != expected.width || actual.height != expected.height || actual.channels != expected.channels ||
+        actual.data.size() != expected.data.size())
+    {
+        snprintf(text, sizeof(text), "result is %dx%dx%d, expected %dx%dx%d", actual.width, actual.height, actual.channels,
+                 expected.width, expected.height, expected.channels);
+        Report<T>(c, family, variant, text);
+        return;
+    }
+
+    for (size_t i = 0; i < actual.data.size(); ++i)
+    {
+        const int x = (int)(i / 4 % actual.width);
+        const int y = (int)(i / 4 / actual.width);
+        const int channel = (int)(i % 4);
+        const T v = actual.data[i];
+
+        if ((channel == 3 && v != PixelTraits<T>::Max) || (binary && v != 0 && v != PixelTraits<T>::Max))
+        {
+            snprintf(text, sizeof(text), "pixel (%d, %d) channel %d: %g is not a valid output", x, y, channel, (double)v);
+            Report<T>(c, family, variant, text);
+            return;
+        }
+        if (v != expected.data[i])
+        {
+            snprintf(text, sizeof(text), "pixel (%d, %d) channel %d: expected %g, got %g", x, y, channel,
+                     (double)expected.data[i], (double)v);
+            Report<T>(c, family, variant, text);
+            return;
+        }
+    }
+}
+
+template <typename T>
+static void RunCase(uint64_t seed, int index)
+{
+    SyntheticImage::Random rng = SyntheticImage::Stream(seed, 0, (uint64_t)index);
+
+    Case c;
+    c.index = index;
+    c.width = rng.Range(1, MAX_SIZE);
+    c.height = rng.Range(1, MAX_SIZE);
+    c.kernel = rng.Range(0, 1) ? FIXED_KERNELS[rng.Range(0, 4)] : 2 * rng.Range(0, 20) + 1;
+    c.contrastLimit = rng.Range(0, 80);
+    c.otsuLevel = rng.Range(0, 2) ? -1 : rng.Range(0, 255);
+    c.k = rng.Uniform() * 3.0f - 1.5f;
+
+    ImageProcessor::ImageT<T> src;
+    MakeInput(rng, c, src);
+
+    ImageProcessor::ImageT<T> expected;
+    ImageProcessor::ImageT<T> actual;
+    for (const ImageProcessor::FilterFamily<T> *family : ImageProcessor::Families<T>())
+    {
+        const std::string name = family->name;
+        const bool bernsen = name == "bernsen";
+        double param = 0.0;
+        if (name == "median")
+        {
+            ReferenceFilters::Median(src, expected, c.kernel);
+        }
+        else if (bernsen)
+        {
+            ReferenceFilters::Bernsen(src, expected, c.kernel, c.contrastLimit, c.otsuLevel);
+            param = c.contrastLimit;
+        }
+        else
+        {
+            ReferenceFilters::Niblack(src, expected, c.kernel, c.k);
+            param = c.k;
+        }
+
+        for (const ImageProcessor::FilterVariant<T> &variant : family->variants)
+        {
+            if (!variant.supports(c.kernel))
+                continue;
+            // Stale contents must not leak into the result.
+            actual.data.assign(expected.data.size(), (T)1);
+            variant.run(src, actual, c.kernel, param, bernsen ? c.otsuLevel : -1);
+            Check(c, family->name, variant.name, name != "median", expected, actual);
+            ++g_runs;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int cases = argc > 1 ? atoi(argv[1]) : 200;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+    printf("%d cases, seed %llu, kernels: %s\n", cases, (unsigned long long)seed, PixelKernels::Get().Report().c_str());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < cases; ++i)
+    {
+        RunCase<unsigned char>(seed, i);
+        RunCase<unsigned short>(seed, i);
+        RunCase<float>(seed, i);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    if (g_failures > MAX_REPORTS)
+        printf("... %d more\n", g_failures - MAX_REPORTS);
+    printf("%zu runs, %d mismatches, %.1f s\n", g_runs, g_failures,
+           std::chrono::duration<double>(end - start).count());
+    return g_failures == 0 ? 0 : 1;
+}
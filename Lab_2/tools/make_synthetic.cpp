@@ -0,0 +1,38 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "../include/SyntheticImage.h"
+
+// Lab_2_synth <preset> <width> <height> [seed] [out.pgm] [--16]
+int main(int argc, char **argv)
+{
+    SyntheticImage::Preset preset;
+    if (argc < 4 || !SyntheticImage::ParsePreset(argv[1], preset))
+    {
+        fprintf(stderr, "usage: %s noise|shadow|faint|text width height [seed] [out.pgm] [--16]\n", argv[0]);
+        return 1;
+    }
+
+    int width = atoi(argv[2]);
+    int height = atoi(argv[3]);
+    uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+    const char *path = argc > 5 ? argv[5] : "synthetic.pgm";
+    bool wide = argc > 6 && strcmp(argv[6], "--16") == 0;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!SyntheticImage::Save(path, SyntheticImage::MakePreset(preset, width, height, seed), wide))
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    printf("%s: %dx%d %s, seed %llu, %.0f ms (%.1f Mpx/s)\n", path, width, height, SyntheticImage::PresetName(preset),
+           (unsigned long long)seed, ms, (double)width * height / ms / 1000.0);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Software raster target. A pixel is one byte of coverage (GRAY8) or four
+// bytes in R, G, B, A order (RGBA8, the byte order of IM_COL32 colors; GRAY8
+// uses the low byte of a color). The first pixel is 64-byte aligned and the
+// stride is a multiple of 64 bytes. The tiled layout stores 8x8 tiles
+// contiguously, so a steep line touches one cache line per 8 rows instead of
+// one per row. y = 0 is the top row.
+class Framebuffer {
+public:
+    enum Format {
+        FORMAT_GRAY8,
+        FORMAT_RGBA8
+    };
+
+    enum Layout {
+        LAYOUT_LINEAR,
+        LAYOUT_TILED
+    };
+
+    static const int TILE_SIZE = 8;
+
+    Framebuffer();
+    Framebuffer(int width, int height, Format format, Layout layout = LAYOUT_LINEAR);
+
+    // Keeps the allocation when it is large enough; the pixels are undefined
+    // until Clear.
+    void Resize(int width, int height, Format format, Layout layout = LAYOUT_LINEAR);
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    Format GetFormat() const { return format; }
+    Layout GetLayout() const { return layout; }
+    int BytesPerPixel() const { return format == FORMAT_RGBA8 ? 4 : 1; }
+
+    // Bytes from one row (linear) or one row of tiles (tiled) to the next.
+    size_t Stride() const { return stride; }
+
+    uint8_t *Data() { return data; }
+    const uint8_t *Data() const { return data; }
+
+    size_t Offset(int x, int y) const {
+        return Offset(x, y, stride, BytesPerPixel(), layout);
+    }
+
+    static size_t Offset(int x, int y, size_t stride, int bpp, Layout layout) {
+        if (layout == LAYOUT_LINEAR)
+            return (size_t)y * stride + (size_t)x * bpp;
+        size_t tx = (size_t)x / TILE_SIZE;
+        size_t ty = (size_t)y / TILE_SIZE;
+        size_t inTile = ((size_t)y % TILE_SIZE) * TILE_SIZE + (size_t)x % TILE_SIZE;
+        return ty * stride + (tx * TILE_SIZE * TILE_SIZE + inTile) * bpp;
+    }
+
+    // Moves pixel (x, y) toward `color` by coverage / 255, rounded; full
+    // coverage is a plain store.
+    void Blend(int x, int y, uint32_t color, uint8_t coverage) {
+        BlendPixel(data + Offset(x, y), format, color, coverage);
+    }
+
+    static void BlendPixel(uint8_t *p, Format format, uint32_t color, uint8_t coverage) {
+        if (format == FORMAT_GRAY8) {
+            *p = coverage == 255 ? (uint8_t)color : Mix(*p, (uint8_t)color, coverage);
+            return;
+        }
+        for (int c = 0; c < 4; c++)
+            p[c] = coverage == 255 ? (uint8_t)(color >> (8 * c)) : Mix(p[c], (uint8_t)(color >> (8 * c)), coverage);
+    }
+
+    // The whole allocation, padding included: memset when all bytes of the
+    // pixel are equal, otherwise 16-byte stores.
+    void Clear(uint32_t color);
+
+    // Pixels x0..x1 of row y, inclusive and inside the buffer.
+    void FillSpan(int y, int x0, int x1, uint32_t color);
+    void BlendSpan(int y, int x0, int x1, uint32_t color, uint8_t coverage);
+
+    // Row by row into a linear image with `dstStride` bytes per row, e.g. for
+    // a texture upload.
+    void CopyTo(uint8_t *dst, size_t dstStride) const;
+
+    static uint8_t Mix(uint8_t dst, uint8_t src, uint8_t coverage) {
+        unsigned t = src * coverage + dst * (255u - coverage) + 128u;
+        return (uint8_t)((t + (t >> 8)) >> 8);
+    }
+
+private:
+    std::vector<uint8_t> storage;
+    uint8_t *data;
+    size_t stride;
+    size_t size;
+    int width;
+    int height;
+    Format format;
+    Layout layout;
+
+    // Calls fn(offset, pixels) for the contiguous pieces of row y from x0 to x1.
+    template <typename Fn>
+    void ForEachRun(int y, int x0, int x1, Fn fn) const;
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include "Framebuffer.h"
+#include "RasterAlgorithms.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Pixel sinks for RasterAlgorithms. Each one is a small struct with an inline
+// Plot, so an algorithm instantiated with it has no call or container cost
+// beyond what the sink itself stores. PlotCoverage takes 8-bit coverage
+// (0..255) from the fixed-point algorithms; sinks that keep 8-bit values store
+// it as is, the others convert it to alpha.
+
+// Counts pixels. The coordinates and 8-bit coverage are folded into an
+// integer checksum, so the compiler cannot drop the work that produced them
+// and no floating-point sum serializes the loop.
+struct CountSink {
+    size_t count = 0;
+    uint32_t checksum = 0;
+
+    void Plot(int x, int y, float alpha = 1.0f) {
+        count++;
+        checksum += ((uint32_t)x * 0x9E3779B1u ^ (uint32_t)y) + (uint32_t)(alpha * 255.0f);
+    }
+
+    void PlotCoverage(int x, int y, uint8_t coverage) {
+        count++;
+        checksum += ((uint32_t)x * 0x9E3779B1u ^ (uint32_t)y) + coverage;
+    }
+};
+
+// Appends to a vector of Point, as the canvas uses.
+struct PointSink {
+    std::vector<Point> &points;
+
+    void Plot(int x, int y, float alpha = 1.0f) {
+        points.push_back({x, y, alpha});
+    }
+
+    void PlotCoverage(int x, int y, uint8_t coverage) {
+        points.push_back({x, y, coverage * (1.0f / 255.0f)});
+    }
+};
+
+// Structure-of-arrays output without growth checks: Reset sizes the arrays
+// for at most `capacity` pixels (Rasterizer::MaxPixels), after that Plot is
+// three stores.
+struct SoaSink {
+    std::vector<int> xs;
+    std::vector<int> ys;
+    std::vector<float> alphas;
+    size_t count = 0;
+
+    void Reset(size_t capacity) {
+        if (xs.size() < capacity) {
+            xs.resize(capacity);
+            ys.resize(capacity);
+            alphas.resize(capacity);
+        }
+        count = 0;
+    }
+
+    void Plot(int x, int y, float alpha = 1.0f) {
+        xs[count] = x;
+        ys[count] = y;
+        alphas[count] = alpha;
+        count++;
+    }
+
+    void PlotCoverage(int x, int y, uint8_t coverage) {
+        Plot(x, y, coverage * (1.0f / 255.0f));
+    }
+};
+
+// Writes 8-bit coverage into a caller-owned gray buffer; (originX, originY)
+// is the raster coordinate of the top-left byte, and y grows upwards as on
+// the canvas. Pixels outside are dropped, overlapping ones keep the maximum.
+struct GraySink {
+    uint8_t *pixels;
+    int width;
+    int height;
+    ptrdiff_t stride;
+    int originX;
+    int originY;
+
+    void Plot(int x, int y, float alpha = 1.0f) {
+        PlotCoverage(x, y, (uint8_t)(alpha * 255.0f + 0.5f));
+    }
+
+    void PlotCoverage(int x, int y, uint8_t coverage) {
+        int col = x - originX;
+        int row = originY - y;
+        if ((unsigned)col >= (unsigned)width || (unsigned)row >= (unsigned)height)
+            return;
+        uint8_t &p = pixels[row * stride + col];
+        if (coverage > p)
+            p = coverage;
+    }
+};
+
+// Joins horizontally adjacent pixels of the same row and coverage into spans
+// and passes each finished one to `emit(y, x0, x1, alpha)`, x0 <= x1. Call
+// Flush after the algorithm to emit the last span.
+template <typename Emit>
+struct SpanSink {
+    Emit emit;
+    bool open = false;
+    int y = 0;
+    int x0 = 0;
+    int x1 = 0;
+    float alpha = 0.0f;
+
+    explicit SpanSink(Emit e) : emit(e) {}
+
+    void Plot(int px, int py, float a = 1.0f) {
+        if (open && py == y && a == alpha) {
+            if (px == x1 + 1) {
+                x1 = px;
+                return;
+            }
+            if (px == x0 - 1) {
+                x0 = px;
+                return;
+            }
+        }
+        Flush();
+        open = true;
+        y = py;
+        x0 = x1 = px;
+        alpha = a;
+    }
+
+    void PlotCoverage(int px, int py, uint8_t coverage) {
+        Plot(px, py, coverage * (1.0f / 255.0f));
+    }
+
+    void Flush() {
+        if (open)
+            emit(y, x0, x1, alpha);
+        open = false;
+    }
+};
+
+template <typename Emit>
+SpanSink<Emit> MakeSpanSink(Emit emit) {
+    return SpanSink<Emit>(emit);
+}
+
+// Blends into a Framebuffer with `color` at the plotted coverage; the origin
+// and clipping are as in GraySink. The buffer geometry is copied in, so the
+// pixel stores cannot force it to be reloaded from the Framebuffer.
+struct FramebufferSink {
+    uint8_t *data;
+    size_t stride;
+    int width;
+    int height;
+    Framebuffer::Format format;
+    Framebuffer::Layout layout;
+    uint32_t color;
+    int originX;
+    int originY;
+
+    FramebufferSink(Framebuffer &target, uint32_t color, int originX, int originY)
+        : data(target.Data()), stride(target.Stride()), width(target.Width()), height(target.Height()),
+          format(target.GetFormat()), layout(target.GetLayout()), color(color), originX(originX), originY(originY) {}
+
+    void Plot(int x, int y, float alpha = 1.0f) {
+        PlotCoverage(x, y, (uint8_t)(alpha * 255.0f + 0.5f));
+    }
+
+    void PlotCoverage(int x, int y, uint8_t coverage) {
+        int col = x - originX;
+        int row = originY - y;
+        if ((unsigned)col >= (unsigned)width || (unsigned)row >= (unsigned)height)
+            return;
+        int bpp = format == Framebuffer::FORMAT_RGBA8 ? 4 : 1;
+        Framebuffer::BlendPixel(data + Framebuffer::Offset(col, row, stride, bpp, layout), format, color, coverage);
+    }
+};
+
+// SpanSink output that writes each span into a Framebuffer as one span fill
+// (full coverage) or span blend, clipped to the buffer.
+struct FramebufferSpanWriter {
+    Framebuffer *target;
+    uint32_t color;
+    int originX;
+    int originY;
+
+    void operator()(int y, int x0, int x1, float alpha) const {
+        int row = originY - y;
+        int col0 = std::max(0, x0 - originX);
+        int col1 = std::min(target->Width() - 1, x1 - originX);
+        if ((unsigned)row >= (unsigned)target->Height() || col0 > col1)
+            return;
+        target->BlendSpan(row, col0, col1, color, (uint8_t)(alpha * 255.0f + 0.5f));
+    }
+};
+
+// Passes the pixels inside `clip` on to `sink`. The clipped Rasterizer::Run
+// draws through it: a range bounds only the major axis of a line, and a
+// circle step plots all eight octants.
+template <typename Sink>
+struct ClipSink {
+    Sink &sink;
+    RasterBounds clip;
+
+    bool Inside(int x, int y) const {
+        return x >= clip.minX && x <= clip.maxX && y >= clip.minY && y <= clip.maxY;
+    }
+
+    void Plot(int x, int y, float alpha = 1.0f) {
+        if (Inside(x, y))
+            sink.Plot(x, y, alpha);
+    }
+
+    void PlotCoverage(int x, int y, uint8_t coverage) {
+        if (Inside(x, y))
+            sink.PlotCoverage(x, y, coverage);
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include "Rasterizer.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Bucket index over a rasterized pixel list. The plane is cut into 64x64
+// cell buckets, and each bucket keeps the runs of consecutive points that
+// fall into it. The algorithms plot along the primitive, so a line has about
+// one run per bucket it crosses; a query visits only the buckets overlapping
+// its box, however many points there are in total.
+class PointIndex {
+public:
+    static const int BUCKET_SHIFT = 6;
+
+    void Build(const std::vector<Point> &points);
+
+    // Calls fn(point) for the points of `points` (the list given to Build)
+    // inside `box`, bounds inclusive. Points of one bucket come in list order,
+    // so repeated pixels blend as they did when plotted.
+    template <typename Fn>
+    void ForEach(const std::vector<Point> &points, const RasterBounds &box, Fn fn) const {
+        for (int by = box.minY >> BUCKET_SHIFT; by <= box.maxY >> BUCKET_SHIFT; by++) {
+            int64_t first = Key(box.minX >> BUCKET_SHIFT, by);
+            int64_t last = Key(box.maxX >> BUCKET_SHIFT, by);
+            auto it = std::lower_bound(runs.begin(), runs.end(), first,
+                                       [](const Run &run, int64_t key) { return run.key < key; });
+            for (; it != runs.end() && it->key <= last; ++it) {
+                for (uint32_t i = it->begin; i < it->end; i++) {
+                    const Point &p = points[i];
+                    if (p.x >= box.minX && p.x <= box.maxX && p.y >= box.minY && p.y <= box.maxY)
+                        fn(p);
+                }
+            }
+        }
+    }
+
+private:
+    // Points begin..end-1 of the list, all in bucket `key`.
+    struct Run {
+        int64_t key;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // Sorted by key, then by begin.
+    std::vector<Run> runs;
+
+    // Row-major bucket order; `>>` on the coordinates rounds negative ones down.
+    static int64_t Key(int bx, int by) {
+        return (int64_t)by * ((int64_t)1 << 32) + bx;
+    }
+};
@@ -0,0 +1,1014 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+
+struct Point {
+    int x, y;
+    float alpha;
+};
+
+// Raster-space box, bounds inclusive.
+struct RasterBounds {
+    int minX, minY, maxX, maxY;
+};
+
+// Part of a primitive to draw: for lines the pixels whose major-axis
+// coordinate (x, or y when |dy| > |dx|) is in lo..hi, for the circle the
+// steps x = lo..hi of its octant walk. An algorithm starts the part with the
+// state it would have reached from the beginning, so its pixels are exactly
+// those of the whole primitive.
+struct RasterRange {
+    int lo = INT_MIN;
+    int hi = INT_MAX;
+};
+
+// The algorithms as free templates over a pixel sink: any type with
+// `void Plot(int x, int y, float alpha = 1.0f)` and, for WuFixed,
+// `void PlotCoverage(int x, int y, uint8_t coverage)`. The sink is inlined, so the
+// cost of a call is the algorithm plus whatever the sink does per pixel
+// (see PixelSinks.h).
+namespace RasterAlgorithms
+{
+
+inline float fpart(float x)
+{
+    return x - std::floor(x);
+}
+
+inline float rfpart(float x)
+{
+    return 1.0f - fpart(x);
+}
+
+// The steps i = 0..n of a line from p1 (n = max(|dx|, |dy|), one pixel per
+// step along the major axis) whose major coordinate is in `range`; false when
+// there are none.
+inline bool LineSteps(Point p1, Point p2, const RasterRange &range, int &first, int &last)
+{
+    long long dx = (long long)p2.x - p1.x;
+    long long dy = (long long)p2.y - p1.y;
+    bool steep = std::llabs(dy) > std::llabs(dx);
+    long long start = steep ? p1.y : p1.x;
+    long long delta = steep ? dy : dx;
+    long long lo = delta >= 0 ? range.lo - start : start - range.hi;
+    long long hi = delta >= 0 ? range.hi - start : start - range.lo;
+    lo = std::max(lo, 0LL);
+    hi = std::min(hi, std::llabs(delta));
+    if (lo > hi)
+        return false;
+    first = (int)lo;
+    last = (int)hi;
+    return true;
+}
+
+// Minor steps BresenhamLine has taken after `step` major steps of a line
+// with deltas dx >= dy >= 0: floor((2 * step * dy + dx) / (2 * dx)).
+inline long long BresenhamMinorSteps(long long step, int dx, int dy)
+{
+    return dx == 0 ? 0 : (2 * step * dy + dx) / (2 * (long long)dx);
+}
+
+// BresenhamLine's decision after `step` major and `minor` minor steps.
+inline int BresenhamDecision(long long step, long long minor, int dx, int dy)
+{
+    return (int)(2LL * dy - dx + 2 * step * dy - 2 * minor * dx);
+}
+
+// The float algorithms (StepByStep, DDA, Wu) reach the first step of a range
+// by repeating the same additions without plotting: rounding makes the
+// accumulated value differ from any closed form.
+template <typename Sink>
+void StepByStep(Point p1, Point p2, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int first, last;
+    if (!LineSteps(p1, p2, range, first, last))
+        return;
+    if (p1.x == p2.x && p1.y == p2.y)
+    {
+        sink.Plot(p1.x, p1.y);
+        return;
+    }
+    int dx = p2.x - p1.x;
+    int dy = p2.y - p1.y;
+    int steps = std::max(std::abs(dx), std::abs(dy));
+    float x = (float)p1.x;
+    float y = (float)p1.y;
+    float xInc = (float)dx / steps;
+    float yInc = (float)dy / steps;
+    for (int i = 0; i < first; i++)
+    {
+        x += xInc;
+        y += yInc;
+    }
+    for (int i = first; i <= last; i++)
+    {
+        sink.Plot((int)std::round(x), (int)std::round(y));
+        x += xInc;
+        y += yInc;
+    }
+}
+
+template <typename Sink>
+void DDA(Point p1, Point p2, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int first, last;
+    if (!LineSteps(p1, p2, range, first, last))
+        return;
+    int dx = p2.x - p1.x;
+    int dy = p2.y - p1.y;
+    int length = std::max(std::abs(dx), std::abs(dy));
+    float x = (float)p1.x;
+    float y = (float)p1.y;
+    float dX = (float)dx / length;
+    float dY = (float)dy / length;
+    for (int i = 0; i < first; i++)
+    {
+        x += dX;
+        y += dY;
+    }
+    for (int i = first; i <= last; i++)
+    {
+        sink.Plot((int)std::round(x), (int)std::round(y));
+        x += dX;
+        y += dY;
+    }
+}
+
+template <typename Sink>
+void BresenhamLine(Point p1, Point p2, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int first, last;
+    if (!LineSteps(p1, p2, range, first, last))
+        return;
+
+    int x1 = p1.x;
+    int y1 = p1.y;
+    int x2 = p2.x;
+    int y2 = p2.y;
+
+    int dx = std::abs(x2 - x1);
+    int dy = std::abs(y2 - y1);
+
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+
+    bool isSteep = dy > dx;
+
+    if (isSteep)
+    {
+        std::swap(x1, y1);
+        std::swap(x2, y2);
+        std::swap(dx, dy);
+        std::swap(sx, sy);
+    }
+
+    // The state after `first` steps, in closed form.
+    long long minor = BresenhamMinorSteps(first, dx, dy);
+    int decision = BresenhamDecision(first, minor, dx, dy);
+
+    int d1 = 2 * dy;
+    int d2 = 2 * (dy - dx);
+
+    int x = x1 + first * sx;
+    int y = y1 + (int)minor * sy;
+
+    if (isSteep)
+        sink.Plot(y, x);
+    else
+        sink.Plot(x, y);
+
+    for (int i = first; i < last; i++)
+    {
+        x += sx;
+        if (decision >= 0)
+        {
+            y += sy;
+            decision += d2;
+        }
+        else
+        {
+            decision += d1;
+        }
+        if (isSteep)
+            sink.Plot(y, x);
+        else
+            sink.Plot(x, y);
+    }
+}
+
+// Bresenham's line drawn run by run: along the major axis the line moves in
+// runs of q or q + 1 pixels (q = dx / dy), so one decision per run picks the
+// length and the run itself is a plain loop. The pixels are exactly those of
+// BresenhamLine, in the same order.
+template <typename Sink>
+void BresenhamRunSlice(Point p1, Point p2, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int first, last;
+    if (!LineSteps(p1, p2, range, first, last))
+        return;
+
+    int x1 = p1.x;
+    int y1 = p1.y;
+    int x2 = p2.x;
+    int y2 = p2.y;
+
+    int dx = std::abs(x2 - x1);
+    int dy = std::abs(y2 - y1);
+
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+
+    bool isSteep = dy > dx;
+
+    if (isSteep)
+    {
+        std::swap(x1, y1);
+        std::swap(x2, y2);
+        std::swap(dx, dy);
+        std::swap(sx, sy);
+    }
+
+    // The first run goes from step `first` up to BresenhamLine's next minor
+    // step, the first step whose minor count (2 * step * dy + dx) / (2 * dx)
+    // reaches one more.
+    long long minor = BresenhamMinorSteps(first, dx, dy);
+    int next = last + 1;
+    if (dy > 0)
+        next = (int)std::min((long long)next, (2 * (long long)dx * (minor + 1) - dx + 2 * dy - 1) / (2 * (long long)dy));
+
+    int x = x1 + first * sx;
+    int y = y1 + (int)minor * sy;
+
+    for (int i = first; i < next; i++)
+    {
+        if (isSteep)
+            sink.Plot(y, x);
+        else
+            sink.Plot(x, y);
+        x += sx;
+    }
+    x -= sx;
+    if (next > last)
+        return;
+
+    // After a minor step the next run has q - 1 or q more major steps; the
+    // decision is BresenhamLine's kept as if q - 1 steps were already taken,
+    // so its sign picks the length and it changes by -r or 2 * dy - r per run.
+    int q = dx / dy;
+    int r = 2 * (dx % dy);
+    int decision = BresenhamDecision(next, minor + 1, dx, dy) + (q - 1) * 2 * dy;
+
+    int remaining = last - next + 1;
+    while (remaining > 0)
+    {
+        int run;
+        if (decision >= 0)
+        {
+            run = q;
+            decision -= r;
+        }
+        else
+        {
+            run = q + 1;
+            decision += 2 * dy - r;
+        }
+        run = std::min(run, remaining);
+        remaining -= run;
+
+        y += sy;
+        if (isSteep)
+        {
+            for (int i = 0; i < run; i++)
+            {
+                x += sx;
+                sink.Plot(y, x);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < run; i++)
+            {
+                x += sx;
+                sink.Plot(x, y);
+            }
+        }
+    }
+}
+
+// Wu and Rokne's symmetric double step: one decision chooses the pattern of
+// the next two pixels (minor step on neither, the second, the first or both)
+// and the pattern is drawn from both ends at once, mirrored. Away from exact
+// ties the pixels are BresenhamLine's; at a tie the second half rounds the
+// other way, so the line is symmetric about its midpoint.
+template <typename Sink>
+void DoubleStep(Point p1, Point p2, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int from, to;
+    if (!LineSteps(p1, p2, range, from, to))
+        return;
+
+    int x1 = p1.x;
+    int y1 = p1.y;
+    int x2 = p2.x;
+    int y2 = p2.y;
+
+    int dx = std::abs(x2 - x1);
+    int dy = std::abs(y2 - y1);
+
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+
+    bool isSteep = dy > dx;
+
+    if (isSteep)
+    {
+        std::swap(x1, y1);
+        std::swap(x2, y2);
+        std::swap(dx, dy);
+        std::swap(sx, sy);
+    }
+
+    auto plot = [&](int x, int y)
+    {
+        if (isSteep)
+            sink.Plot(y, x);
+        else
+            sink.Plot(x, y);
+    };
+
+    // Pixel `step` steps from the start, if the range has it.
+    auto plotStep = [&](int step, int x, int y)
+    {
+        if (step >= from && step <= to)
+            plot(x, y);
+    };
+
+    plotStep(0, x1, y1);
+    if (dx == 0)
+        return;
+    plotStep(dx, x2, y2);
+
+    // BresenhamLine's decision before a pair of steps; the limits split its
+    // range into the four patterns.
+    int lowLimit = -2 * dy;
+    int highLimit = 2 * (dx - dy);
+
+    auto pattern = [&](int &decision, int &first, int &second)
+    {
+        if (decision < lowLimit)
+        {
+            first = 0;
+            second = 0;
+            decision += 4 * dy;
+        }
+        else if (decision < 0)
+        {
+            first = 0;
+            second = sy;
+            decision += 4 * dy - 2 * dx;
+        }
+        else if (decision < highLimit)
+        {
+            first = sy;
+            second = 0;
+            decision += 4 * dy - 2 * dx;
+        }
+        else
+        {
+            first = sy;
+            second = sy;
+            decision += 4 * (dy - dx);
+        }
+    };
+
+    int pairs = (dx - 1) / 4;
+    int left = (dx - 1) % 4;
+    int first = 0, second = 0;
+    int fx = x1, fy = y1;
+    int bx = x2, by = y2;
+
+    if (from == 0 && to == dx)
+    {
+        int decision = 2 * dy - dx;
+        for (int i = 0; i <= pairs; i++)
+        {
+            pattern(decision, first, second);
+
+            if (i == pairs)
+                break;
+
+            fx += sx;
+            fy += first;
+            plot(fx, fy);
+            fx += sx;
+            fy += second;
+            plot(fx, fy);
+
+            bx -= sx;
+            by -= first;
+            plot(bx, by);
+            bx -= sx;
+            by -= second;
+            plot(bx, by);
+        }
+    }
+    else
+    {
+        // Part of the line: each half draws its pairs i0..i1 that reach the
+        // range, from BresenhamLine's state before step 2 * i0 (dir is 1 for
+        // the front half, -1 for the mirrored back half).
+        auto half = [&](int i0, int i1, int dir)
+        {
+            if (i0 > i1)
+                return;
+            long long minor = BresenhamMinorSteps(2LL * i0, dx, dy);
+            int decision = BresenhamDecision(2LL * i0, minor, dx, dy);
+            int x = (dir > 0 ? x1 : x2) + dir * 2 * i0 * sx;
+            int y = (dir > 0 ? y1 : y2) + dir * (int)minor * sy;
+            for (int i = i0; i <= i1; i++)
+            {
+                int a, b;
+                pattern(decision, a, b);
+                x += dir * sx;
+                y += dir * a;
+                plotStep(dir > 0 ? 2 * i + 1 : dx - 2 * i - 1, x, y);
+                x += dir * sx;
+                y += dir * b;
+                plotStep(dir > 0 ? 2 * i + 2 : dx - 2 * i - 2, x, y);
+            }
+        };
+
+        int back = dx - 2 - to;
+        half(std::max(0, (from - 1) / 2), to >= 1 ? std::min(pairs - 1, (to - 1) / 2) : -1, 1);
+        half(back > 0 ? (back + 1) / 2 : 0, from < dx ? std::min(pairs - 1, (dx - 1 - from) / 2) : -1, -1);
+
+        long long minor = BresenhamMinorSteps(2LL * pairs, dx, dy);
+        int decision = BresenhamDecision(2LL * pairs, minor, dx, dy);
+        pattern(decision, first, second);
+        fx = x1 + 2 * pairs * sx;
+        fy = y1 + (int)minor * sy;
+        bx = x2 - 2 * pairs * sx;
+        by = y2 - (int)minor * sy;
+    }
+
+    // 0..3 pixels remain between the two halves: the last pattern forward,
+    // then its first step backward.
+    if (left > 0)
+        plotStep(2 * pairs + 1, fx + sx, fy + first);
+    if (left > 1)
+        plotStep(2 * pairs + 2, fx + 2 * sx, fy + first + second);
+    if (left > 2)
+        plotStep(dx - 2 * pairs - 1, bx - sx, by - first);
+}
+
+// y of BresenhamCircle's step x (x >= 0, radius > 0). Before the walk
+// crosses the diagonal it is the largest y with E(x - 1, y) < 0, i.e.
+// y * (y - 1) <= radius^2 - x^2 - 1; the step across may stay one row above
+// that, so step x is taken from the closed form of step x - 1 with one
+// decision. It never grows with x, also past the end of the walk.
+inline int BresenhamCircleY(int radius, int x)
+{
+    if (x == 0)
+        return radius;
+    long long r2 = (long long)radius * radius;
+    long long prev = (long long)x - 1;
+    long long limit = r2 - prev * prev - 1;
+    long long y = 0;
+    if (limit >= 0)
+    {
+        y = (long long)((1.0 + std::sqrt(1.0 + 4.0 * (double)limit)) / 2.0);
+        while (y > 0 && y * (y - 1) > limit)
+            y--;
+        while ((y + 1) * y <= limit)
+            y++;
+    }
+    if (2 * (long long)x * x + y * y + (y - 1) * (y - 1) - 2 * r2 >= 0)
+        y--;
+    return (int)y;
+}
+
+template <typename Sink>
+void BresenhamCircle(Point p1, int radius, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int x0 = p1.x;
+    int y0 = p1.y;
+    int R = radius;
+
+    int x = 0;
+    int y = R;
+
+    int E = 3 - 2 * R;
+
+    // A range starts at step x = range.lo, if the walk gets there (step x
+    // follows step x - 1 while x - 1 < y), with y and E in closed form.
+    if (range.lo > 0)
+    {
+        if (R <= 0 || range.lo - 1 >= BresenhamCircleY(R, range.lo - 1))
+            return;
+        x = range.lo;
+        y = BresenhamCircleY(R, x);
+        long long next = (long long)x + 1;
+        E = (int)(2 * next * next + (long long)y * y + (long long)(y - 1) * (y - 1) - 2 * (long long)R * R);
+    }
+    if (x > range.hi)
+        return;
+
+    auto plot8 = [&](int xc, int yc, int x, int y)
+    {
+        sink.Plot(xc + x, yc + y);
+        sink.Plot(xc + x, yc - y);
+        sink.Plot(xc - x, yc + y);
+        sink.Plot(xc - x, yc - y);
+        sink.Plot(xc + y, yc + x);
+        sink.Plot(xc + y, yc - x);
+        sink.Plot(xc - y, yc + x);
+        sink.Plot(xc - y, yc - x);
+    };
+
+    plot8(x0, y0, x, y);
+
+    while (x < y && x < range.hi)
+    {
+        if (E >= 0)
+        {
+            E = E + 4 * (x - y) + 10;
+            x++;
+            y--;
+        }
+        else
+        {
+            E = E + 4 * x + 6;
+            x++;
+        }
+        plot8(x0, y0, x, y);
+    }
+}
+
+// Castle-Pitteway move words without building strings. Word 0 is the straight
+// move "s", word 1 the diagonal "d"; every later word is `repeat` written
+// `count` times followed by `tail`. One Euclid division step adds one word,
+// so a period of any int-sized line fits in a fixed array. Words of at most
+// 64 moves also keep their moves as bits (1 = diagonal, first move lowest);
+// `diagonals` counts the diagonal moves, so a word can be skipped whole.
+struct CastlePitewayWord
+{
+    int repeat;
+    int count;
+    int tail;
+    long long length;
+    long long diagonals;
+    uint64_t moves;
+};
+
+const int CASTLE_PITEWAY_MAX_WORDS = 64;
+const long long CASTLE_PITEWAY_FLAT_MOVES = 64;
+
+// Replays a word from (x, y). A flat word is a branch-free loop over its
+// bits and a single move repeated is a run; anything longer recurses on
+// `repeat` and continues with `tail` in place. The position lives in locals
+// so the sink's stores cannot force it back to memory.
+template <typename Sink>
+struct CastlePitewayWalker
+{
+    const CastlePitewayWord *words;
+    int straightX, straightY;
+    int extraX, extraY;
+    Sink &sink;
+
+    void Replay(const CastlePitewayWord &word, int &x, int &y)
+    {
+        ReplayMoves(word.moves, (int)word.length, x, y);
+    }
+
+    void ReplayMoves(uint64_t moves, int length, int &x, int &y)
+    {
+        for (int i = 0; i < length; i++)
+        {
+            int diagonal = -(int)(moves & 1);
+            moves >>= 1;
+            x += straightX + (diagonal & extraX);
+            y += straightY + (diagonal & extraY);
+            sink.Plot(x, y);
+        }
+    }
+
+    void Walk(int w, int &px, int &py)
+    {
+        int x = px;
+        int y = py;
+        while (words[w].length > CASTLE_PITEWAY_FLAT_MOVES)
+        {
+            const CastlePitewayWord &word = words[w];
+            const CastlePitewayWord &repeat = words[word.repeat];
+            if (repeat.length == 1)
+            {
+                int mx = straightX + (int)repeat.moves * extraX;
+                int my = straightY + (int)repeat.moves * extraY;
+                for (int i = 0; i < word.count; i++)
+                {
+                    x += mx;
+                    y += my;
+                    sink.Plot(x, y);
+                }
+            }
+            else if (repeat.length <= CASTLE_PITEWAY_FLAT_MOVES)
+            {
+                for (int i = 0; i < word.count; i++)
+                    Replay(repeat, x, y);
+            }
+            else
+            {
+                for (int i = 0; i < word.count; i++)
+                    Walk(word.repeat, x, y);
+            }
+            w = word.tail;
+        }
+        Replay(words[w], x, y);
+        px = x;
+        py = y;
+    }
+
+    // Moves (x, y) past the first n moves of word w without plotting.
+    void Skip(int w, long long n, int &x, int &y)
+    {
+        while (n > 0)
+        {
+            const CastlePitewayWord &word = words[w];
+            if (n >= word.length)
+            {
+                x += (int)(word.length * straightX + word.diagonals * extraX);
+                y += (int)(word.length * straightY + word.diagonals * extraY);
+                return;
+            }
+            const CastlePitewayWord &repeat = words[word.repeat];
+            long long whole = std::min((long long)word.count, n / repeat.length);
+            x += (int)(whole * (repeat.length * straightX + repeat.diagonals * extraX));
+            y += (int)(whole * (repeat.length * straightY + repeat.diagonals * extraY));
+            n -= whole * repeat.length;
+            w = whole < word.count ? word.repeat : word.tail;
+        }
+    }
+
+    // Plots moves begin..end - 1 of word w, (x, y) being the position before
+    // move `begin`.
+    void WalkPart(int w, long long begin, long long end, int &x, int &y)
+    {
+        const CastlePitewayWord &word = words[w];
+        if (begin == 0 && end == word.length)
+        {
+            Walk(w, x, y);
+            return;
+        }
+        if (word.length <= CASTLE_PITEWAY_FLAT_MOVES)
+        {
+            ReplayMoves(word.moves >> begin, (int)(end - begin), x, y);
+            return;
+        }
+        const CastlePitewayWord &repeat = words[word.repeat];
+        long long repeats = repeat.length * word.count;
+        if (begin < repeats)
+        {
+            long long last = (std::min(end, repeats) - 1) / repeat.length;
+            for (long long i = begin / repeat.length; i <= last; i++)
+            {
+                long long start = i * repeat.length;
+                WalkPart(word.repeat, std::max(begin - start, 0LL), std::min(end - start, repeat.length), x, y);
+            }
+        }
+        if (end > repeats)
+            WalkPart(word.tail, std::max(begin - repeats, 0LL), end - repeats, x, y);
+    }
+};
+
+// Adds the word `repeat`^count + `tail`, flattening it when it is short.
+inline int AddCastlePitewayWord(CastlePitewayWord *words, int &size, int repeat, int count, int tail)
+{
+    CastlePitewayWord &word = words[size];
+    word = {repeat, count, tail, words[repeat].length * count + words[tail].length,
+            words[repeat].diagonals * count + words[tail].diagonals, 0};
+    if (word.length <= CASTLE_PITEWAY_FLAT_MOVES)
+    {
+        int shift = 0;
+        for (int i = 0; i < count; i++)
+        {
+            word.moves |= words[repeat].moves << shift;
+            shift += (int)words[repeat].length;
+        }
+        if (shift < 64)
+            word.moves |= words[tail].moves << shift;
+    }
+    return size++;
+}
+
+template <typename Sink>
+void CastlePiteway(Point p1, Point p2, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int from, to;
+    if (!LineSteps(p1, p2, range, from, to))
+        return;
+
+    int x0 = p1.x;
+    int y0 = p1.y;
+    int x1 = p2.x;
+    int y1 = p2.y;
+
+    int dx = std::abs(x1 - x0);
+    int dy = std::abs(y1 - y0);
+    int sx = (x1 > x0) ? 1 : -1;
+    int sy = (y1 > y0) ? 1 : -1;
+
+    bool steep = dy > dx;
+    if (steep)
+        std::swap(dx, dy);
+
+    if (dy == 0)
+    {
+        for (int i = from; i <= to; i++)
+        {
+            if (steep)
+                sink.Plot(x0, y0 + i * sy);
+            else
+                sink.Plot(x0 + i * sx, y0);
+        }
+        return;
+    }
+    if (dx == dy)
+    {
+        for (int i = from; i <= to; i++)
+        {
+            sink.Plot(x0 + i * sx, y0 + i * sy);
+        }
+        return;
+    }
+
+    int u = dx - dy;
+    int v = dy;
+
+    // The subtractive recursion m2 = m1 + m2 (u > v) or m1 = m2 + m1 (v > u),
+    // with each run of equal steps taken as one division.
+    CastlePitewayWord words[CASTLE_PITEWAY_MAX_WORDS];
+    words[0] = {0, 0, 0, 1, 0, 0};
+    words[1] = {1, 0, 1, 1, 1, 1};
+    int size = 2;
+    int m1 = 0;
+    int m2 = 1;
+
+    while (u != v)
+    {
+        if (u > v)
+        {
+            int k = (u - 1) / v;
+            u -= k * v;
+            m2 = AddCastlePitewayWord(words, size, m1, k, m2);
+        }
+        else
+        {
+            int k = (v - 1) / u;
+            v -= k * u;
+            m1 = AddCastlePitewayWord(words, size, m2, k, m1);
+        }
+    }
+
+    CastlePitewayWalker<Sink> walker = {words, steep ? 0 : sx, steep ? sy : 0, steep ? sx : 0, steep ? 0 : sy, sink};
+    int currX = x0;
+    int currY = y0;
+
+    if (from == 0 && to == dx)
+    {
+        sink.Plot(currX, currY);
+        for (int k = 0; k < u; k++)
+        {
+            walker.Walk(m2, currX, currY);
+            walker.Walk(m1, currX, currY);
+        }
+        return;
+    }
+
+    // Part of the line: pixel i follows move i - 1 of u periods m2 m1. The
+    // periods and words before the first move are skipped by their length
+    // and diagonal count.
+    if (from == 0)
+        sink.Plot(currX, currY);
+    int period = AddCastlePitewayWord(words, size, m2, 1, m1);
+    long long length = words[period].length;
+    long long begin = std::max(from - 1, 0);
+    long long end = to;
+    if (begin >= end)
+        return;
+    walker.Skip(period, begin % length, currX, currY);
+    long long periods = begin / length;
+    currX += (int)(periods * (length * walker.straightX + words[period].diagonals * walker.extraX));
+    currY += (int)(periods * (length * walker.straightY + words[period].diagonals * walker.extraY));
+    for (long long k = periods; k * length < end; k++)
+        walker.WalkPart(period, std::max(begin - k * length, 0LL), std::min(end - k * length, length), currX, currY);
+}
+
+template <typename Sink>
+void Wu(Point p1, Point p2, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int first, last;
+    if (!LineSteps(p1, p2, range, first, last))
+        return;
+
+    float x0 = (float)p1.x;
+    float y0 = (float)p1.y;
+    float x1 = (float)p2.x;
+    float y1 = (float)p2.y;
+
+    bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+
+    if (steep)
+    {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+    }
+
+    if (x0 > x1)
+    {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float gradient;
+
+    if (dx == 0.0f)
+    {
+        gradient = 1.0f;
+    }
+    else
+    {
+        gradient = dy / dx;
+    }
+
+    float xend = std::floor(x0);
+    float yend = y0 + gradient * (xend - x0);
+    float xgap = 1.0f - (x0 - xend);
+
+    int xpxl1 = (int)xend;
+    int ypxl1 = (int)std::floor(yend);
+
+    if (xpxl1 >= range.lo && xpxl1 <= range.hi)
+    {
+        if (steep)
+        {
+            sink.Plot(ypxl1, xpxl1, rfpart(yend) * xgap);
+            sink.Plot(ypxl1 + 1, xpxl1, fpart(yend) * xgap);
+        }
+        else
+        {
+            sink.Plot(xpxl1, ypxl1, rfpart(yend) * xgap);
+            sink.Plot(xpxl1, ypxl1 + 1, fpart(yend) * xgap);
+        }
+    }
+
+    float intery = yend + gradient;
+
+    xend = std::ceil(x1);
+    yend = y1 + gradient * (xend - x1);
+    xgap = 1.0f - (xend - x1);
+
+    int xpxl2 = (int)xend;
+    int ypxl2 = (int)std::floor(yend);
+
+    if (xpxl2 >= range.lo && xpxl2 <= range.hi)
+    {
+        if (steep)
+        {
+            sink.Plot(ypxl2, xpxl2, rfpart(yend) * xgap);
+            sink.Plot(ypxl2 + 1, xpxl2, fpart(yend) * xgap);
+        }
+        else
+        {
+            sink.Plot(xpxl2, ypxl2, rfpart(yend) * xgap);
+            sink.Plot(xpxl2, ypxl2 + 1, fpart(yend) * xgap);
+        }
+    }
+
+    // The columns between the ends that are in the range.
+    int start = std::max(xpxl1 + 1, range.lo);
+    int stop = std::min(xpxl2, range.hi == INT_MAX ? INT_MAX : range.hi + 1);
+    for (int x = xpxl1 + 1; x < start; x++)
+        intery = intery + gradient;
+
+    if (steep)
+    {
+        for (int x = start; x < stop; x++)
+        {
+            sink.Plot((int)std::floor(intery), x, rfpart(intery));
+            sink.Plot((int)std::floor(intery) + 1, x, fpart(intery));
+            intery = intery + gradient;
+        }
+    }
+    else
+    {
+        for (int x = start; x < stop; x++)
+        {
+            sink.Plot(x, (int)std::floor(intery), rfpart(intery));
+            sink.Plot(x, (int)std::floor(intery) + 1, fpart(intery));
+            intery = intery + gradient;
+        }
+    }
+}
+
+// Wu's line in integer arithmetic. The minor coordinate is kept in 32.32
+// fixed point: its integer part is the row of the upper-left pixel of the pair
+// and the top 8 bits of the fraction are the coverage of the other one.
+// Endpoints are integer, so the end pixels have full coverage. The pairs are
+// those of Wu in exact arithmetic, in the same order; the float Wu rounds
+// `intery` at every step and can pick a row one off from them, on short lines
+// too. Every value is exact integer maths, so the output is the same on every
+// platform.
+template <typename Sink>
+void WuFixed(Point p1, Point p2, Sink &sink, const RasterRange &range = RasterRange())
+{
+    int first, last;
+    if (!LineSteps(p1, p2, range, first, last))
+        return;
+
+    int x0 = p1.x;
+    int y0 = p1.y;
+    int x1 = p2.x;
+    int y1 = p2.y;
+
+    bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+
+    if (steep)
+    {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+    }
+
+    if (x0 > x1)
+    {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    // The gradient is rounded up, so intery never falls below the exact
+    // value and an exactly integer row is not taken for the one below it
+    // (the accumulated error stays under 1 / dx while dx < 65536).
+    const int64_t ONE = (int64_t)1 << 32;
+    int dx = x1 - x0;
+    int dy = y1 - y0;
+    int64_t gradient = 0;
+    if (dx != 0)
+    {
+        int64_t scaled = (int64_t)dy * ONE;
+        gradient = scaled / dx + (scaled % dx > 0 ? 1 : 0);
+    }
+
+    auto plotEnd = [&](int x, int y)
+    {
+        if (x < range.lo || x > range.hi)
+            return;
+        if (steep)
+        {
+            sink.PlotCoverage(y, x, 255);
+            sink.PlotCoverage(y + 1, x, 0);
+        }
+        else
+        {
+            sink.PlotCoverage(x, y, 255);
+            sink.PlotCoverage(x, y + 1, 0);
+        }
+    };
+    plotEnd(x0, y0);
+    plotEnd(x1, y1);
+
+    // The columns between the ends that are in the range; intery at column
+    // x is y0 + (x - x0) * gradient.
+    int start = std::max(x0 + 1, range.lo);
+    int stop = std::min(x1, range.hi == INT_MAX ? INT_MAX : range.hi + 1);
+    int64_t intery = (int64_t)y0 * ONE + (int64_t)(start - x0) * gradient;
+
+    if (steep)
+    {
+        for (int x = start; x < stop; x++)
+        {
+            int y = (int)(intery >> 32);
+            uint8_t coverage = (uint8_t)(intery >> 24);
+            sink.PlotCoverage(y, x, (uint8_t)(255 - coverage));
+            sink.PlotCoverage(y + 1, x, coverage);
+            intery += gradient;
+        }
+    }
+    else
+    {
+        for (int x = start; x < stop; x++)
+        {
+            int y = (int)(intery >> 32);
+            uint8_t coverage = (uint8_t)(intery >> 24);
+            sink.PlotCoverage(x, y, (uint8_t)(255 - coverage));
+            sink.PlotCoverage(x, y + 1, coverage);
+            intery += gradient;
+        }
+    }
+}
+
+} // namespace RasterAlgorithms
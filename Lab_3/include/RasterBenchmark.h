@@ -0,0 +1,49 @@
+#pragma once
+#include "Framebuffer.h"
+#include "Rasterizer.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Times the current task on a worker thread. Each sample is the mean time of
+// one call over a batch long enough for the clock; the distribution of the
+// samples collected so far is published for the UI. Sampling stops after a
+// fixed number of samples and resumes when the task changes. The calls write
+// into the worker's own framebuffer, sized like the canvas one.
+class RasterBenchmark {
+public:
+    struct Stats {
+        double min = 0.0;
+        double median = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        size_t samples = 0;
+        bool finished = false;
+    };
+
+    RasterBenchmark();
+    ~RasterBenchmark();
+
+    void SetTask(const RasterTask &task);
+    Stats GetStats() const;
+
+private:
+    static const size_t MAX_SAMPLES = 2000;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    RasterTask task;
+    bool hasTask;
+    bool stopping;
+    std::atomic<unsigned> generation;
+    Stats stats;
+
+    std::thread worker;
+    Framebuffer target;
+
+    void Run();
+    void RunOnce(const RasterTask &task, const RasterBounds &bounds);
+    void Publish(unsigned gen, std::vector<double> &samples, bool finished);
+};
@@ -1,25 +1,34 @@
 #pragma once
 #include "imgui.h"
+#include "Framebuffer.h"
+#include "PointIndex.h"
+#include "Rasterizer.h"
+#include "RasterBenchmark.h"
 #include <vector>
 #include <string>
 
-struct Point {
-    int x, y;
-    float alpha;
-};
+// Grid label texts for a range of integers, formatted once and reused while
+// the visible range stays inside it.
+struct AxisLabels {
+    static const int LABEL_CHARS = 12;
+
+    std::vector<char> text;
+    int first = 0;
+    int count = 0;
+
+    // Reformats, with a margin of the range's length on both sides, when
+    // lo..hi is not covered yet.
+    void Cover(int lo, int hi);
 
-enum RasterAlgorithm {
-    ALGO_STEP_BY_STEP,
-    ALGO_DDA,
-    ALGO_BRESENHAM_LINE,
-    ALGO_BRESENHAM_CIRCLE,
-    ALGO_CASTLE_PITEWAY,
-    ALGO_WU
+    const char *Get(int value) const {
+        return text.data() + (size_t)(value - first) * LABEL_CHARS;
+    }
 };
 
 class RasterController {
 public:
     RasterController();
+    ~RasterController();
     void Render();
 
 private:
@@ -29,28 +38,38 @@ private:
     int radius;
     RasterAlgorithm currentAlgo;
     
+    // The task's pixels inside `pointBounds`, a region around the view.
     std::vector<Point> Points;
+    RasterBounds pointBounds;
+    PointIndex pointIndex;
+
+    // The rasterized pixels as 8-bit coverage; `canvasBounds` is the raster
+    // box it covers, row 0 being canvasBounds.maxY. For primitives larger
+    // than MAX_TARGET_SIDE the box follows the view.
+    Framebuffer canvas;
+    RasterBounds canvasBounds;
+
+    // The visible part of `canvas` as an RGBA image and its GL texture (0
+    // until the first upload); `imageCells` holds the canvas columns (minX,
+    // maxX) and rows (minY, maxY) it was made from.
+    Framebuffer canvasImage;
+    unsigned int canvasTexture;
+    RasterBounds imageCells;
+    bool imageValid;
     
-    double currentExecutionTime; 
-    double averageExecutionTime; 
-    double totalTimeAccumulator; 
-    long long frameCount;        
-    
-    Point lastP1, lastP2;
-    int lastRadius;
-    RasterAlgorithm lastAlgo;
+    RasterTask lastTask;
+    bool hasResult;
+
+    RasterBenchmark benchmark;
 
     ImVec2 scrolling;
 
+    AxisLabels xLabels;
+    AxisLabels yLabels;
+
     void Calculate();
+    void Rasterize(int centerX, int centerY);
+    void PlaceCanvas(int centerX, int centerY);
+    void UploadCanvasImage(const RasterBounds &cells);
     void DrawCanvas();
-    
-    void AlgoStepByStep();
-    void AlgoDDA();
-    void AlgoBresenhamLine();
-    void AlgoBresenhamCircle();
-    void AlgoCastlePiteway();
-    void AlgoWu();
-    
-    void Plot(int x, int y, float alpha = 1.0f);
 };
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+#include "RasterAlgorithms.h"
+#include "PixelSinks.h"
+#include <cstddef>
+#include <vector>
+
+enum RasterAlgorithm {
+    ALGO_STEP_BY_STEP,
+    ALGO_DDA,
+    ALGO_BRESENHAM_LINE,
+    ALGO_BRESENHAM_CIRCLE,
+    ALGO_CASTLE_PITEWAY,
+    ALGO_WU,
+    ALGO_BRESENHAM_RUN_SLICE,
+    ALGO_DOUBLE_STEP,
+    ALGO_WU_FIXED,
+    ALGO_COUNT
+};
+
+// Everything an algorithm reads: the segment (p1, p2) or the circle (center p1, radius).
+struct RasterTask {
+    RasterAlgorithm algo;
+    Point p1;
+    Point p2;
+    int radius;
+
+    bool SameAs(const RasterTask &other) const {
+        return algo == other.algo && p1.x == other.p1.x && p1.y == other.p1.y &&
+               p2.x == other.p2.x && p2.y == other.p2.y && radius == other.radius;
+    }
+};
+
+// Runs the task's algorithm into any pixel sink. The switch is the only
+// per-call dispatch; the per-pixel path is the inlined algorithm and sink.
+class Rasterizer {
+public:
+    template <typename Sink>
+    static void Run(const RasterTask &task, Sink &sink) {
+        Run(task, sink, RasterRange());
+    }
+
+    // Only the part of the primitive in `range` (see RasterRange).
+    template <typename Sink>
+    static void Run(const RasterTask &task, Sink &sink, const RasterRange &range) {
+        using namespace RasterAlgorithms;
+        switch (task.algo) {
+        case ALGO_STEP_BY_STEP:
+            StepByStep(task.p1, task.p2, sink, range);
+            break;
+        case ALGO_DDA:
+            DDA(task.p1, task.p2, sink, range);
+            break;
+        case ALGO_BRESENHAM_LINE:
+            BresenhamLine(task.p1, task.p2, sink, range);
+            break;
+        case ALGO_BRESENHAM_CIRCLE:
+            BresenhamCircle(task.p1, task.radius, sink, range);
+            break;
+        case ALGO_CASTLE_PITEWAY:
+            CastlePiteway(task.p1, task.p2, sink, range);
+            break;
+        case ALGO_WU:
+            Wu(task.p1, task.p2, sink, range);
+            break;
+        case ALGO_BRESENHAM_RUN_SLICE:
+            BresenhamRunSlice(task.p1, task.p2, sink, range);
+            break;
+        case ALGO_DOUBLE_STEP:
+            DoubleStep(task.p1, task.p2, sink, range);
+            break;
+        case ALGO_WU_FIXED:
+            WuFixed(task.p1, task.p2, sink, range);
+            break;
+        case ALGO_COUNT:
+            break;
+        }
+    }
+
+    // Only the pixels inside `clip`, the same as the whole primitive has
+    // there; the work is that of the ranges ClipRanges finds, not of the
+    // whole primitive.
+    template <typename Sink>
+    static void Run(const RasterTask &task, Sink &sink, const RasterBounds &clip) {
+        RasterRange ranges[MAX_CLIP_RANGES];
+        int count = ClipRanges(task, clip, ranges);
+        ClipSink<Sink> clipped = {sink, clip};
+        for (int i = 0; i < count; i++)
+            Run(task, clipped, ranges[i]);
+    }
+
+    // Clears `points` and fills it, for the canvas.
+    static void Run(const RasterTask &task, std::vector<Point> &points);
+    static void Run(const RasterTask &task, std::vector<Point> &points, const RasterBounds &clip);
+
+    // The ranges whose pixels can fall inside `clip`, at most
+    // MAX_CLIP_RANGES and disjoint. A line has one: Liang-Barsky cuts the
+    // segment to the clip grown by a pixel, as no algorithm strays further
+    // from it, except the float ones, whose minor coordinate drifts; they get
+    // the clip's major extent. The circle gets the steps at which any of its
+    // eight octants is inside, merged.
+    static int ClipRanges(const RasterTask &task, const RasterBounds &clip, RasterRange *ranges);
+
+    static const int MAX_CLIP_RANGES = 8;
+
+    // Upper bound on the pixels the task plots, for sinks without growth checks.
+    static size_t MaxPixels(const RasterTask &task);
+
+    // Raster-space box around every pixel a task plots, the second pixel of
+    // Wu's pairs included.
+    static RasterBounds Bounds(const RasterTask &task);
+
+    // Bounds cut to at most `maxSide` pixels per axis around p1, for
+    // framebuffers that must stay a bounded size (pixels outside are clipped).
+    static RasterBounds Bounds(const RasterTask &task, int maxSide);
+
+    // The same cut around (centerX, centerY), e.g. the middle of the view.
+    static RasterBounds Bounds(const RasterTask &task, int maxSide, int centerX, int centerY);
+
+    // Side limit of the canvas and benchmark framebuffers: 16 MB of GRAY8.
+    static const int MAX_TARGET_SIDE = 4096;
+
+    // Short ASCII id for tables and files.
+    static const char *Name(RasterAlgorithm algo);
+};
@@ -0,0 +1,188 @@
+#include "../include/Framebuffer.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LAB3_SSE2
+#endif
+
+static const size_t ALIGNMENT = 64;
+
+// Clears larger than this bypass the cache, as memset does for large sizes.
+static const size_t STREAM_BYTES = (size_t)1 << 20;
+
+static size_t AlignUp(size_t value)
+{
+    return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+// Repeats the 4-byte `pattern` over `bytes` bytes; dst and bytes are whole pixels.
+static void FillBytes(uint8_t *dst, size_t bytes, uint32_t pattern)
+{
+    size_t i = 0;
+#ifdef LAB3_SSE2
+    __m128i v = _mm_set1_epi32((int)pattern);
+    for (; i + 16 <= bytes; i += 16)
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+#endif
+    for (; i < bytes; i++)
+        dst[i] = (uint8_t)(pattern >> (8 * (i % 4)));
+}
+
+// Framebuffer::Mix over `bytes` bytes with the 4-byte `pattern` as the source.
+static void BlendBytes(uint8_t *dst, size_t bytes, uint32_t pattern, uint8_t coverage)
+{
+    size_t i = 0;
+#ifdef LAB3_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cover = _mm_set1_epi16(coverage);
+    const __m128i inverse = _mm_set1_epi16((short)(255 - coverage));
+    const __m128i half = _mm_set1_epi16(128);
+    __m128i src = _mm_set1_epi32((int)pattern);
+    __m128i srcLo = _mm_mullo_epi16(_mm_unpacklo_epi8(src, zero), cover);
+    __m128i srcHi = _mm_mullo_epi16(_mm_unpackhi_epi8(src, zero), cover);
+    for (; i + 16 <= bytes; i += 16)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(srcLo, _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inverse)), half);
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(srcHi, _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inverse)), half);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < bytes; i++)
+        dst[i] = Framebuffer::Mix(dst[i], (uint8_t)(pattern >> (8 * (i % 4))), coverage);
+}
+
+// A GRAY8 color as four equal bytes, so both formats use the same pattern code.
+static uint32_t Pattern(Framebuffer::Format format, uint32_t color)
+{
+    return format == Framebuffer::FORMAT_GRAY8 ? (color & 0xFFu) * 0x01010101u : color;
+}
+
+Framebuffer::Framebuffer()
+{
+    data = nullptr;
+    stride = 0;
+    size = 0;
+    width = 0;
+    height = 0;
+    format = FORMAT_GRAY8;
+    layout = LAYOUT_LINEAR;
+}
+
+Framebuffer::Framebuffer(int width, int height, Format format, Layout layout)
+    : Framebuffer()
+{
+    Resize(width, height, format, layout);
+}
+
+void Framebuffer::Resize(int newWidth, int newHeight, Format newFormat, Layout newLayout)
+{
+    width = std::max(0, newWidth);
+    height = std::max(0, newHeight);
+    format = newFormat;
+    layout = newLayout;
+
+    size_t bpp = (size_t)BytesPerPixel();
+    if (layout == LAYOUT_LINEAR)
+    {
+        stride = AlignUp((size_t)width * bpp);
+        size = stride * (size_t)height;
+    }
+    else
+    {
+        size_t tilesX = ((size_t)width + TILE_SIZE - 1) / TILE_SIZE;
+        size_t tilesY = ((size_t)height + TILE_SIZE - 1) / TILE_SIZE;
+        stride = tilesX * TILE_SIZE * TILE_SIZE * bpp;
+        size = stride * tilesY;
+    }
+
+    if (storage.size() < size + ALIGNMENT)
+        storage.resize(size + ALIGNMENT);
+    uintptr_t base = (uintptr_t)storage.data();
+    data = storage.data() + (AlignUp(base) - base);
+}
+
+void Framebuffer::Clear(uint32_t color)
+{
+    uint32_t pattern = Pattern(format, color);
+    if (pattern == (pattern & 0xFFu) * 0x01010101u)
+    {
+        std::memset(data, (int)(pattern & 0xFFu), size);
+        return;
+    }
+#ifdef LAB3_SSE2
+    // data is 64-byte aligned and size a multiple of 64.
+    if (size >= STREAM_BYTES)
+    {
+        __m128i v = _mm_set1_epi32((int)pattern);
+        for (size_t i = 0; i < size; i += 16)
+            _mm_stream_si128((__m128i *)(data + i), v);
+        _mm_sfence();
+        return;
+    }
+#endif
+    FillBytes(data, size, pattern);
+}
+
+template <typename Fn>
+void Framebuffer::ForEachRun(int y, int x0, int x1, Fn fn) const
+{
+    if (layout == LAYOUT_LINEAR)
+    {
+        fn(Offset(x0, y), x1 - x0 + 1);
+        return;
+    }
+    for (int x = x0; x <= x1;)
+    {
+        int end = std::min(x1, x / TILE_SIZE * TILE_SIZE + TILE_SIZE - 1);
+        fn(Offset(x, y), end - x + 1);
+        x = end + 1;
+    }
+}
+
+void Framebuffer::FillSpan(int y, int x0, int x1, uint32_t color)
+{
+    uint32_t pattern = Pattern(format, color);
+    size_t bpp = (size_t)BytesPerPixel();
+    ForEachRun(y, x0, x1, [&](size_t offset, int pixels)
+               {
+                   if (format == FORMAT_GRAY8)
+                       std::memset(data + offset, (int)(pattern & 0xFFu), (size_t)pixels);
+                   else
+                       FillBytes(data + offset, (size_t)pixels * bpp, pattern); });
+}
+
+void Framebuffer::BlendSpan(int y, int x0, int x1, uint32_t color, uint8_t coverage)
+{
+    if (coverage == 255)
+    {
+        FillSpan(y, x0, x1, color);
+        return;
+    }
+    uint32_t pattern = Pattern(format, color);
+    size_t bpp = (size_t)BytesPerPixel();
+    ForEachRun(y, x0, x1, [&](size_t offset, int pixels)
+               { BlendBytes(data + offset, (size_t)pixels * bpp, pattern, coverage); });
+}
+
+void Framebuffer::CopyTo(uint8_t *dst, size_t dstStride) const
+{
+    size_t rowBytes = (size_t)width * BytesPerPixel();
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t *row = dst + (size_t)y * dstStride;
+        if (layout == LAYOUT_LINEAR)
+        {
+            std::memcpy(row, data + Offset(0, y), rowBytes);
+            continue;
+        }
+        ForEachRun(y, 0, width - 1, [&](size_t offset, int pixels)
+                   {
+                       std::memcpy(row, data + offset, (size_t)pixels * BytesPerPixel());
+                       row += (size_t)pixels * BytesPerPixel(); });
+    }
+}
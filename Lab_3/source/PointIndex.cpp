@@ -0,0 +1,16 @@
+#include "../include/PointIndex.h"
+
+void PointIndex::Build(const std::vector<Point> &points)
+{
+    runs.clear();
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        int64_t key = Key(points[i].x >> BUCKET_SHIFT, points[i].y >> BUCKET_SHIFT);
+        if (!runs.empty() && runs.back().key == key && runs.back().end == i)
+            runs.back().end++;
+        else
+            runs.push_back({key, (uint32_t)i, (uint32_t)i + 1});
+    }
+    std::sort(runs.begin(), runs.end(), [](const Run &a, const Run &b)
+              { return a.key != b.key ? a.key < b.key : a.begin < b.begin; });
+}
@@ -0,0 +1,137 @@
+#include "../include/RasterBenchmark.h"
+#include <algorithm>
+#include <chrono>
+
+using Clock = std::chrono::steady_clock;
+
+static const double MIN_BATCH_US = 200.0;
+static const int MAX_BATCH = 100000;
+static const double PUBLISH_INTERVAL_MS = 100.0;
+
+
+static double ElapsedUs(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static double Quantile(const std::vector<double> &sorted, double q)
+{
+    size_t index = (size_t)(q * (double)(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+RasterBenchmark::RasterBenchmark()
+{
+    task = {ALGO_BRESENHAM_LINE, {0, 0, 1.0f}, {0, 0, 1.0f}, 0};
+    hasTask = false;
+    stopping = false;
+    generation = 0;
+
+    worker = std::thread(&RasterBenchmark::Run, this);
+}
+
+RasterBenchmark::~RasterBenchmark()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        generation++;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void RasterBenchmark::SetTask(const RasterTask &newTask)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = newTask;
+        hasTask = true;
+        stats = Stats();
+        generation++;
+    }
+    wake.notify_one();
+}
+
+// The algorithm and its pixel writes; the target is cleared once per task,
+// not per call, so later calls blend over the same pixels.
+void RasterBenchmark::RunOnce(const RasterTask &task, const RasterBounds &bounds)
+{
+    FramebufferSink sink = {target, 255, bounds.minX, bounds.maxY};
+    Rasterizer::Run(task, sink);
+}
+
+RasterBenchmark::Stats RasterBenchmark::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void RasterBenchmark::Publish(unsigned gen, std::vector<double> &samples, bool finished)
+{
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (gen != generation)
+        return;
+    stats.min = sorted.front();
+    stats.median = Quantile(sorted, 0.5);
+    stats.p95 = Quantile(sorted, 0.95);
+    stats.p99 = Quantile(sorted, 0.99);
+    stats.samples = sorted.size();
+    stats.finished = finished;
+}
+
+void RasterBenchmark::Run()
+{
+    std::vector<double> samples;
+    samples.reserve(MAX_SAMPLES);
+    unsigned done = 0;
+
+    while (true)
+    {
+        RasterTask current;
+        unsigned gen;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]
+                      { return stopping || (hasTask && generation != done); });
+            if (stopping)
+                return;
+            current = task;
+            gen = generation;
+        }
+
+        RasterBounds bounds = Rasterizer::Bounds(current, Rasterizer::MAX_TARGET_SIDE);
+        target.Resize(bounds.maxX - bounds.minX + 1, bounds.maxY - bounds.minY + 1, Framebuffer::FORMAT_GRAY8);
+        target.Clear(0);
+
+        // Size the batch from one call.
+        Clock::time_point start = Clock::now();
+        RunOnce(current, bounds);
+        double once = std::max(0.01, ElapsedUs(start, Clock::now()));
+        int batch = (int)std::min((double)MAX_BATCH, std::max(1.0, MIN_BATCH_US / once));
+
+        samples.clear();
+        Clock::time_point lastPublish = Clock::now();
+        while (samples.size() < MAX_SAMPLES && gen == generation)
+        {
+            start = Clock::now();
+            for (int i = 0; i < batch; i++)
+                RunOnce(current, bounds);
+            Clock::time_point end = Clock::now();
+            samples.push_back(ElapsedUs(start, end) / batch);
+
+            if (ElapsedUs(lastPublish, end) >= PUBLISH_INTERVAL_MS * 1000.0)
+            {
+                Publish(gen, samples, false);
+                lastPublish = end;
+            }
+        }
+
+        if (gen == generation)
+            Publish(gen, samples, true);
+        done = gen;
+    }
+}
@@ -1,23 +1,29 @@
 #include "../include/RasterController.h"
+#include <GL/gl.h>
 #include <cmath>
 #include <algorithm>
-#include <chrono>
 #include <cstdio>
-#include <string>
 #include <utility>
 
 static const float PANEL_WIDTH = 350.0f;
 static const int WINDOW_WIDTH = 1280;
 static const int WINDOW_HEIGHT = 720;
 
-static float fpart(float x)
-{
-    return x - std::floor(x);
-}
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+// Color of a cell with full coverage; the coverage itself becomes alpha.
+static const uint8_t PIXEL_GRAY = 50;
 
-static float rfpart(float x)
+// Side of the region around the view that the task is rasterized into; the
+// canvas framebuffer moves inside it through the point index.
+static const int POINT_REGION_SIDE = 16 * Rasterizer::MAX_TARGET_SIDE;
+
+static bool Contains(const RasterBounds &outer, const RasterBounds &inner)
 {
-    return 1.0f - fpart(x);
+    return inner.minX >= outer.minX && inner.maxX <= outer.maxX &&
+           inner.minY >= outer.minY && inner.maxY <= outer.maxY;
 }
 
 RasterController::RasterController()
@@ -28,406 +34,47 @@ RasterController::RasterController()
     radius = 10;
     currentAlgo = ALGO_BRESENHAM_LINE;
 
-    currentExecutionTime = 0.0;
-    averageExecutionTime = 0.0;
-    totalTimeAccumulator = 0.0;
-    frameCount = 0;
+    lastTask = {currentAlgo, p1, p2, radius};
+    hasResult = false;
 
-    lastP1 = p1;
-    lastP2 = p2;
-    lastRadius = radius;
-    lastAlgo = currentAlgo;
+    canvasTexture = 0;
+    imageCells = {0, 0, -1, -1};
+    imageValid = false;
 
     scrolling = ImVec2(0.0f, 0.0f);
 }
 
-void RasterController::Plot(int x, int y, float alpha)
+RasterController::~RasterController()
 {
-    Points.push_back({x, y, alpha});
+    if (canvasTexture != 0)
+        glDeleteTextures(1, &canvasTexture);
 }
 
-void RasterController::AlgoStepByStep()
+void RasterController::Calculate()
 {
-    if (p1.x == p2.x && p1.y == p2.y)
-    {
-        Plot(p1.x, p1.y);
+    RasterTask task = {currentAlgo, p1, p2, radius};
+    if (hasResult && task.SameAs(lastTask))
         return;
-    }
-    int dx = p2.x - p1.x;
-    int dy = p2.y - p1.y;
-    int steps = std::max(std::abs(dx), std::abs(dy));
-    float x = (float)p1.x;
-    float y = (float)p1.y;
-    float xInc = (float)dx / steps;
-    float yInc = (float)dy / steps;
-    for (int i = 0; i <= steps; i++)
-    {
-        Plot((int)round(x), (int)round(y));
-        x += xInc;
-        y += yInc;
-    }
-}
-
-void RasterController::AlgoDDA()
-{
-    int dx = p2.x - p1.x;
-    int dy = p2.y - p1.y;
-    int length = std::max(std::abs(dx), std::abs(dy));
-    float x = (float)p1.x;
-    float y = (float)p1.y;
-    float dX = (float)dx / length;
-    float dY = (float)dy / length;
-    for (int i = 0; i <= length; i++)
-    {
-        Plot((int)round(x), (int)round(y));
-        x += dX;
-        y += dY;
-    }
-}
-
-void RasterController::AlgoBresenhamLine()
-{
-    int x1 = p1.x;
-    int y1 = p1.y;
-    int x2 = p2.x;
-    int y2 = p2.y;
-
-    int dx = std::abs(x2 - x1);
-    int dy = std::abs(y2 - y1);
-
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
-
-    bool isSteep = dy > dx;
-
-    if (isSteep)
-    {
-        std::swap(x1, y1);
-        std::swap(x2, y2);
-        std::swap(dx, dy);
-        std::swap(sx, sy);
-    }
-
-    int decision = 2 * dy - dx;
 
-    int d1 = 2 * dy;
-    int d2 = 2 * (dy - dx);
-
-    int x = x1;
-    int y = y1;
-
-    if (isSteep)
-        Plot(y, x);
-    else
-        Plot(x, y);
-
-    for (int i = 0; i < dx; i++)
-    {
-        x += sx;
-        if (decision >= 0)
-        {
-            y += sy;
-            decision += d2;
-        }
-        else
-        {
-            decision += d1;
-        }
-        if (isSteep)
-            Plot(y, x);
-        else
-            Plot(x, y);
-    }
-}
-
-void RasterController::AlgoBresenhamCircle()
-{
-    int x0 = p1.x;
-    int y0 = p1.y;
-    int R = radius;
-
-    int x = 0;
-    int y = R;
-
-    int E = 3 - 2 * R;
-
-    auto plot8 = [&](int xc, int yc, int x, int y)
-    {
-        Plot(xc + x, yc + y);
-        Plot(xc + x, yc - y);
-        Plot(xc - x, yc + y);
-        Plot(xc - x, yc - y);
-        Plot(xc + y, yc + x);
-        Plot(xc + y, yc - x);
-        Plot(xc - y, yc + x);
-        Plot(xc - y, yc - x);
-    };
+    lastTask = task;
+    hasResult = true;
 
-    plot8(x0, y0, x, y);
+    // The raster cell in the middle of the view.
+    Rasterize((int)std::floor(-scrolling.x / scale), (int)std::floor(scrolling.y / scale));
 
-    while (x < y)
-    {
-        if (E >= 0)
-        {
-            E = E + 4 * (x - y) + 10;
-            x++;
-            y--;
-        }
-        else
-        {
-            E = E + 4 * x + 6;
-            x++;
-        }
-        plot8(x0, y0, x, y);
-    }
+    benchmark.SetTask(task);
 }
 
-void RasterController::AlgoCastlePiteway()
+// Rasterizes the last task clipped to at most POINT_REGION_SIDE cells around
+// (centerX, centerY): a line of millions of pixels costs about the region's
+// side, and the pixels inside are exactly those of the whole primitive.
+void RasterController::Rasterize(int centerX, int centerY)
 {
-    int x0 = p1.x;
-    int y0 = p1.y;
-    int x1 = p2.x;
-    int y1 = p2.y;
-
-    int dx = std::abs(x1 - x0);
-    int dy = std::abs(y1 - y0);
-    int sx = (x1 > x0) ? 1 : -1;
-    int sy = (y1 > y0) ? 1 : -1;
-
-    bool steep = dy > dx;
-    if (steep)
-        std::swap(dx, dy);
-
-    if (dy == 0)
-    {
-        for (int i = 0; i <= dx; i++)
-        {
-            if (steep)
-                Plot(y0 + i * sy, x0 + i * sx);
-            else
-                Plot(x0 + i * sx, y0);
-        }
-        return;
-    }
-    if (dx == dy)
-    {
-        for (int i = 0; i <= dx; i++)
-        {
-            Plot(x0 + i * sx, y0 + i * sy);
-        }
-        return;
-    }
-
-    int u = dx - dy;
-    int v = dy;
-
-    std::string m1 = "s";
-    std::string m2 = "d";
+    pointBounds = Rasterizer::Bounds(lastTask, POINT_REGION_SIDE, centerX, centerY);
+    Rasterizer::Run(lastTask, Points, pointBounds);
+    pointIndex.Build(Points);
 
-    while (u != v)
-    {
-        if (u > v)
-        {
-            u = u - v;
-            m2 = m1 + m2;
-        }
-        else
-        {
-            v = v - u;
-            m1 = m2 + m1;
-        }
-    }
-
-    std::string finalSequence = "";
-    for (int k = 0; k < u; k++)
-    {
-        finalSequence += m2 + m1;
-    }
-
-    int currX = x0;
-    int currY = y0;
-
-    Plot(currX, currY);
-
-    for (char move : finalSequence)
-    {
-        if (steep)
-        {
-            if (move == 's')
-            {
-                currY += sy;
-            }
-            else
-            {
-                currX += sx;
-                currY += sy;
-            }
-        }
-        else
-        {
-            if (move == 's')
-            {
-                currX += sx;
-            }
-            else
-            {
-                currX += sx;
-                currY += sy;
-            }
-        }
-        Plot(currX, currY);
-    }
-}
-
-void RasterController::AlgoWu()
-{
-    float x0 = (float)p1.x;
-    float y0 = (float)p1.y;
-    float x1 = (float)p2.x;
-    float y1 = (float)p2.y;
-
-    bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
-
-    if (steep)
-    {
-        std::swap(x0, y0);
-        std::swap(x1, y1);
-    }
-
-    if (x0 > x1)
-    {
-        std::swap(x0, x1);
-        std::swap(y0, y1);
-    }
-
-    float dx = x1 - x0;
-    float dy = y1 - y0;
-    float gradient;
-
-    if (dx == 0.0f)
-    {
-        gradient = 1.0f;
-    }
-    else
-    {
-        gradient = dy / dx;
-    }
-
-    float xend = std::floor(x0);
-    float yend = y0 + gradient * (xend - x0);
-    float xgap = 1.0f - (x0 - xend);
-
-    int xpxl1 = (int)xend;
-    int ypxl1 = (int)std::floor(yend);
-
-    if (steep)
-    {
-        Plot(ypxl1, xpxl1, rfpart(yend) * xgap);
-        Plot(ypxl1 + 1, xpxl1, fpart(yend) * xgap);
-    }
-    else
-    {
-        Plot(xpxl1, ypxl1, rfpart(yend) * xgap);
-        Plot(xpxl1, ypxl1 + 1, fpart(yend) * xgap);
-    }
-
-    float intery = yend + gradient;
-
-    xend = std::ceil(x1);
-    yend = y1 + gradient * (xend - x1);
-    xgap = 1.0f - (xend - x1);
-
-    int xpxl2 = (int)xend;
-    int ypxl2 = (int)std::floor(yend);
-
-    if (steep)
-    {
-        Plot(ypxl2, xpxl2, rfpart(yend) * xgap);
-        Plot(ypxl2 + 1, xpxl2, fpart(yend) * xgap);
-    }
-    else
-    {
-        Plot(xpxl2, ypxl2, rfpart(yend) * xgap);
-        Plot(xpxl2, ypxl2 + 1, fpart(yend) * xgap);
-    }
-
-    if (steep)
-    {
-        for (int x = xpxl1 + 1; x < xpxl2; x++)
-        {
-            Plot((int)std::floor(intery), x, rfpart(intery));
-            Plot((int)std::floor(intery) + 1, x, fpart(intery));
-            intery = intery + gradient;
-        }
-    }
-    else
-    {
-        for (int x = xpxl1 + 1; x < xpxl2; x++)
-        {
-            Plot(x, (int)std::floor(intery), rfpart(intery));
-            Plot(x, (int)std::floor(intery) + 1, fpart(intery));
-            intery = intery + gradient;
-        }
-    }
-}
-
-void RasterController::Calculate()
-{
-    bool changed = false;
-    if (p1.x != lastP1.x || p1.y != lastP1.y ||
-        p2.x != lastP2.x || p2.y != lastP2.y ||
-        radius != lastRadius || currentAlgo != lastAlgo)
-    {
-        changed = true;
-        lastP1 = p1;
-        lastP2 = p2;
-        lastRadius = radius;
-        lastAlgo = currentAlgo;
-
-        totalTimeAccumulator = 0.0;
-        frameCount = 0;
-    }
-
-    Points.clear();
-    Points.reserve(2000);
-
-    auto start = std::chrono::high_resolution_clock::now();
-    int iterations = 1000;
-    for (int i = 0; i < iterations; i++)
-    {
-        if (i > 0)
-            Points.clear();
-        switch (currentAlgo)
-        {
-        case ALGO_STEP_BY_STEP:
-            AlgoStepByStep();
-            break;
-        case ALGO_DDA:
-            AlgoDDA();
-            break;
-        case ALGO_BRESENHAM_LINE:
-            AlgoBresenhamLine();
-            break;
-        case ALGO_BRESENHAM_CIRCLE:
-            AlgoBresenhamCircle();
-            break;
-        case ALGO_CASTLE_PITEWAY:
-            AlgoCastlePiteway();
-            break;
-        case ALGO_WU:
-            AlgoWu();
-            break;
-        }
-    }
-    auto end = std::chrono::high_resolution_clock::now();
-
-    std::chrono::duration<double, std::micro> elapsed = end - start;
-
-    currentExecutionTime = elapsed.count() / (double)iterations;
-
-    totalTimeAccumulator += currentExecutionTime;
-    frameCount++;
-    averageExecutionTime = totalTimeAccumulator / (double)frameCount;
+    PlaceCanvas(centerX, centerY);
 }
 
 void RasterController::Render()
@@ -451,10 +98,16 @@ void RasterController::Render()
         currentAlgo = ALGO_DDA;
     if (ImGui::RadioButton("Брезенхем (Отрезок)", currentAlgo == ALGO_BRESENHAM_LINE))
         currentAlgo = ALGO_BRESENHAM_LINE;
+    if (ImGui::RadioButton("Брезенхем (серии)", currentAlgo == ALGO_BRESENHAM_RUN_SLICE))
+        currentAlgo = ALGO_BRESENHAM_RUN_SLICE;
+    if (ImGui::RadioButton("Двойной шаг Ву", currentAlgo == ALGO_DOUBLE_STEP))
+        currentAlgo = ALGO_DOUBLE_STEP;
     if (ImGui::RadioButton("Каста-Питвея", currentAlgo == ALGO_CASTLE_PITEWAY))
         currentAlgo = ALGO_CASTLE_PITEWAY;
     if (ImGui::RadioButton("Ву", currentAlgo == ALGO_WU))
         currentAlgo = ALGO_WU;
+    if (ImGui::RadioButton("Ву (фиксированная точка)", currentAlgo == ALGO_WU_FIXED))
+        currentAlgo = ALGO_WU_FIXED;
     if (ImGui::RadioButton("Брезенхем (Окружность)", currentAlgo == ALGO_BRESENHAM_CIRCLE))
         currentAlgo = ALGO_BRESENHAM_CIRCLE;
     ImGui::Spacing();
@@ -491,9 +144,14 @@ void RasterController::Render()
 
     ImGui::Separator();
 
-    ImGui::Text("Текущее время:   %.3f мкс", currentExecutionTime);
-    ImGui::Text("Среднее время:   %.3f мкс", averageExecutionTime);
-    ImGui::Text("Кол-во пикселей: %zu", Points.size());
+    RasterBenchmark::Stats stats = benchmark.GetStats();
+    ImGui::Text("Время (мкс), замеров: %zu%s", stats.samples, stats.finished ? "" : "...");
+    ImGui::Text("  мин:     %.3f", stats.min);
+    ImGui::Text("  медиана: %.3f", stats.median);
+    ImGui::Text("  p95:     %.3f", stats.p95);
+    ImGui::Text("  p99:     %.3f", stats.p99);
+    ImGui::Text("Кол-во пикселей в области: %zu", Points.size());
+    ImGui::Text("Буфер: %d x %d", canvas.Width(), canvas.Height());
 
     ImGui::End();
 
@@ -509,6 +167,70 @@ void RasterController::Render()
     ImGui::End();
 }
 
+void AxisLabels::Cover(int lo, int hi)
+{
+    if (lo >= first && hi < first + count)
+        return;
+    int span = hi - lo + 1;
+    first = lo - span;
+    count = 3 * span;
+    text.resize((size_t)count * LABEL_CHARS);
+    for (int i = 0; i < count; i++)
+        std::snprintf(text.data() + (size_t)i * LABEL_CHARS, LABEL_CHARS, "%d", first + i);
+}
+
+// Fills `canvas` with the last task's pixels inside at most MAX_TARGET_SIDE
+// cells around (centerX, centerY). The index hands over only the points in
+// that box, so moving the canvas along a huge primitive costs what the box
+// holds, not what was rasterized.
+void RasterController::PlaceCanvas(int centerX, int centerY)
+{
+    canvasBounds = Rasterizer::Bounds(lastTask, Rasterizer::MAX_TARGET_SIDE, centerX, centerY);
+    canvas.Resize(canvasBounds.maxX - canvasBounds.minX + 1, canvasBounds.maxY - canvasBounds.minY + 1,
+                  Framebuffer::FORMAT_GRAY8);
+    canvas.Clear(0);
+    FramebufferSink sink = {canvas, 255, canvasBounds.minX, canvasBounds.maxY};
+    pointIndex.ForEach(Points, canvasBounds, [&](const Point &p)
+                       { sink.Plot(p.x, p.y, p.alpha); });
+    imageValid = false;
+}
+
+// One texel per cell, so the texture is drawn with GL_NEAREST: cells stay
+// sharp squares at any scale.
+void RasterController::UploadCanvasImage(const RasterBounds &cells)
+{
+    int width = cells.maxX - cells.minX + 1;
+    int height = cells.maxY - cells.minY + 1;
+    canvasImage.Resize(width, height, Framebuffer::FORMAT_RGBA8);
+    for (int row = 0; row < height; row++)
+    {
+        const uint8_t *src = canvas.Data() + canvas.Offset(cells.minX, cells.minY + row);
+        uint8_t *dst = canvasImage.Data() + canvasImage.Offset(0, row);
+        for (int col = 0; col < width; col++, dst += 4)
+        {
+            dst[0] = dst[1] = dst[2] = PIXEL_GRAY;
+            dst[3] = src[col];
+        }
+    }
+
+    if (canvasTexture == 0)
+    {
+        glGenTextures(1, &canvasTexture);
+        glBindTexture(GL_TEXTURE_2D, canvasTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, canvasTexture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(canvasImage.Stride() / 4));
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, canvasImage.Data());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    imageCells = cells;
+    imageValid = true;
+}
+
 void RasterController::DrawCanvas()
 {
     ImDrawList *draw_list = ImGui::GetWindowDrawList();
@@ -554,6 +276,49 @@ void RasterController::DrawCanvas()
         return ImVec2(origin.x + x * scale, origin.y - y * scale);
     };
 
+    // Visible raster cells. When the part of the primitive among them leaves
+    // the rasterized region, the task is rasterized again around the middle
+    // of the view; when it only leaves the canvas, the canvas moves there.
+    RasterBounds view;
+    view.minX = (int)std::floor((canvas_p0.x - origin.x) / scale);
+    view.maxX = (int)std::ceil((canvas_p1.x - origin.x) / scale);
+    view.minY = (int)std::floor((origin.y - canvas_p1.y) / scale);
+    view.maxY = (int)std::ceil((origin.y - canvas_p0.y) / scale);
+
+    RasterBounds shown = Rasterizer::Bounds(lastTask);
+    shown.minX = std::max(shown.minX, view.minX);
+    shown.maxX = std::min(shown.maxX, view.maxX);
+    shown.minY = std::max(shown.minY, view.minY);
+    shown.maxY = std::min(shown.maxY, view.maxY);
+    if (shown.minX <= shown.maxX && shown.minY <= shown.maxY)
+    {
+        int centerX = view.minX + (view.maxX - view.minX) / 2;
+        int centerY = view.minY + (view.maxY - view.minY) / 2;
+        if (!Contains(pointBounds, shown))
+            Rasterize(centerX, centerY);
+        else if (!Contains(canvasBounds, shown))
+            PlaceCanvas(centerX, centerY);
+    }
+
+    // The framebuffer pixels inside the visible cells, as one textured quad;
+    // it is uploaded again only when the task or the visible cells change.
+    RasterBounds cells;
+    cells.minX = std::max(0, view.minX - canvasBounds.minX);
+    cells.maxX = std::min(canvas.Width() - 1, view.maxX - canvasBounds.minX);
+    cells.minY = std::max(0, canvasBounds.maxY - view.maxY);
+    cells.maxY = std::min(canvas.Height() - 1, canvasBounds.maxY - view.minY);
+
+    if (cells.minX <= cells.maxX && cells.minY <= cells.maxY)
+    {
+        if (!imageValid || cells.minX != imageCells.minX || cells.maxX != imageCells.maxX ||
+            cells.minY != imageCells.minY || cells.maxY != imageCells.maxY)
+            UploadCanvasImage(cells);
+
+        ImVec2 p_min = ToScreen(canvasBounds.minX + cells.minX, canvasBounds.maxY - cells.minY + 1);
+        ImVec2 p_max = ToScreen(canvasBounds.minX + cells.maxX + 1, canvasBounds.maxY - cells.maxY);
+        draw_list->AddImage((ImTextureID)(intptr_t)canvasTexture, p_min, p_max);
+    }
+
     if (scale >= 4)
     {
         const ImU32 GRID_COLOR = IM_COL32(220, 220, 220, 255);
@@ -564,19 +329,22 @@ void RasterController::DrawCanvas()
         int y_min = (int)((origin.y - canvas_p1.y) / scale) - 1;
         int y_max = (int)((origin.y - canvas_p0.y) / scale) + 1;
 
+        xLabels.Cover(x_min, x_max);
+        yLabels.Cover(y_min, y_max);
+
         for (int x = x_min; x <= x_max; x++)
         {
             float xi = origin.x + x * scale;
             draw_list->AddLine(ImVec2(xi, canvas_p0.y), ImVec2(xi, canvas_p1.y), GRID_COLOR);
             if (scale > 15 || (x % 5 == 0))
-                draw_list->AddText(ImVec2(xi + 2, origin.y + 2), TEXT_COLOR, std::to_string(x).c_str());
+                draw_list->AddText(ImVec2(xi + 2, origin.y + 2), TEXT_COLOR, xLabels.Get(x));
         }
         for (int y = y_min; y <= y_max; y++)
         {
             float yi = origin.y - y * scale;
             draw_list->AddLine(ImVec2(canvas_p0.x, yi), ImVec2(canvas_p1.x, yi), GRID_COLOR);
             if ((scale > 15 || (y % 5 == 0)) && y != 0)
-                draw_list->AddText(ImVec2(origin.x + 2, yi - 14), TEXT_COLOR, std::to_string(y).c_str());
+                draw_list->AddText(ImVec2(origin.x + 2, yi - 14), TEXT_COLOR, yLabels.Get(y));
         }
     }
 
@@ -592,21 +360,6 @@ void RasterController::DrawCanvas()
         draw_list->AddLine(ImVec2(canvas_p1.x, origin.y), ImVec2(canvas_p1.x - 10, origin.y + 5), AXIS_COLOR, th);
     }
 
-    const ImU32 BORDER_COLOR = IM_COL32(0, 0, 0, 255);
-
-    for (const auto &p : Points)
-    {
-        ImVec2 p_min = ToScreen(p.x, p.y + 1);
-        ImVec2 p_max = ToScreen(p.x + 1, p.y);
-
-        ImU32 Point_COLOR = IM_COL32(50, 50, 50, (int)(p.alpha * 255));
-
-        draw_list->AddRectFilled(p_min, p_max, Point_COLOR);
-
-        if (scale > 5 && p.alpha > 0.3f)
-            draw_list->AddRect(p_min, p_max, BORDER_COLOR);
-    }
-
     const ImU32 IDEAL_COLOR = IM_COL32(0, 0, 255, 100);
     if (currentAlgo != ALGO_BRESENHAM_CIRCLE)
     {
@@ -0,0 +1,243 @@
+#include "../include/Rasterizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+void Rasterizer::Run(const RasterTask &task, std::vector<Point> &points)
+{
+    points.clear();
+    PointSink sink{points};
+    Run(task, sink);
+}
+
+void Rasterizer::Run(const RasterTask &task, std::vector<Point> &points, const RasterBounds &clip)
+{
+    points.clear();
+    PointSink sink{points};
+    Run(task, sink, clip);
+}
+
+// Below this the float algorithms step their major coordinate exactly.
+static const long long FLOAT_EXACT = 1 << 24;
+
+static bool LineRange(const RasterTask &task, const RasterBounds &clip, RasterRange &range)
+{
+    long long dx = (long long)task.p2.x - task.p1.x;
+    long long dy = (long long)task.p2.y - task.p1.y;
+    bool steep = std::llabs(dy) > std::llabs(dx);
+    range.lo = steep ? clip.minY : clip.minX;
+    range.hi = steep ? clip.maxY : clip.maxX;
+
+    if (task.algo == ALGO_STEP_BY_STEP || task.algo == ALGO_DDA || task.algo == ALGO_WU)
+    {
+        long long extent = std::max(std::max(std::llabs(task.p1.x), std::llabs(task.p1.y)),
+                                    std::max(std::llabs(task.p2.x), std::llabs(task.p2.y)));
+        if (extent >= FLOAT_EXACT)
+            range = RasterRange();
+        return true;
+    }
+
+    // Liang-Barsky: the part t0..t1 of p1 + t * (p2 - p1) inside the clip
+    // grown by one pixel on every side.
+    double x0 = task.p1.x;
+    double y0 = task.p1.y;
+    double p[4] = {-(double)dx, (double)dx, -(double)dy, (double)dy};
+    double q[4] = {x0 - (clip.minX - 1.0), (clip.maxX + 1.0) - x0,
+                   y0 - (clip.minY - 1.0), (clip.maxY + 1.0) - y0};
+    double t0 = 0.0;
+    double t1 = 1.0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (p[i] == 0.0)
+        {
+            if (q[i] < 0.0)
+                return false;
+            continue;
+        }
+        double t = q[i] / p[i];
+        if (p[i] < 0.0)
+            t0 = std::max(t0, t);
+        else
+            t1 = std::min(t1, t);
+    }
+    if (t0 > t1)
+        return false;
+
+    double start = steep ? y0 : x0;
+    double delta = (double)(steep ? dy : dx);
+    double a = start + t0 * delta;
+    double b = start + t1 * delta;
+    range.lo = std::max(range.lo, (int)std::floor(std::min(a, b)) - 1);
+    range.hi = std::min(range.hi, (int)std::ceil(std::max(a, b)) + 1);
+    return range.lo <= range.hi;
+}
+
+// The circle walk plots (c.x +- x, c.y +- y) and (c.x +- y, c.y +- x) at
+// step x, with y = BresenhamCircleY(r, x) never growing. So each octant is
+// inside the clip on an interval of steps: exact bounds from its coordinate
+// in x, a binary search for the one in y.
+static int CircleRanges(Point c, int r, const RasterBounds &clip, RasterRange *ranges)
+{
+    if (r <= 0)
+    {
+        ranges[0] = {0, 0};
+        return 1;
+    }
+
+    // First step with y <= hi and last step with y >= lo.
+    auto firstAtMost = [&](long long hi)
+    {
+        long long lo = 0, top = (long long)r + 1;
+        while (lo < top)
+        {
+            long long mid = (lo + top) / 2;
+            if (RasterAlgorithms::BresenhamCircleY(r, (int)mid) <= hi)
+                top = mid;
+            else
+                lo = mid + 1;
+        }
+        return lo;
+    };
+    auto lastAtLeast = [&](long long lo)
+    {
+        long long bottom = -1, hi = r;
+        while (bottom < hi)
+        {
+            long long mid = (bottom + hi + 1) / 2;
+            if (RasterAlgorithms::BresenhamCircleY(r, (int)mid) >= lo)
+                bottom = mid;
+            else
+                hi = mid - 1;
+        }
+        return bottom;
+    };
+
+    RasterRange found[8];
+    int count = 0;
+    for (int octant = 0; octant < 8; octant++)
+    {
+        int sx = (octant & 1) ? -1 : 1;
+        int sy = (octant & 2) ? -1 : 1;
+        bool swapped = (octant & 4) != 0;
+
+        // The clip as offsets along the octant's x and y directions.
+        long long xMin = swapped ? clip.minY - (long long)c.y : clip.minX - (long long)c.x;
+        long long xMax = swapped ? clip.maxY - (long long)c.y : clip.maxX - (long long)c.x;
+        long long yMin = swapped ? clip.minX - (long long)c.x : clip.minY - (long long)c.y;
+        long long yMax = swapped ? clip.maxX - (long long)c.x : clip.maxY - (long long)c.y;
+        if (sx < 0)
+        {
+            std::swap(xMin, xMax);
+            xMin = -xMin;
+            xMax = -xMax;
+        }
+        if (sy < 0)
+        {
+            std::swap(yMin, yMax);
+            yMin = -yMin;
+            yMax = -yMax;
+        }
+
+        long long lo = std::max(std::max(0LL, xMin), firstAtMost(yMax));
+        long long hi = std::min(std::min((long long)r, xMax), lastAtLeast(yMin));
+        if (lo > hi)
+            continue;
+        // Kept sorted by lo.
+        int at = count++;
+        for (; at > 0 && found[at - 1].lo > lo; at--)
+            found[at] = found[at - 1];
+        found[at] = {(int)lo, (int)hi};
+    }
+
+    int merged = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (merged > 0 && found[i].lo <= ranges[merged - 1].hi + 1)
+            ranges[merged - 1].hi = std::max(ranges[merged - 1].hi, found[i].hi);
+        else
+            ranges[merged++] = found[i];
+    }
+    return merged;
+}
+
+int Rasterizer::ClipRanges(const RasterTask &task, const RasterBounds &clip, RasterRange *ranges)
+{
+    if (clip.minX > clip.maxX || clip.minY > clip.maxY)
+        return 0;
+    if (task.algo == ALGO_BRESENHAM_CIRCLE)
+        return CircleRanges(task.p1, task.radius, clip, ranges);
+    return LineRange(task, clip, ranges[0]) ? 1 : 0;
+}
+
+size_t Rasterizer::MaxPixels(const RasterTask &task)
+{
+    if (task.algo == ALGO_BRESENHAM_CIRCLE)
+        return 8 * ((size_t)std::max(0, task.radius) + 1);
+
+    long long dx = std::llabs((long long)task.p2.x - task.p1.x);
+    long long dy = std::llabs((long long)task.p2.y - task.p1.y);
+    size_t major = (size_t)std::max(dx, dy);
+    // Wu plots two pixels per column plus two at each end.
+    bool wu = task.algo == ALGO_WU || task.algo == ALGO_WU_FIXED;
+    return wu ? 2 * major + 4 : major + 1;
+}
+
+RasterBounds Rasterizer::Bounds(const RasterTask &task)
+{
+    if (task.algo == ALGO_BRESENHAM_CIRCLE)
+    {
+        int r = std::max(0, task.radius);
+        return {task.p1.x - r, task.p1.y - r, task.p1.x + r, task.p1.y + r};
+    }
+    return {std::min(task.p1.x, task.p2.x), std::min(task.p1.y, task.p2.y),
+            std::max(task.p1.x, task.p2.x) + 1, std::max(task.p1.y, task.p2.y) + 1};
+}
+
+static void ClampAxis(int &lo, int &hi, int center, int maxSide)
+{
+    if (hi - lo + 1 <= maxSide)
+        return;
+    lo = std::max(lo, std::min(center - maxSide / 2, hi - maxSide + 1));
+    hi = lo + maxSide - 1;
+}
+
+RasterBounds Rasterizer::Bounds(const RasterTask &task, int maxSide)
+{
+    return Bounds(task, maxSide, task.p1.x, task.p1.y);
+}
+
+RasterBounds Rasterizer::Bounds(const RasterTask &task, int maxSide, int centerX, int centerY)
+{
+    RasterBounds b = Bounds(task);
+    ClampAxis(b.minX, b.maxX, centerX, maxSide);
+    ClampAxis(b.minY, b.maxY, centerY, maxSide);
+    return b;
+}
+
+const char *Rasterizer::Name(RasterAlgorithm algo)
+{
+    switch (algo)
+    {
+    case ALGO_STEP_BY_STEP:
+        return "step";
+    case ALGO_DDA:
+        return "dda";
+    case ALGO_BRESENHAM_LINE:
+        return "bresenham";
+    case ALGO_BRESENHAM_CIRCLE:
+        return "bresenham_circle";
+    case ALGO_CASTLE_PITEWAY:
+        return "castle_pitteway";
+    case ALGO_WU:
+        return "wu";
+    case ALGO_BRESENHAM_RUN_SLICE:
+        return "bresenham_runs";
+    case ALGO_DOUBLE_STEP:
+        return "double_step";
+    case ALGO_WU_FIXED:
+        return "wu_fixed";
+    case ALGO_COUNT:
+        break;
+    }
+    return "";
+}
@@ -0,0 +1,378 @@
+#include "../include/Rasterizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+// Lab_3_bench [--trials N] [--warmup N] [--min-us US] [--pin CPU]
+//             [--sink count|points|soa|gray|spans|fb|fbtiled|fbrgba|fbspans]
+//             [--format csv|json|markdown] [--out FILE] [--quick]
+//
+// Sweeps segment length and octant for every line algorithm and the radius
+// for the circle. Each trial times a batch of calls long enough for the
+// clock; trials outside Tukey's fences (1.5 IQR beyond the quartiles) are
+// dropped before the statistics are taken. The sink decides what a plotted
+// pixel costs: `count` measures the algorithm alone, `points` the
+// std::vector<Point> the canvas used to draw from, the `fb` sinks blended
+// writes into a Framebuffer (GRAY8 linear or tiled, RGBA8, or GRAY8 through
+// span fills).
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int trials = 30;
+    int warmup = 3;
+    double minBatchUs = 1000.0;
+    int pinCpu = -1;
+    std::string sink = "count";
+    std::string format = "csv";
+    std::string out;
+    bool quick = false;
+};
+
+struct Result {
+    RasterAlgorithm algo;
+    int length;
+    int octant;
+    size_t pixels;
+    int batch;
+    int kept;
+    int trials;
+    double minNs;
+    double medianNs;
+    double meanNs;
+    double stddevNs;
+    double ci95Ns;
+};
+
+static bool PinToCpu(int cpu)
+{
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Endpoint of a segment of the given length in the middle of an octant:
+// octant k spans [45k, 45(k + 1)) degrees.
+static Point OctantEnd(int length, int octant)
+{
+    const double angle = (octant * 45.0 + 22.5) * 3.14159265358979323846 / 180.0;
+    return {(int)std::lround(length * std::cos(angle)), (int)std::lround(length * std::sin(angle)), 1.0f};
+}
+
+static double Quartile(const std::vector<double> &sorted, double q)
+{
+    double pos = q * (double)(sorted.size() - 1);
+    size_t lo = (size_t)pos;
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - (double)lo);
+}
+
+// Keeps sink results observable so no call is optimized away.
+static uint64_t g_sinkGuard = 0;
+
+// Side of the screen-sized targets of the gray and framebuffer sinks,
+// centered on the origin; pixels outside are clipped.
+static const int GRAY_SIZE = 2048;
+
+template <typename F>
+static Result Measure(const RasterTask &task, int length, int octant, const Options &options, F &&call)
+{
+    Result r = {};
+    r.algo = task.algo;
+    r.length = length;
+    r.octant = octant;
+    r.trials = options.trials;
+
+    CountSink counter;
+    Rasterizer::Run(task, counter);
+    r.pixels = counter.count;
+
+    call();
+    Clock::time_point start = Clock::now();
+    call();
+    double onceUs = std::max(0.01, std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    r.batch = (int)std::max(1.0, std::ceil(options.minBatchUs / onceUs));
+
+    for (int w = 0; w < options.warmup; w++)
+        for (int i = 0; i < r.batch; i++)
+            call();
+
+    std::vector<double> samples;
+    samples.reserve(options.trials);
+    for (int t = 0; t < options.trials; t++)
+    {
+        start = Clock::now();
+        for (int i = 0; i < r.batch; i++)
+            call();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        samples.push_back(ns / r.batch);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double q1 = Quartile(samples, 0.25);
+    double q3 = Quartile(samples, 0.75);
+    double lo = q1 - 1.5 * (q3 - q1);
+    double hi = q3 + 1.5 * (q3 - q1);
+
+    std::vector<double> kept;
+    for (double s : samples)
+        if (s >= lo && s <= hi)
+            kept.push_back(s);
+
+    double sum = 0.0;
+    for (double s : kept)
+        sum += s;
+    r.kept = (int)kept.size();
+    r.meanNs = sum / r.kept;
+
+    double var = 0.0;
+    for (double s : kept)
+        var += (s - r.meanNs) * (s - r.meanNs);
+    r.stddevNs = r.kept > 1 ? std::sqrt(var / (r.kept - 1)) : 0.0;
+    r.ci95Ns = 1.96 * r.stddevNs / std::sqrt((double)r.kept);
+    r.minNs = kept.front();
+    r.medianNs = Quartile(kept, 0.5);
+    return r;
+}
+
+static Result MeasureWithSink(const RasterTask &task, int length, int octant, const Options &options)
+{
+    if (options.sink == "points")
+    {
+        std::vector<Point> points;
+        return Measure(task, length, octant, options, [&]
+                       { Rasterizer::Run(task, points); });
+    }
+    if (options.sink == "soa")
+    {
+        SoaSink soa;
+        const size_t capacity = Rasterizer::MaxPixels(task);
+        return Measure(task, length, octant, options, [&]
+                       {
+                           soa.Reset(capacity);
+                           Rasterizer::Run(task, soa);
+                           g_sinkGuard += soa.count; });
+    }
+    if (options.sink == "gray")
+    {
+        std::vector<uint8_t> pixels((size_t)GRAY_SIZE * GRAY_SIZE);
+        GraySink gray = {pixels.data(), GRAY_SIZE, GRAY_SIZE, GRAY_SIZE, -GRAY_SIZE / 2, GRAY_SIZE / 2};
+        Result r = Measure(task, length, octant, options, [&]
+                           { Rasterizer::Run(task, gray); });
+        g_sinkGuard += pixels[(size_t)GRAY_SIZE * GRAY_SIZE / 2 + GRAY_SIZE / 2];
+        return r;
+    }
+    if (options.sink == "fb" || options.sink == "fbtiled" || options.sink == "fbrgba")
+    {
+        Framebuffer target(GRAY_SIZE, GRAY_SIZE,
+                           options.sink == "fbrgba" ? Framebuffer::FORMAT_RGBA8 : Framebuffer::FORMAT_GRAY8,
+                           options.sink == "fbtiled" ? Framebuffer::LAYOUT_TILED : Framebuffer::LAYOUT_LINEAR);
+        target.Clear(0);
+        FramebufferSink sink = {target, 0xFF323232u, -GRAY_SIZE / 2, GRAY_SIZE / 2};
+        Result r = Measure(task, length, octant, options, [&]
+                           { Rasterizer::Run(task, sink); });
+        g_sinkGuard += target.Data()[target.Offset(GRAY_SIZE / 2, GRAY_SIZE / 2)];
+        return r;
+    }
+    if (options.sink == "fbspans")
+    {
+        Framebuffer target(GRAY_SIZE, GRAY_SIZE, Framebuffer::FORMAT_GRAY8);
+        target.Clear(0);
+        FramebufferSpanWriter writer = {&target, 255, -GRAY_SIZE / 2, GRAY_SIZE / 2};
+        Result r = Measure(task, length, octant, options, [&]
+                           {
+                               auto spans = MakeSpanSink(writer);
+                               Rasterizer::Run(task, spans);
+                               spans.Flush(); });
+        g_sinkGuard += target.Data()[target.Offset(GRAY_SIZE / 2, GRAY_SIZE / 2)];
+        return r;
+    }
+    if (options.sink == "spans")
+    {
+        return Measure(task, length, octant, options, [&]
+                       {
+                           auto spans = MakeSpanSink([](int y, int x0, int x1, float)
+                                                     { g_sinkGuard += (uint64_t)(x1 - x0 + 1 + y); });
+                           Rasterizer::Run(task, spans);
+                           spans.Flush(); });
+    }
+    return Measure(task, length, octant, options, [&]
+                   {
+                       CountSink counter;
+                       Rasterizer::Run(task, counter);
+                       g_sinkGuard += counter.checksum + counter.count; });
+}
+
+static void WriteCsv(FILE *f, const std::vector<Result> &results, const char *sink)
+{
+    fprintf(f, "algorithm,sink,length,octant,pixels,batch,trials,kept,min_ns,median_ns,mean_ns,stddev_ns,ci95_ns,ns_per_pixel\n");
+    for (const Result &r : results)
+        fprintf(f, "%s,%s,%d,%d,%zu,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f\n", Rasterizer::Name(r.algo), sink, r.length, r.octant,
+                r.pixels, r.batch, r.trials, r.kept, r.minNs, r.medianNs, r.meanNs, r.stddevNs, r.ci95Ns,
+                r.medianNs / (double)std::max<size_t>(1, r.pixels));
+}
+
+static void WriteJson(FILE *f, const std::vector<Result> &results, const char *sink)
+{
+    fprintf(f, "[\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        fprintf(f,
+                "  {\"algorithm\": \"%s\", \"sink\": \"%s\", \"length\": %d, \"octant\": %d, \"pixels\": %zu, \"batch\": %d, \"trials\": %d, "
+                "\"kept\": %d, \"min_ns\": %.1f, \"median_ns\": %.1f, \"mean_ns\": %.1f, \"stddev_ns\": %.1f, "
+                "\"ci95_ns\": %.1f}%s\n",
+                Rasterizer::Name(r.algo), sink, r.length, r.octant, r.pixels, r.batch, r.trials, r.kept, r.minNs, r.medianNs,
+                r.meanNs, r.stddevNs, r.ci95Ns, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "]\n");
+}
+
+// Median over octants of the per-call median, one row per algorithm and one
+// column per length (radius for the circle), in microseconds.
+static void WriteMarkdown(FILE *f, const std::vector<Result> &results, const std::vector<int> &lengths)
+{
+    fprintf(f, "| Алгоритм |");
+    for (int length : lengths)
+        fprintf(f, " %d |", length);
+    fprintf(f, "\n|---|");
+    for (size_t i = 0; i < lengths.size(); i++)
+        fprintf(f, "---|");
+    fprintf(f, "\n");
+
+    for (int a = 0; a < ALGO_COUNT; a++)
+    {
+        fprintf(f, "| %s |", Rasterizer::Name((RasterAlgorithm)a));
+        for (int length : lengths)
+        {
+            std::vector<double> medians;
+            for (const Result &r : results)
+                if (r.algo == a && r.length == length)
+                    medians.push_back(r.medianNs);
+            std::sort(medians.begin(), medians.end());
+            if (medians.empty())
+                fprintf(f, " – |");
+            else
+                fprintf(f, " %.2f |", Quartile(medians, 0.5) / 1000.0);
+        }
+        fprintf(f, "\n");
+    }
+}
+
+static bool ParseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--quick") == 0)
+        {
+            options.quick = true;
+            continue;
+        }
+        if (!value)
+            return false;
+        if (strcmp(arg, "--trials") == 0)
+            options.trials = std::max(1, atoi(value));
+        else if (strcmp(arg, "--warmup") == 0)
+            options.warmup = std::max(0, atoi(value));
+        else if (strcmp(arg, "--min-us") == 0)
+            options.minBatchUs = std::max(1.0, atof(value));
+        else if (strcmp(arg, "--pin") == 0)
+            options.pinCpu = atoi(value);
+        else if (strcmp(arg, "--sink") == 0)
+            options.sink = value;
+        else if (strcmp(arg, "--format") == 0)
+            options.format = value;
+        else if (strcmp(arg, "--out") == 0)
+            options.out = value;
+        else
+            return false;
+        i++;
+    }
+    const char *sinks[] = {"count", "points", "soa", "gray", "spans", "fb", "fbtiled", "fbrgba", "fbspans"};
+    if (std::find(std::begin(sinks), std::end(sinks), options.sink) == std::end(sinks))
+        return false;
+    return options.format == "csv" || options.format == "json" || options.format == "markdown";
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "usage: %s [--trials N] [--warmup N] [--min-us US] [--pin CPU] "
+                        "[--sink count|points|soa|gray|spans|fb|fbtiled|fbrgba|fbspans]\n"
+                        "       [--format csv|json|markdown] [--out FILE] [--quick]\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (options.pinCpu >= 0 && !PinToCpu(options.pinCpu))
+        fprintf(stderr, "cannot pin to CPU %d, running unpinned\n", options.pinCpu);
+
+    std::vector<int> lengths = {16, 128, 1024, 8192};
+    if (options.quick)
+    {
+        lengths = {16, 1024};
+        options.trials = std::min(options.trials, 10);
+    }
+
+    std::vector<Result> results;
+    for (int a = 0; a < ALGO_COUNT; a++)
+    {
+        RasterAlgorithm algo = (RasterAlgorithm)a;
+        for (int length : lengths)
+        {
+            if (algo == ALGO_BRESENHAM_CIRCLE)
+            {
+                RasterTask task = {algo, {0, 0, 1.0f}, {0, 0, 1.0f}, length};
+                results.push_back(MeasureWithSink(task, length, -1, options));
+                continue;
+            }
+            for (int octant = 0; octant < 8; octant++)
+            {
+                RasterTask task = {algo, {0, 0, 1.0f}, OctantEnd(length, octant), 0};
+                results.push_back(MeasureWithSink(task, length, octant, options));
+            }
+        }
+        fprintf(stderr, "%s done (%s)\n", Rasterizer::Name(algo), options.sink.c_str());
+    }
+
+    FILE *f = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "cannot write %s\n", options.out.c_str());
+        return 1;
+    }
+    if (options.format == "json")
+        WriteJson(f, results, options.sink.c_str());
+    else if (options.format == "markdown")
+        WriteMarkdown(f, results, lengths);
+    else
+        WriteCsv(f, results, options.sink.c_str());
+    if (f != stdout)
+        fclose(f);
+    fprintf(stderr, "guard %llu\n", (unsigned long long)g_sinkGuard);
+    return 0;
+}
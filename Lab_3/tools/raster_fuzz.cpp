@@ -0,0 +1,183 @@
+#include "../include/Rasterizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <tuple>
+#include <vector>
+
+// Lab_3_fuzz [cases] [seed]
+//
+// Runs every algorithm on random segments and circles, clipped to a random
+// rectangle, and compares the result with the unclipped run filtered by the
+// same rectangle: the pixels, their alpha and their order must be the same
+// (as a multiset for the double step, which plots from both ends). Segments
+// reach 200000 pixels, clips are placed around a point of the primitive and
+// include thin and single-pixel ones. Case i is generated from (seed, i)
+// alone, so a failure is reproduced by the same arguments.
+
+static const int SCALES[] = {8, 300, 5000, 200000};
+static const int MAX_CLIP_SIDE = 3000;
+static const int MAX_REPORTS = 20;
+
+// SplitMix64 over (seed, case).
+struct Random {
+    uint64_t state;
+
+    uint64_t Next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [lo, hi].
+    int Range(int lo, int hi) {
+        return lo + (int)(Next() % (uint64_t)((int64_t)hi - lo + 1));
+    }
+};
+
+static int g_failures = 0;
+static size_t g_runs = 0;
+static size_t g_fullPixels = 0;
+static size_t g_clippedPixels = 0;
+
+static bool Inside(const Point &p, const RasterBounds &clip)
+{
+    return p.x >= clip.minX && p.x <= clip.maxX && p.y >= clip.minY && p.y <= clip.maxY;
+}
+
+static bool SamePixel(const Point &a, const Point &b)
+{
+    return a.x == b.x && a.y == b.y && a.alpha == b.alpha;
+}
+
+static bool PixelLess(const Point &a, const Point &b)
+{
+    return std::make_tuple(a.x, a.y, a.alpha) < std::make_tuple(b.x, b.y, b.alpha);
+}
+
+static void Report(int index, const RasterTask &task, const RasterBounds &clip, const std::vector<Point> &expected,
+                   const std::vector<Point> &actual)
+{
+    ++g_failures;
+    if (g_failures > MAX_REPORTS)
+        return;
+    size_t i = 0;
+    while (i < expected.size() && i < actual.size() && SamePixel(expected[i], actual[i]))
+        i++;
+    printf("MISMATCH case %d %s: (%d, %d)-(%d, %d) r=%d, clip [%d, %d]x[%d, %d]\n", index, Rasterizer::Name(task.algo),
+           task.p1.x, task.p1.y, task.p2.x, task.p2.y, task.radius, clip.minX, clip.maxX, clip.minY, clip.maxY);
+    printf("  %zu pixels expected, %zu clipped; first difference at %zu", expected.size(), actual.size(), i);
+    if (i < expected.size())
+        printf(", expected (%d, %d, %.3f)", expected[i].x, expected[i].y, expected[i].alpha);
+    if (i < actual.size())
+        printf(", got (%d, %d, %.3f)", actual[i].x, actual[i].y, actual[i].alpha);
+    printf("\n");
+}
+
+// A segment at one of the scales, sometimes a point, a horizontal, vertical
+// or diagonal line; the circle radius is at the same scale.
+static void MakeGeometry(Random &rng, Point &p1, Point &p2, int &radius)
+{
+    const int scale = SCALES[rng.Range(0, 3)];
+    p1 = {rng.Range(-scale, scale), rng.Range(-scale, scale), 1.0f};
+    p2 = {rng.Range(-scale, scale), rng.Range(-scale, scale), 1.0f};
+    radius = rng.Range(0, scale);
+
+    switch (rng.Range(0, 7)) {
+    case 0:
+        p2 = p1;
+        break;
+    case 1:
+        p2.y = p1.y;
+        break;
+    case 2:
+        p2.x = p1.x;
+        break;
+    case 3:
+        p2.y = p1.y + (p2.x - p1.x) * (rng.Range(0, 1) ? 1 : -1);
+        break;
+    default:
+        break;
+    }
+}
+
+// Around a point of the primitive, so most clips cut it; a fifth are at
+// most 4 pixels wide and high, and some miss it altogether.
+static RasterBounds MakeClip(Random &rng, const RasterTask &task)
+{
+    int cx, cy;
+    if (task.algo == ALGO_BRESENHAM_CIRCLE) {
+        cx = task.p1.x + (rng.Range(0, 1) ? task.radius : -task.radius);
+        cy = task.p1.y + rng.Range(-task.radius, task.radius);
+    } else {
+        double t = rng.Range(0, 1 << 20) / (double)(1 << 20);
+        cx = task.p1.x + (int)((task.p2.x - task.p1.x) * t);
+        cy = task.p1.y + (int)((task.p2.y - task.p1.y) * t);
+    }
+    const int offset = rng.Range(0, 3) == 0 ? MAX_CLIP_SIDE : 8;
+    cx += rng.Range(-offset, offset);
+    cy += rng.Range(-offset, offset);
+
+    const int side = rng.Range(0, 4) == 0 ? 3 : MAX_CLIP_SIDE;
+    RasterBounds clip;
+    clip.minX = cx - rng.Range(0, side);
+    clip.minY = cy - rng.Range(0, side);
+    clip.maxX = cx + rng.Range(0, side);
+    clip.maxY = cy + rng.Range(0, side);
+    return clip;
+}
+
+static void RunCase(uint64_t seed, int index)
+{
+    Random rng = {seed * 0xD1B54A32D192ED03ull + (uint64_t)index};
+    RasterTask task = {ALGO_STEP_BY_STEP, {0, 0, 1.0f}, {0, 0, 1.0f}, 0};
+    MakeGeometry(rng, task.p1, task.p2, task.radius);
+
+    std::vector<Point> full;
+    std::vector<Point> expected;
+    std::vector<Point> actual;
+    for (int a = 0; a < ALGO_COUNT; a++) {
+        task.algo = (RasterAlgorithm)a;
+        const RasterBounds clip = MakeClip(rng, task);
+
+        Rasterizer::Run(task, full);
+        Rasterizer::Run(task, actual, clip);
+        expected.clear();
+        for (const Point &p : full)
+            if (Inside(p, clip))
+                expected.push_back(p);
+
+        if (task.algo == ALGO_DOUBLE_STEP) {
+            std::sort(expected.begin(), expected.end(), PixelLess);
+            std::sort(actual.begin(), actual.end(), PixelLess);
+        }
+        if (expected.size() != actual.size() || !std::equal(expected.begin(), expected.end(), actual.begin(), SamePixel))
+            Report(index, task, clip, expected, actual);
+
+        g_runs++;
+        g_fullPixels += full.size();
+        g_clippedPixels += actual.size();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int cases = argc > 1 ? atoi(argv[1]) : 500;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+    printf("%d cases, seed %llu\n", cases, (unsigned long long)seed);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < cases; i++)
+        RunCase(seed, i);
+    auto end = std::chrono::steady_clock::now();
+
+    if (g_failures > MAX_REPORTS)
+        printf("... %d more\n", g_failures - MAX_REPORTS);
+    printf("%zu runs, %zu of %zu pixels inside the clips, %d mismatches, %.1f s\n", g_runs, g_clippedPixels, g_fullPixels,
+           g_failures, std::chrono::duration<double>(end - start).count());
+    return g_failures == 0 ? 0 : 1;
+}